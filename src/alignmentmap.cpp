@@ -0,0 +1,126 @@
+#include "alignmentmap.h"
+#include <algorithm>
+
+AlignmentMap::AlignmentMap()
+{
+}
+
+void AlignmentMap::clear()
+{
+    anchors.clear();
+    changedRegions.clear();
+}
+
+bool AlignmentMap::isEmpty() const
+{
+    return anchors.isEmpty();
+}
+
+void AlignmentMap::build(QVector<Change> changes, int lines1, int lines2)
+{
+    clear();
+    std::sort(changes.begin(), changes.end(), [](const Change &a, const Change &b) {
+        return a.left0 != b.left0 ? a.left0 < b.left0 : a.right0 < b.right0;
+    });
+
+    // Anchors come in pairs: where a change starts and where it ends. Lines
+    // between two changes pair up one to one.
+    Anchor current = { 0, 0, 0 };
+    anchors.append(current);
+    for (const Change &change : std::as_const(changes)) {
+        if (change.type == DiffHunk::Moved) {
+            continue;
+        }
+        const bool overlaps = change.left0 < current.left || change.right0 < current.right;
+        if (overlaps && !changedRegions.isEmpty()) {
+            // Several changes on the same lines of either side, as token
+            // diffs give; only one wholly behind the previous change on the
+            // right cannot be aligned
+            const Anchor &start = anchors[anchors.size() - 2];
+            if (change.right1 <= start.right && change.right0 < start.right) {
+                continue;
+            }
+            Anchor &end = anchors.last();
+            end.left = qMax(end.left, change.left1);
+            end.right = qMax(end.right, change.right1);
+            end.row = start.row + qMax(end.left - start.left, end.right - start.right);
+            Region &region = changedRegions.last();
+            region.row1 = end.row;
+            if (region.type != change.type) {
+                region.type = DiffHunk::Modified;
+            }
+            current = end;
+            continue;
+        }
+        if (overlaps) {
+            continue;
+        }
+
+        Anchor start = { change.left0, change.right0,
+                         current.row + qMax(change.left0 - current.left, change.right0 - current.right) };
+        Anchor end = { qMax(change.left1, change.left0), qMax(change.right1, change.right0), 0 };
+        end.row = start.row + qMax(end.left - start.left, end.right - start.right);
+        anchors.append(start);
+        anchors.append(end);
+        changedRegions.append({ change.type, start.row, end.row });
+        current = end;
+    }
+
+    Anchor last = { qMax(lines1, current.left), qMax(lines2, current.right), 0 };
+    last.row = current.row + qMax(last.left - current.left, last.right - current.right);
+    anchors.append(last);
+}
+
+int AlignmentMap::rowCount() const
+{
+    return anchors.isEmpty() ? 0 : anchors.last().row;
+}
+
+double AlignmentMap::toRow(int side, double line) const
+{
+    if (anchors.isEmpty()) {
+        return line;
+    }
+
+    // Last anchor at or before the line; anchors that share a coordinate
+    // (an insertion on the other side) resolve to the later one
+    auto it = std::upper_bound(anchors.constBegin(), anchors.constEnd(), line,
+                               [this, side](double value, const Anchor &anchor) {
+                                   return value < coordinate(anchor, side);
+                               });
+    if (it == anchors.constBegin()) {
+        return line;
+    }
+    const Anchor &a = *(it - 1);
+    if (it == anchors.constEnd()) {
+        return a.row + (line - coordinate(a, side));
+    }
+    const Anchor &b = *it;
+    const double span = coordinate(b, side) - coordinate(a, side);
+    return a.row + (line - coordinate(a, side)) * (b.row - a.row) / span;
+}
+
+double AlignmentMap::fromRow(int side, double row) const
+{
+    if (anchors.isEmpty()) {
+        return row;
+    }
+
+    auto it = std::upper_bound(anchors.constBegin(), anchors.constEnd(), row,
+                               [](double value, const Anchor &anchor) { return value < anchor.row; });
+    if (it == anchors.constBegin()) {
+        return row;
+    }
+    const Anchor &a = *(it - 1);
+    if (it == anchors.constEnd()) {
+        return coordinate(a, side) + (row - a.row);
+    }
+    // Across an insertion on the other side this side stands still
+    const Anchor &b = *it;
+    return coordinate(a, side) + (row - a.row) * (coordinate(b, side) - coordinate(a, side)) / (b.row - a.row);
+}
+
+double AlignmentMap::map(int fromSide, double line) const
+{
+    return fromRow(fromSide == 1 ? 2 : 1, toRow(fromSide, line));
+}
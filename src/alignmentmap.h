@@ -0,0 +1,60 @@
+#ifndef ALIGNMENTMAP_H
+#define ALIGNMENTMAP_H
+
+#include <QVector>
+#include "diffengine.h"
+
+// Monotone correspondence between the lines of two texts, built once per
+// diff from its changes. Positions are also given as rows: the lines of a
+// view where both sides are shown aligned, a change taking as many rows as
+// its longer side. Lookups are binary searches over two anchors per change.
+class AlignmentMap
+{
+public:
+    // A change as half-open line ranges
+    struct Change {
+        DiffHunk::Type type;
+        int left0;
+        int left1;
+        int right0;
+        int right1;
+    };
+
+    AlignmentMap();
+
+    // Changes are taken in order of their left start. Ones that overlap the
+    // previous change on either side are merged into it; moved text and
+    // changes that lie wholly before the previous one on the right cannot
+    // be aligned and are left out.
+    void build(QVector<Change> changes, int lines1, int lines2);
+    void clear();
+    bool isEmpty() const;
+
+    int rowCount() const;
+    // side is 1 (left) or 2 (right); lines and rows may be fractional
+    double toRow(int side, double line) const;
+    double fromRow(int side, double row) const;
+    double map(int fromSide, double line) const;
+
+    // The aligned changes with their row ranges, for the overview ruler
+    struct Region {
+        DiffHunk::Type type;
+        int row0;
+        int row1;
+    };
+    const QVector<Region> &regions() const { return changedRegions; }
+
+private:
+    struct Anchor {
+        int left;
+        int right;
+        int row;
+    };
+
+    int coordinate(const Anchor &anchor, int side) const { return side == 1 ? anchor.left : anchor.right; }
+
+    QVector<Anchor> anchors;
+    QVector<Region> changedRegions;
+};
+
+#endif // ALIGNMENTMAP_H
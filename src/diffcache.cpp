@@ -0,0 +1,146 @@
+#include "diffcache.h"
+#include "fasthash.h"
+#include "filecomparator.h"
+#include <QFile>
+#include <QMutexLocker>
+
+namespace {
+
+// Paths whose hashes are remembered; the table is simply dropped when full
+const int kMaxKnownHashes = 65536;
+
+qsizetype entryCost(const DiffCache::Entry &entry)
+{
+    return (entry.text1.size() + entry.text2.size()) * qsizetype(sizeof(QChar))
+         + entry.hunks.size() * qsizetype(sizeof(DiffHunk));
+}
+
+} // namespace
+
+DiffCache::DiffCache(qint64 capacityBytes)
+{
+    entries.setMaxCost(capacityBytes);
+}
+
+void DiffCache::setCapacity(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    entries.setMaxCost(bytes);
+}
+
+bool DiffCache::makeKey(const QString &file1, const QString &file2, quint32 options, Key *key,
+                        QByteArray *data1, QByteArray *data2)
+{
+    bool ok1 = false;
+    bool ok2 = false;
+    key->hash1 = contentHash(file1, &ok1, data1);
+    key->hash2 = contentHash(file2, &ok2, data2);
+    key->options = options;
+    return ok1 && ok2;
+}
+
+bool DiffCache::find(const Key &key, Entry *entry)
+{
+    QMutexLocker locker(&mutex);
+    // object() marks the entry as most recently used
+    const Entry *cached = entries.object(key);
+    if (!cached) {
+        return false;
+    }
+    // Copies share the texts and hunks with the cached entry
+    *entry = *cached;
+    return true;
+}
+
+bool DiffCache::markPending(const Key &key)
+{
+    QMutexLocker locker(&mutex);
+    if (entries.contains(key) || pending.contains(key)) {
+        return false;
+    }
+    pending.insert(key);
+    return true;
+}
+
+void DiffCache::unmarkPending(const Key &key)
+{
+    QMutexLocker locker(&mutex);
+    pending.remove(key);
+    pendingDone.wakeAll();
+}
+
+bool DiffCache::waitForPending(const Key &key)
+{
+    QMutexLocker locker(&mutex);
+    bool waited = false;
+    while (pending.contains(key)) {
+        waited = true;
+        pendingDone.wait(&mutex);
+    }
+    return waited;
+}
+
+void DiffCache::insert(const Key &key, const Entry &entry)
+{
+    QMutexLocker locker(&mutex);
+    // An entry larger than the whole cache is not kept
+    entries.insert(key, new Entry(entry), entryCost(entry));
+    if (pending.remove(key)) {
+        pendingDone.wakeAll();
+    }
+}
+
+quint64 DiffCache::contentHash(const QString &path, bool *ok, QByteArray *data)
+{
+    FileMeta meta = FileMeta::read(path);
+    if (meta.size < 0) {
+        *ok = false;
+        return 0;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        auto it = knownHashes.constFind(path);
+        if (it != knownHashes.constEnd() && it->meta.size == meta.size
+            && it->meta.mtime == meta.mtime && it->meta.inode == meta.inode) {
+            *ok = true;
+            return it->hash;
+        }
+    }
+
+    // Hash outside the lock; a prefetch and the GUI thread may both get here.
+    // A caller about to diff the file gets the bytes that were hashed.
+    quint64 hash;
+    if (data) {
+        QFile file(path);
+        *ok = file.open(QIODevice::ReadOnly);
+        if (*ok) {
+            *data = file.readAll();
+            *ok = file.error() == QFileDevice::NoError;
+        }
+        hash = *ok ? FastHash::hash(data->constData(), data->size()) : 0;
+    } else {
+        hash = FileComparator::hashFile(path, ok);
+    }
+    if (*ok && !meta.isRacy()) {
+        QMutexLocker locker(&mutex);
+        if (knownHashes.size() >= kMaxKnownHashes) {
+            knownHashes.clear();
+        }
+        KnownHash known;
+        known.meta = meta;
+        known.hash = hash;
+        knownHashes.insert(path, known);
+    }
+    return hash;
+}
+
+bool operator==(const DiffCache::Key &a, const DiffCache::Key &b)
+{
+    return a.hash1 == b.hash1 && a.hash2 == b.hash2 && a.options == b.options;
+}
+
+size_t qHash(const DiffCache::Key &key, size_t seed)
+{
+    return qHashMulti(seed, key.hash1, key.hash2, key.options);
+}
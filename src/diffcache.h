@@ -0,0 +1,76 @@
+#ifndef DIFFCACHE_H
+#define DIFFCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include "diffengine.h"
+#include "foldermanifest.h"
+
+// Bounded LRU cache of text diffs, so a pair that was seen or prefetched
+// before is shown without reading or diffing it again.
+//
+// Entries are keyed by the content hashes of both files and the diff
+// options, which keeps them valid across renames and reloads of unchanged
+// files. A file's hash is remembered while its size, mtime and inode stay
+// the same, the rule FolderManifest uses, so a lookup normally costs two
+// stat() calls. All methods are thread-safe.
+class DiffCache
+{
+public:
+    struct Key {
+        quint64 hash1;
+        quint64 hash2;
+        quint32 options;
+    };
+
+    struct Entry {
+        QString text1;
+        QString text2;
+        QVector<DiffHunk> hunks;
+    };
+
+    explicit DiffCache(qint64 capacityBytes);
+
+    // Least recently used entries are dropped to fit
+    void setCapacity(qint64 bytes);
+    // Returns false if either file cannot be read. A file whose hash is
+    // not remembered is read to hash it; if data1 or data2 is given, it
+    // receives those bytes so a miss need not read the file again, and
+    // stays null for a file that was not read.
+    bool makeKey(const QString &file1, const QString &file2, quint32 options, Key *key,
+                 QByteArray *data1 = nullptr, QByteArray *data2 = nullptr);
+    bool find(const Key &key, Entry *entry);
+    // Marks a key as being computed, unless it is cached or already marked;
+    // insert() or unmarkPending() clear the mark
+    bool markPending(const Key &key);
+    void unmarkPending(const Key &key);
+    // Blocks while another thread computes this key; true if it did
+    bool waitForPending(const Key &key);
+    void insert(const Key &key, const Entry &entry);
+
+private:
+    struct KnownHash {
+        FileMeta meta;
+        quint64 hash;
+    };
+
+    quint64 contentHash(const QString &path, bool *ok, QByteArray *data);
+
+    // Cost is the approximate size of an entry in bytes
+    QCache<Key, Entry> entries;
+    QHash<QString, KnownHash> knownHashes;
+    QSet<Key> pending;
+    QMutex mutex;
+    QWaitCondition pendingDone;
+};
+
+bool operator==(const DiffCache::Key &a, const DiffCache::Key &b);
+size_t qHash(const DiffCache::Key &key, size_t seed = 0);
+
+#endif // DIFFCACHE_H
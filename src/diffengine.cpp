@@ -1,10 +1,162 @@
 #include "diffengine.h"
+#include "diffsession.h"
+#include "tracer.h"
 #include <QStringList>
+#include <QStringView>
+#include <QHash>
 #include <QRegularExpression>
 #include <algorithm>
 
+namespace {
+
+struct Token {
+    int start;
+    int length;
+};
+
+bool isIgnoredPunctuation(QChar c)
+{
+    // Same set as DiffEngine::removePunctuation()
+    static const QString marks = QStringLiteral(".,;:!?'\"");
+    return marks.contains(c);
+}
+
+// Split prose into words and single punctuation marks. Whitespace, line
+// breaks included, only separates tokens; a blank line inside the text is
+// kept as a paragraph-break token so that paragraphs cannot merge.
+void tokenize(const QString &text, bool skipPunctuation, QHash<QStringView, int> &ids,
+              QVector<int> &seq, QVector<Token> &tokens)
+{
+    static const QString paragraphBreak = QStringLiteral("\n\n");
+    
+    const QChar *data = text.constData();
+    const int length = text.length();
+    int pos = 0;
+    while (pos < length) {
+        const int start = pos;
+        const QChar c = data[pos];
+        QStringView token;
+        
+        if (c.isSpace()) {
+            int newlines = 0;
+            while (pos < length && data[pos].isSpace()) {
+                if (data[pos] == QLatin1Char('\n')) {
+                    ++newlines;
+                }
+                ++pos;
+            }
+            if (newlines < 2 || start == 0 || pos == length) {
+                continue;
+            }
+            token = paragraphBreak;
+        } else if (c.isLetterOrNumber() || c == QLatin1Char('_')) {
+            while (pos < length && (data[pos].isLetterOrNumber() || data[pos] == QLatin1Char('_'))) {
+                ++pos;
+            }
+            token = QStringView(data + start, pos - start);
+        } else {
+            ++pos;
+            if (skipPunctuation && isIgnoredPunctuation(c)) {
+                continue;
+            }
+            token = QStringView(data + start, 1);
+        }
+        
+        int id = ids.value(token, -1);
+        if (id < 0) {
+            id = ids.size();
+            ids.insert(token, id);
+        }
+        seq.append(id);
+        tokens.append(Token{start, pos - start});
+    }
+}
+
+int rangeStart(const DiffLines &lines, int line)
+{
+    return qMin(lines.starts[line], lines.starts[lines.count] - 1);
+}
+
+int rangeEnd(const DiffLines &lines, int endLine)
+{
+    return lines.ends[endLine - 1];
+}
+
+// Lines [i0, i1) were replaced by [j0, j1): pair them up as modifications and
+// report whatever is left over on the longer side as added or deleted
+void appendRegionHunks(QVector<DiffHunk> &hunks,
+                       const DiffLines &lines1, int i0, int i1,
+                       const DiffLines &lines2, int j0, int j1)
+{
+    int common = qMin(i1 - i0, j1 - j0);
+    
+    if (common > 0) {
+        DiffHunk hunk;
+        hunk.type = DiffHunk::Modified;
+        hunk.leftStart = rangeStart(lines1, i0);
+        hunk.leftEnd = rangeEnd(lines1, i0 + common);
+        hunk.rightStart = rangeStart(lines2, j0);
+        hunk.rightEnd = rangeEnd(lines2, j0 + common);
+        hunks.append(hunk);
+    }
+    
+    if (i1 - i0 > common) {
+        DiffHunk hunk;
+        hunk.type = DiffHunk::Deleted;
+        hunk.leftStart = rangeStart(lines1, i0 + common);
+        hunk.leftEnd = rangeEnd(lines1, i1);
+        hunk.rightStart = rangeStart(lines2, j1);
+        hunk.rightEnd = hunk.rightStart;
+        hunks.append(hunk);
+    } else if (j1 - j0 > common) {
+        DiffHunk hunk;
+        hunk.type = DiffHunk::Added;
+        hunk.leftStart = rangeStart(lines1, i1);
+        hunk.leftEnd = hunk.leftStart;
+        hunk.rightStart = rangeStart(lines2, j0 + common);
+        hunk.rightEnd = rangeEnd(lines2, j1);
+        hunks.append(hunk);
+    }
+}
+
+// Holds back the last edit so that runs can still be merged before they
+// reach the sink; has the part of the QVector interface diffRange() uses
+class StreamedEdits
+{
+public:
+    explicit StreamedEdits(DiffEngine::EditSink &sink) : sink(sink), pending(false) {}
+    
+    bool isEmpty() const { return !pending; }
+    DiffEngine::Edit &last() { return edit; }
+    
+    void append(const DiffEngine::Edit &next)
+    {
+        if (pending) {
+            sink.append(edit);
+        }
+        edit = next;
+        pending = true;
+    }
+    
+    void finish()
+    {
+        if (pending) {
+            sink.append(edit);
+        }
+        pending = false;
+    }
+
+private:
+    DiffEngine::EditSink &sink;
+    DiffEngine::Edit edit;
+    bool pending;
+};
+
+} // namespace
+
 DiffEngine::DiffEngine(QObject *parent)
     : QObject(parent)
+    , session(new DiffSession)
 {
 }
 
@@ -14,6 +166,8 @@ DiffEngine::~DiffEngine()
 
 QString DiffEngine::normalizeWhitespace(const QString &text)
 {
+    TraceScope trace("normalizeWhitespace");
+    trace.arg("chars", text.size());
     QString result = text;
     // Replace multiple spaces with single space
     result.replace(QRegularExpression("[ \\t]+"), " ");
@@ -26,6 +180,8 @@ QString DiffEngine::normalizeWhitespace(const QString &text)
 
 QString DiffEngine::removePunctuation(const QString &text)
 {
+    TraceScope trace("removePunctuation");
+    trace.arg("chars", text.size());
     QString result = text;
     // Remove common punctuation marks
     result.remove(QRegularExpression("[.,;:!?'\"]"));
@@ -34,6 +190,8 @@ QString DiffEngine::removePunctuation(const QString &text)
 
 QString DiffEngine::normalizeReflow(const QString &text)
 {
+    TraceScope trace("normalizeReflow");
+    trace.arg("chars", text.size());
     // Join lines in paragraphs (separated by double newlines)
     QStringList paragraphs = text.split(QRegularExpression("\\n\\s*\\n"));
     QStringList normalized;
@@ -52,129 +210,584 @@ QString DiffEngine::normalizeReflow(const QString &text)
 
 QVector<DiffHunk> DiffEngine::computeDiff(const QString &text1, const QString &text2)
 {
-    // Split into lines for line-based diff
-    QStringList lines1 = text1.split('\n');
-    QStringList lines2 = text2.split('\n');
+    TraceScope trace("computeDiff");
+    
+    // Every intermediate lives in the session, so a diff of similar size to
+    // the previous one allocates nothing but the returned hunks
+    session->reset();
+    
+    // Intern lines so the diff compares integers instead of strings
+    DiffLines lines1, lines2;
+    {
+        TraceScope internTrace("internLines");
+        session->internLines(text1, text2, &lines1, &lines2);
+        internTrace.arg("lines1", lines1.count);
+        internTrace.arg("lines2", lines2.count);
+    }
     
     // Compute edits using Myers algorithm
-    QVector<Edit> edits = myersDiff(lines1, lines2);
+    {
+        TraceScope myersTrace("myersDiff");
+        diffRange(lines1.ids, 0, lines1.count, lines2.ids, 0, lines2.count,
+                  session->forward, session->backward, session->edits);
+        myersTrace.arg("items", lines1.count + lines2.count);
+        myersTrace.arg("edits", session->edits.size());
+    }
     
     // Convert edits to hunks
-    return editsToHunks(edits, text1, text2);
+    editsToHunks(session->edits, lines1, lines2, session->hunks);
+    
+    // The copy returned is the one allocation a warm session still makes
+    QVector<DiffHunk> hunks(session->hunks.constBegin(), session->hunks.constEnd());
+    trace.arg("hunks", hunks.size());
+    trace.arg("allocations", session->arenaAllocations() + (hunks.isEmpty() ? 0 : 1));
+    trace.arg("vectorsGrown", session->vectorsGrown());
+    return hunks;
 }
 
-QVector<DiffEngine::Edit> DiffEngine::myersDiff(const QStringList &lines1, const QStringList &lines2)
+DiffStats DiffEngine::computeStats(const QString &text1, const QString &text2)
 {
-    // Simplified Myers diff algorithm
-    // This is a basic implementation for demonstration
-    QVector<Edit> edits;
+    // Hunk ranges exclude the final line break and hold at least one line
+    auto lineCount = [](const QString &text, int start, int end) {
+        return int(QStringView(text).mid(start, end - start).count(QChar('\n'))) + 1;
+    };
     
-    int i = 0, j = 0;
-    while (i < lines1.size() || j < lines2.size()) {
-        if (i < lines1.size() && j < lines2.size() && lines1[i] == lines2[j]) {
-            // Equal lines
-            Edit e;
-            e.type = Edit::Equal;
-            e.pos1 = i;
-            e.pos2 = j;
-            e.length = 1;
-            edits.append(e);
-            i++;
-            j++;
-        } else if (i < lines1.size() && (j >= lines2.size() || 
-                   (j + 1 < lines2.size() && lines1[i] == lines2[j + 1]))) {
-            // Insert in text2
-            Edit e;
-            e.type = Edit::Insert;
-            e.pos1 = i;
-            e.pos2 = j;
-            e.length = 1;
-            edits.append(e);
-            j++;
-        } else if (j < lines2.size() && (i >= lines1.size() || 
-                   (i + 1 < lines1.size() && lines1[i + 1] == lines2[j]))) {
-            // Delete from text1
-            Edit e;
-            e.type = Edit::Delete;
-            e.pos1 = i;
-            e.pos2 = j;
-            e.length = 1;
-            edits.append(e);
-            i++;
-        } else if (i < lines1.size() && j < lines2.size()) {
-            // Modified line
-            Edit del, ins;
-            del.type = Edit::Delete;
-            del.pos1 = i;
-            del.pos2 = j;
-            del.length = 1;
-            
-            ins.type = Edit::Insert;
-            ins.pos1 = i;
-            ins.pos2 = j;
-            ins.length = 1;
-            
-            edits.append(del);
-            edits.append(ins);
-            i++;
-            j++;
+    DiffStats stats;
+    const QVector<DiffHunk> hunks = computeDiff(text1, text2);
+    for (const DiffHunk &hunk : hunks) {
+        switch (hunk.type) {
+        case DiffHunk::Added:
+            stats.added += lineCount(text2, hunk.rightStart, hunk.rightEnd);
+            break;
+        case DiffHunk::Deleted:
+            stats.deleted += lineCount(text1, hunk.leftStart, hunk.leftEnd);
+            break;
+        case DiffHunk::Modified:
+            stats.modified += lineCount(text1, hunk.leftStart, hunk.leftEnd);
+            break;
+        default:
+            break;
         }
     }
+    return stats;
+}
+
+QVector<DiffHunk> DiffEngine::computeTokenDiff(const QString &text1, const QString &text2,
+                                               bool skipPunctuation)
+{
+    QHash<QStringView, int> tokenIds;
+    QVector<int> seq1, seq2;
+    QVector<Token> tokens1, tokens2;
+    {
+        TraceScope trace("tokenize");
+        tokenize(text1, skipPunctuation, tokenIds, seq1, tokens1);
+        tokenize(text2, skipPunctuation, tokenIds, seq2, tokens2);
+        trace.arg("tokens1", seq1.size());
+        trace.arg("tokens2", seq2.size());
+    }
     
-    return edits;
+    QVector<Edit> edits = myersDiff(seq1, seq2);
+    
+    // Map token runs back to the character ranges they cover
+    auto startOf = [](const QVector<Token> &tokens, int index, int textLength) {
+        return index < tokens.size() ? tokens[index].start : textLength;
+    };
+    auto endOf = [](const QVector<Token> &tokens, int endIndex) {
+        const Token &last = tokens[endIndex - 1];
+        return last.start + last.length;
+    };
+    
+    QVector<DiffHunk> hunks;
+    int k = 0;
+    while (k < edits.size()) {
+        if (edits[k].type == Edit::Equal) {
+            ++k;
+            continue;
+        }
+        
+        int i0 = edits[k].pos1, i1 = i0;
+        int j0 = edits[k].pos2, j1 = j0;
+        for (; k < edits.size() && edits[k].type != Edit::Equal; ++k) {
+            if (edits[k].type == Edit::Delete) {
+                i1 = edits[k].pos1 + edits[k].length;
+            } else {
+                j1 = edits[k].pos2 + edits[k].length;
+            }
+        }
+        
+        DiffHunk hunk;
+        if (i1 > i0 && j1 > j0) {
+            hunk.type = DiffHunk::Modified;
+        } else {
+            hunk.type = (i1 > i0) ? DiffHunk::Deleted : DiffHunk::Added;
+        }
+        hunk.leftStart = startOf(tokens1, i0, text1.length());
+        hunk.leftEnd = (i1 > i0) ? endOf(tokens1, i1) : hunk.leftStart;
+        hunk.rightStart = startOf(tokens2, j0, text2.length());
+        hunk.rightEnd = (j1 > j0) ? endOf(tokens2, j1) : hunk.rightStart;
+        hunks.append(hunk);
+    }
+    
+    return hunks;
 }
 
-QVector<DiffHunk> DiffEngine::editsToHunks(const QVector<Edit> &edits, const QString &text1, const QString &text2)
+QVector<DiffHunk> DiffEngine::computeBlockDiff(const QString &text1, const QVector<DiffBlock> &blocks1,
+                                               const QString &text2, const QVector<DiffBlock> &blocks2)
 {
+    TraceScope trace("computeBlockDiff");
+    trace.arg("blocks1", blocks1.size());
+    trace.arg("blocks2", blocks2.size());
     QVector<DiffHunk> hunks;
-    QStringList lines1 = text1.split('\n');
-    QStringList lines2 = text2.split('\n');
+    diffBlocks(text1, blocks1, text1.length(), text2, blocks2, text2.length(), hunks);
+    return hunks;
+}
+
+void DiffEngine::diffBlocks(const QString &text1, const QVector<DiffBlock> &blocks1, int end1,
+                            const QString &text2, const QVector<DiffBlock> &blocks2, int end2,
+                            QVector<DiffHunk> &hunks)
+{
+    // Blocks are identified by kind and exact content
+    QHash<QStringView, int> contentIds;
+    QHash<quint64, int> blockIds;
+    auto internBlocks = [&](const QString &text, const QVector<DiffBlock> &blocks) {
+        QVector<int> seq;
+        seq.reserve(blocks.size());
+        for (const DiffBlock &block : blocks) {
+            QStringView content(text.constData() + block.start, block.length);
+            int contentId = contentIds.value(content, -1);
+            if (contentId < 0) {
+                contentId = contentIds.size();
+                contentIds.insert(content, contentId);
+            }
+            quint64 key = (quint64(quint32(block.kind)) << 32) | quint32(contentId);
+            int id = blockIds.value(key, -1);
+            if (id < 0) {
+                id = blockIds.size();
+                blockIds.insert(key, id);
+            }
+            seq.append(id);
+        }
+        return seq;
+    };
     
-    int pos1 = 0, pos2 = 0;
+    QVector<Edit> edits = myersDiff(internBlocks(text1, blocks1), internBlocks(text2, blocks2));
     
-    for (int i = 0; i < edits.size(); i++) {
-        const Edit &edit = edits[i];
-        
+    auto leftPos = [&](int i) { return i < blocks1.size() ? blocks1[i].start : end1; };
+    auto rightPos = [&](int j) { return j < blocks2.size() ? blocks2[j].start : end2; };
+    
+    auto addBlockHunk = [&](DiffHunk::Type type, int leftStart, int leftEnd, int rightStart, int rightEnd) {
         DiffHunk hunk;
+        hunk.type = type;
+        hunk.leftStart = leftStart;
+        hunk.leftEnd = leftEnd;
+        hunk.rightStart = rightStart;
+        hunk.rightEnd = rightEnd;
+        hunks.append(hunk);
+    };
+    
+    int k = 0;
+    while (k < edits.size()) {
+        if (edits[k].type == Edit::Equal) {
+            ++k;
+            continue;
+        }
         
-        if (edit.type == Edit::Delete) {
-            // Check if next edit is Insert at same position (modification)
-            if (i + 1 < edits.size() && edits[i + 1].type == Edit::Insert &&
-                edits[i + 1].pos1 == edit.pos1) {
-                hunk.type = DiffHunk::Modified;
-                hunk.leftStart = pos1;
-                hunk.leftEnd = pos1 + (edit.pos1 < lines1.size() ? lines1[edit.pos1].length() : 0);
-                hunk.rightStart = pos2;
-                hunk.rightEnd = pos2 + (edits[i+1].pos2 < lines2.size() ? lines2[edits[i+1].pos2].length() : 0);
-                
-                pos1 += (edit.pos1 < lines1.size() ? lines1[edit.pos1].length() + 1 : 0);
-                pos2 += (edits[i+1].pos2 < lines2.size() ? lines2[edits[i+1].pos2].length() + 1 : 0);
-                i++; // Skip the next insert
+        // Collect one run of changed blocks between two matched ones
+        int i0 = edits[k].pos1, i1 = i0;
+        int j0 = edits[k].pos2, j1 = j0;
+        for (; k < edits.size() && edits[k].type != Edit::Equal; ++k) {
+            if (edits[k].type == Edit::Delete) {
+                i1 = edits[k].pos1 + edits[k].length;
             } else {
-                hunk.type = DiffHunk::Deleted;
-                hunk.leftStart = pos1;
-                hunk.leftEnd = pos1 + (edit.pos1 < lines1.size() ? lines1[edit.pos1].length() : 0);
-                hunk.rightStart = pos2;
-                hunk.rightEnd = pos2;
-                
-                pos1 += (edit.pos1 < lines1.size() ? lines1[edit.pos1].length() + 1 : 0);
-            }
-            hunks.append(hunk);
-        } else if (edit.type == Edit::Insert) {
-            hunk.type = DiffHunk::Added;
-            hunk.leftStart = pos1;
-            hunk.leftEnd = pos1;
-            hunk.rightStart = pos2;
-            hunk.rightEnd = pos2 + (edit.pos2 < lines2.size() ? lines2[edit.pos2].length() : 0);
+                j1 = edits[k].pos2 + edits[k].length;
+            }
+        }
+        
+        // Pair changed blocks of the same kind in order; only paired blocks
+        // get a line diff, the rest are whole-block additions and deletions
+        int j = j0;
+        for (int i = i0; i < i1; ++i) {
+            const DiffBlock &left = blocks1[i];
+            int match = j;
+            while (match < j1 && blocks2[match].kind != left.kind) {
+                ++match;
+            }
+            if (match == j1) {
+                addBlockHunk(DiffHunk::Deleted, left.start, left.start + left.length, rightPos(j), rightPos(j));
+                continue;
+            }
+            for (; j < match; ++j) {
+                const DiffBlock &added = blocks2[j];
+                addBlockHunk(DiffHunk::Added, left.start, left.start, added.start, added.start + added.length);
+            }
             
-            pos2 += (edit.pos2 < lines2.size() ? lines2[edit.pos2].length() + 1 : 0);
-            hunks.append(hunk);
-        } else if (edit.type == Edit::Equal) {
-            // Move positions forward for equal lines
-            pos1 += (edit.pos1 < lines1.size() ? lines1[edit.pos1].length() + 1 : 0);
-            pos2 += (edit.pos2 < lines2.size() ? lines2[edit.pos2].length() + 1 : 0);
+            const DiffBlock &right = blocks2[match];
+            QVector<DiffHunk> inner = computeDiff(text1.mid(left.start, left.length),
+                                                  text2.mid(right.start, right.length));
+            for (DiffHunk hunk : inner) {
+                hunk.leftStart += left.start;
+                hunk.leftEnd += left.start;
+                hunk.rightStart += right.start;
+                hunk.rightEnd += right.start;
+                hunks.append(hunk);
+            }
+            j = match + 1;
+        }
+        for (; j < j1; ++j) {
+            const DiffBlock &added = blocks2[j];
+            addBlockHunk(DiffHunk::Added, leftPos(i1), leftPos(i1), added.start, added.start + added.length);
+        }
+    }
+}
+
+QVector<DiffHunk> DiffEngine::computeSectionDiff(const QString &text1, const QVector<DiffSection> &sections1,
+                                                 const QString &text2, const QVector<DiffSection> &sections2)
+{
+    TraceScope trace("computeSectionDiff");
+    trace.arg("sections1", sections1.size());
+    trace.arg("sections2", sections2.size());
+    
+    // Level 1: sections equal as a whole are matched and never looked into
+    QHash<QStringView, int> sectionIds;
+    auto internSections = [&](const QString &text, const QVector<DiffSection> &sections) {
+        QVector<int> seq;
+        seq.reserve(sections.size());
+        for (const DiffSection &section : sections) {
+            QStringView content(text.constData() + section.start, section.length);
+            int id = sectionIds.value(content, -1);
+            if (id < 0) {
+                id = sectionIds.size();
+                sectionIds.insert(content, id);
+            }
+            seq.append(id);
+        }
+        return seq;
+    };
+    
+    QVector<Edit> edits = myersDiff(internSections(text1, sections1), internSections(text2, sections2));
+    
+    struct Region {
+        int i0, i1, j0, j1;
+    };
+    QVector<Region> regions;
+    QVector<int> region1(sections1.size(), -1);
+    QVector<int> region2(sections2.size(), -1);
+    
+    int k = 0;
+    while (k < edits.size()) {
+        if (edits[k].type == Edit::Equal) {
+            ++k;
+            continue;
+        }
+        
+        Region region = { edits[k].pos1, edits[k].pos1, edits[k].pos2, edits[k].pos2 };
+        for (; k < edits.size() && edits[k].type != Edit::Equal; ++k) {
+            if (edits[k].type == Edit::Delete) {
+                region.i1 = edits[k].pos1 + edits[k].length;
+            } else {
+                region.j1 = edits[k].pos2 + edits[k].length;
+            }
+        }
+        for (int i = region.i0; i < region.i1; ++i) {
+            region1[i] = regions.size();
+        }
+        for (int j = region.j0; j < region.j1; ++j) {
+            region2[j] = regions.size();
+        }
+        regions.append(region);
+    }
+    
+    // Level 2: pair changed sections, by heading (body edited) or by body
+    // (heading renamed)
+    QVector<int> pair1(sections1.size(), -1);
+    QVector<int> pair2(sections2.size(), -1);
+    
+    using SectionKey = QStringView (*)(const QString &, const DiffSection &);
+    SectionKey headingKey = [](const QString &text, const DiffSection &section) {
+        return QStringView(text.constData() + section.heading.start, section.heading.length);
+    };
+    SectionKey bodyKey = [](const QString &text, const DiffSection &section) {
+        int bodyStart = section.heading.start + section.heading.length;
+        return QStringView(text.constData() + bodyStart, section.start + section.length - bodyStart).trimmed();
+    };
+    
+    // Pair unpaired sections with equal non-empty keys, first come first served
+    auto pairBy = [&](int i0, int i1, int j0, int j1, SectionKey key) {
+        QHash<QStringView, QVector<int>> candidates;
+        for (int j = j0; j < j1; ++j) {
+            QStringView value = key(text2, sections2[j]);
+            if (region2[j] >= 0 && pair2[j] < 0 && !value.isEmpty()) {
+                candidates[value].append(j);
+            }
+        }
+        for (int i = i0; i < i1; ++i) {
+            if (region1[i] < 0 || pair1[i] >= 0) {
+                continue;
+            }
+            auto it = candidates.find(key(text1, sections1[i]));
+            if (it == candidates.end() || it.value().isEmpty()) {
+                continue;
+            }
+            int j = it.value().takeFirst();
+            pair1[i] = j;
+            pair2[j] = i;
+        }
+    };
+    
+    // In place first, then across the document so moved sections still
+    // find their counterpart, then whatever is left by position
+    for (const Region &region : regions) {
+        pairBy(region.i0, region.i1, region.j0, region.j1, headingKey);
+        pairBy(region.i0, region.i1, region.j0, region.j1, bodyKey);
+    }
+    pairBy(0, sections1.size(), 0, sections2.size(), headingKey);
+    pairBy(0, sections1.size(), 0, sections2.size(), bodyKey);
+    for (const Region &region : regions) {
+        int j = region.j0;
+        for (int i = region.i0; i < region.i1; ++i) {
+            if (pair1[i] >= 0) {
+                continue;
+            }
+            while (j < region.j1 && pair2[j] >= 0) {
+                ++j;
+            }
+            if (j == region.j1) {
+                break;
+            }
+            pair1[i] = j;
+            pair2[j] = i;
+        }
+    }
+    
+    // Level 3: diff inside each pair; hunks stay within their sections
+    QVector<DiffHunk> hunks;
+    auto addHunk = [&](DiffHunk::Type type, int leftStart, int leftEnd, int rightStart, int rightEnd) {
+        DiffHunk hunk;
+        hunk.type = type;
+        hunk.leftStart = leftStart;
+        hunk.leftEnd = leftEnd;
+        hunk.rightStart = rightStart;
+        hunk.rightEnd = rightEnd;
+        hunks.append(hunk);
+    };
+    
+    for (const Region &region : regions) {
+        int leftPos = region.i0 < sections1.size() ? sections1[region.i0].start : int(text1.length());
+        int rightPos = region.j0 < sections2.size() ? sections2[region.j0].start : int(text2.length());
+        
+        for (int i = region.i0; i < region.i1; ++i) {
+            const DiffSection &left = sections1[i];
+            int j = pair1[i];
+            if (j < 0) {
+                addHunk(DiffHunk::Deleted, left.start, left.start + left.length, rightPos, rightPos);
+                continue;
+            }
+            
+            const DiffSection &right = sections2[j];
+            if (region2[j] != region1[i]) {
+                addHunk(DiffHunk::Moved, left.start, left.start + left.length,
+                        right.start, right.start + right.length);
+            }
+            
+            if (headingKey(text1, left) != headingKey(text2, right)) {
+                DiffHunk::Type type = DiffHunk::Modified;
+                if (left.heading.length == 0) {
+                    type = DiffHunk::Added;
+                } else if (right.heading.length == 0) {
+                    type = DiffHunk::Deleted;
+                }
+                addHunk(type, left.heading.start, left.heading.start + left.heading.length,
+                        right.heading.start, right.heading.start + right.heading.length);
+            }
+            
+            diffBlocks(text1, left.blocks, left.start + left.length,
+                       text2, right.blocks, right.start + right.length, hunks);
+        }
+        
+        for (int j = region.j0; j < region.j1; ++j) {
+            const DiffSection &right = sections2[j];
+            if (pair2[j] < 0) {
+                addHunk(DiffHunk::Added, leftPos, leftPos, right.start, right.start + right.length);
+            }
         }
     }
     
     return hunks;
 }
+
+QVector<DiffEngine::Edit> DiffEngine::myersDiff(const QVector<int> &seq1, const QVector<int> &seq2)
+{
+    // Linear-space Myers: split on the middle snake of the shortest edit
+    // script and recurse on both halves
+    TraceScope trace("myersDiff");
+    QVector<Edit> edits;
+    QVector<int> forward, backward;
+    diffRange(seq1.constData(), 0, seq1.size(), seq2.constData(), 0, seq2.size(),
+              forward, backward, edits);
+    trace.arg("items", seq1.size() + seq2.size());
+    trace.arg("edits", edits.size());
+    return edits;
+}
+
+void DiffEngine::diffSequences(const int *seq1, int length1, const int *seq2, int length2, EditSink &sink)
+{
+    TraceScope trace("myersDiff");
+    QVector<int> forward, backward;
+    StreamedEdits edits(sink);
+    diffRange(seq1, 0, length1, seq2, 0, length2, forward, backward, edits);
+    edits.finish();
+    trace.arg("items", qint64(length1) + length2);
+}
+
+template<typename Edits>
+void DiffEngine::diffRange(const int *a, int a0, int a1, const int *b, int b0, int b1,
+                           QVector<int> &forward, QVector<int> &backward, Edits &edits)
+{
+    // Strip common prefix and suffix; they are always part of the LCS
+    int prefix = 0;
+    while (a0 + prefix < a1 && b0 + prefix < b1 && a[a0 + prefix] == b[b0 + prefix]) {
+        ++prefix;
+    }
+    appendEdit(edits, Edit::Equal, a0, b0, prefix);
+    a0 += prefix;
+    b0 += prefix;
+    
+    int suffix = 0;
+    while (a1 - suffix > a0 && b1 - suffix > b0 && a[a1 - 1 - suffix] == b[b1 - 1 - suffix]) {
+        ++suffix;
+    }
+    a1 -= suffix;
+    b1 -= suffix;
+    
+    if (a0 == a1) {
+        appendEdit(edits, Edit::Insert, a0, b0, b1 - b0);
+    } else if (b0 == b1) {
+        appendEdit(edits, Edit::Delete, a0, b0, a1 - a0);
+    } else {
+        int x0, y0, x1, y1;
+        middleSnake(a + a0, a1 - a0, b + b0, b1 - b0, forward, backward, x0, y0, x1, y1);
+        diffRange(a, a0, a0 + x0, b, b0, b0 + y0, forward, backward, edits);
+        appendEdit(edits, Edit::Equal, a0 + x0, b0 + y0, x1 - x0);
+        diffRange(a, a0 + x1, a1, b, b0 + y1, b1, forward, backward, edits);
+    }
+    
+    appendEdit(edits, Edit::Equal, a1, b1, suffix);
+}
+
+void DiffEngine::middleSnake(const int *a, int n, const int *b, int m,
+                             QVector<int> &forward, QVector<int> &backward,
+                             int &x0, int &y0, int &x1, int &y1)
+{
+    // Run the forward and reverse searches until their furthest-reaching
+    // paths overlap; the snake where they meet splits the problem in two
+    const int delta = n - m;
+    const bool odd = (delta & 1) != 0;
+    const int maxD = (n + m + 1) / 2;
+    const int offset = maxD + 1;
+    
+    forward.fill(0, 2 * offset + 1);
+    backward.fill(0, 2 * offset + 1);
+    int *vf = forward.data() + offset;
+    int *vb = backward.data() + offset;
+    
+    for (int d = 0; d <= maxD; ++d) {
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && vf[k - 1] < vf[k + 1])) ? vf[k + 1] : vf[k - 1] + 1;
+            int y = x - k;
+            int startX = x, startY = y;
+            while (x < n && y < m && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            vf[k] = x;
+            
+            int c = delta - k;
+            if (odd && c >= -(d - 1) && c <= d - 1 && x + vb[c] >= n) {
+                x0 = startX;
+                y0 = startY;
+                x1 = x;
+                y1 = y;
+                return;
+            }
+        }
+        
+        // Reverse search on diagonal c = delta - k, x counted from the end
+        for (int c = -d; c <= d; c += 2) {
+            int x = (c == -d || (c != d && vb[c - 1] < vb[c + 1])) ? vb[c + 1] : vb[c - 1] + 1;
+            int y = x - c;
+            int startX = x, startY = y;
+            while (x < n && y < m && a[n - 1 - x] == b[m - 1 - y]) {
+                ++x;
+                ++y;
+            }
+            vb[c] = x;
+            
+            int k = delta - c;
+            if (!odd && k >= -d && k <= d && x + vf[k] >= n) {
+                x0 = n - x;
+                y0 = m - y;
+                x1 = n - startX;
+                y1 = m - startY;
+                return;
+            }
+        }
+    }
+    
+    // Unreachable: the paths always meet by maxD
+    x0 = y0 = x1 = y1 = 0;
+}
+
+template<typename Edits>
+void DiffEngine::appendEdit(Edits &edits, Edit::Type type, int pos1, int pos2, int length)
+{
+    if (length <= 0) {
+        return;
+    }
+    
+    // Extend the previous run when it continues on the same side
+    if (!edits.isEmpty() && edits.last().type == type) {
+        Edit &prev = edits.last();
+        bool contiguous = (type == Edit::Insert) ? prev.pos2 + prev.length == pos2
+                                                 : prev.pos1 + prev.length == pos1;
+        if (contiguous) {
+            prev.length += length;
+            return;
+        }
+    }
+    
+    Edit e;
+    e.type = type;
+    e.pos1 = pos1;
+    e.pos2 = pos2;
+    e.length = length;
+    edits.append(e);
+}
+
+void DiffEngine::editsToHunks(const QVector<Edit> &edits, const DiffLines &lines1, const DiffLines &lines2,
+                              QVector<DiffHunk> &hunks)
+{
+    TraceScope trace("editsToHunks");
+    
+    int k = 0;
+    while (k < edits.size()) {
+        if (edits[k].type == Edit::Equal) {
+            ++k;
+            continue;
+        }
+        
+        // Collect one run of changed lines between two equal runs
+        int i0 = edits[k].pos1, i1 = i0;
+        int j0 = edits[k].pos2, j1 = j0;
+        for (; k < edits.size() && edits[k].type != Edit::Equal; ++k) {
+            if (edits[k].type == Edit::Delete) {
+                i1 = edits[k].pos1 + edits[k].length;
+            } else {
+                j1 = edits[k].pos2 + edits[k].length;
+            }
+        }
+        
+        appendRegionHunks(hunks, lines1, i0, i1, lines2, j0, j1);
+    }
+    
+    trace.arg("hunks", hunks.size());
+}
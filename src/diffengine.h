@@ -4,13 +4,18 @@
 #include <QObject>
 #include <QString>
 #include <QVector>
+#include <memory>
+
+class DiffSession;
+struct DiffLines;
 
 struct DiffHunk {
     enum Type {
         Unchanged,
         Added,
         Deleted,
-        Modified
+        Modified,
+        Moved
     };
     
     Type type;
@@ -22,6 +27,38 @@ struct DiffHunk {
     DiffHunk() : type(Unchanged), leftStart(0), leftEnd(0), rightStart(0), rightEnd(0) {}
 };
 
+// Line counts of a diff
+struct DiffStats {
+    int added;      // Lines only in the second text
+    int deleted;    // Lines only in the first text
+    int modified;   // Lines replaced in place
+    
+    DiffStats() : added(0), deleted(0), modified(0) {}
+    int churn() const { return added + deleted + modified; }
+};
+
+// A structural unit of a text (heading, paragraph, table cell...) given as a
+// character range. Blocks only match blocks of the same kind and content.
+struct DiffBlock {
+    int kind;
+    int start;
+    int length;
+    
+    DiffBlock() : kind(0), start(0), length(0) {}
+    DiffBlock(int kind, int start, int length) : kind(kind), start(start), length(length) {}
+};
+
+// A heading together with the blocks that follow it up to the next heading.
+// The preamble before the first heading is a section with an empty heading.
+struct DiffSection {
+    DiffBlock heading;
+    QVector<DiffBlock> blocks;
+    int start;
+    int length;  // Heading and body, up to the end of the last block
+    
+    DiffSection() : start(0), length(0) {}
+};
+
 class DiffEngine : public QObject
 {
     Q_OBJECT
@@ -33,12 +70,30 @@ public:
     // Compute differences between two texts
     QVector<DiffHunk> computeDiff(const QString &text1, const QString &text2);
     
+    // Summarise computeDiff() as line counts
+    DiffStats computeStats(const QString &text1, const QString &text2);
+    
+    // Word-level diff for prose: line breaks only separate tokens, so
+    // re-wrapped paragraphs compare equal. Hunks are character ranges.
+    QVector<DiffHunk> computeTokenDiff(const QString &text1, const QString &text2,
+                                       bool skipPunctuation = false);
+    
+    // Two-level diff: align blocks first, then line-diff only the changed
+    // blocks that could be paired by kind
+    QVector<DiffHunk> computeBlockDiff(const QString &text1, const QVector<DiffBlock> &blocks1,
+                                       const QString &text2, const QVector<DiffBlock> &blocks2);
+    
+    // Three-level diff: align whole sections, pair the changed ones by
+    // heading or body (across the document for moves), then block-diff
+    // inside each pair. Hunks never cross a section boundary.
+    QVector<DiffHunk> computeSectionDiff(const QString &text1, const QVector<DiffSection> &sections1,
+                                         const QString &text2, const QVector<DiffSection> &sections2);
+    
     // Text normalization utilities
     QString normalizeWhitespace(const QString &text);
     QString removePunctuation(const QString &text);
     QString normalizeReflow(const QString &text);
-
-private:
+    
     // Myers diff algorithm implementation
     struct Edit {
         enum Type { Insert, Delete, Equal };
@@ -48,8 +103,36 @@ private:
         int length;
     };
     
-    QVector<Edit> myersDiff(const QStringList &lines1, const QStringList &lines2);
-    QVector<DiffHunk> editsToHunks(const QVector<Edit> &edits, const QString &text1, const QString &text2);
+    // Receives an edit script in order, for scripts too large to hold
+    class EditSink {
+    public:
+        virtual ~EditSink() {}
+        virtual void append(const Edit &edit) = 0;
+    };
+    
+    // Myers over two sequences of interned IDs, streaming the edits out
+    static void diffSequences(const int *seq1, int length1, const int *seq2, int length2, EditSink &sink);
+
+private:
+    void diffBlocks(const QString &text1, const QVector<DiffBlock> &blocks1, int end1,
+                    const QString &text2, const QVector<DiffBlock> &blocks2, int end2,
+                    QVector<DiffHunk> &hunks);
+    
+    // Edits are runs over two sequences of interned IDs
+    QVector<Edit> myersDiff(const QVector<int> &seq1, const QVector<int> &seq2);
+    template<typename Edits>
+    static void diffRange(const int *a, int a0, int a1, const int *b, int b0, int b1,
+                          QVector<int> &forward, QVector<int> &backward, Edits &edits);
+    static void middleSnake(const int *a, int n, const int *b, int m,
+                            QVector<int> &forward, QVector<int> &backward,
+                            int &x0, int &y0, int &x1, int &y1);
+    template<typename Edits>
+    static void appendEdit(Edits &edits, Edit::Type type, int pos1, int pos2, int length);
+    static void editsToHunks(const QVector<Edit> &edits, const DiffLines &lines1, const DiffLines &lines2,
+                             QVector<DiffHunk> &hunks);
+    
+    // Scratch memory of computeDiff(), reused across calls
+    std::unique_ptr<DiffSession> session;
 };
 
 #endif // DIFFENGINE_H
@@ -0,0 +1,48 @@
+#include "diffpreloader.h"
+#include "diffview.h"
+#include "tracer.h"
+#include <QThreadPool>
+
+DiffPreloader::DiffPreloader(QObject *parent)
+    : QObject(parent)
+    , done(false)
+{
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(1);
+}
+
+DiffPreloader::~DiffPreloader()
+{
+    pool->waitForDone();
+}
+
+bool DiffPreloader::canPreload(const QString &file1, const QString &file2, qint64 memoryBudget)
+{
+    return DiffView::isPlainTextPair(file1, file2, memoryBudget);
+}
+
+void DiffPreloader::start(const QString &file1, const QString &file2)
+{
+    path1 = file1;
+    path2 = file2;
+
+    // The worker owns the result members until the queued call below hands
+    // them to the GUI thread
+    pool->start([this]() {
+        TraceScope trace("preload");
+        content1 = DiffView::readTextFile(path1);
+        content2 = DiffView::readTextFile(path2);
+        DiffEngine engine;
+        result = engine.computeDiff(content1, content2);
+
+        QMetaObject::invokeMethod(this, [this]() {
+            done = true;
+            emit finished();
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool DiffPreloader::isFinished() const
+{
+    return done;
+}
@@ -0,0 +1,50 @@
+#ifndef DIFFPRELOADER_H
+#define DIFFPRELOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include "diffengine.h"
+
+class QThreadPool;
+
+// Reads and diffs a pair of text files given on the command line while the
+// main window is still being built. Only plain text with default options is
+// preloaded; formats with their own parser and files beyond the memory
+// budget go through DiffView as usual.
+class DiffPreloader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DiffPreloader(QObject *parent = nullptr);
+    ~DiffPreloader();
+
+    static bool canPreload(const QString &file1, const QString &file2, qint64 memoryBudget);
+
+    void start(const QString &file1, const QString &file2);
+    bool isFinished() const;
+
+    // Valid once finished() was emitted
+    QString file1() const { return path1; }
+    QString file2() const { return path2; }
+    QString text1() const { return content1; }
+    QString text2() const { return content2; }
+    QVector<DiffHunk> hunks() const { return result; }
+
+signals:
+    // Delivered through the event loop, so connecting after start() is safe
+    void finished();
+
+private:
+    QThreadPool *pool;
+    bool done;
+
+    QString path1;
+    QString path2;
+    QString content1;
+    QString content2;
+    QVector<DiffHunk> result;
+};
+
+#endif // DIFFPRELOADER_H
@@ -0,0 +1,129 @@
+#include "diffsession.h"
+#include "linesegmenter.h"
+#include <QHash>
+#include <QStringView>
+
+namespace {
+
+// Calls unit(start, end) for each line of text, or for each segment of a
+// long line; end excludes the line break
+template<typename Unit>
+void forEachUnit(const QString &text, Unit unit)
+{
+    const QChar *data = text.constData();
+    const int length = text.length();
+    int start = 0;
+    while (true) {
+        int end = text.indexOf(QLatin1Char('\n'), start);
+        if (end < 0) {
+            end = length;
+        }
+        if (LineSegmenter::isLong(end - start)) {
+            for (int pos = start; pos < end; ) {
+                int next = LineSegmenter::segmentEnd(data, pos, end);
+                unit(pos, next);
+                pos = next;
+            }
+        } else {
+            unit(start, end);
+        }
+        if (end == length) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+int countUnits(const QString &text)
+{
+    const int lines = int(QStringView(text).count(QLatin1Char('\n'))) + 1;
+    if (text.length() <= LineSegmenter::kLongLine) {
+        return lines;
+    }
+    int count = 0;
+    forEachUnit(text, [&count](int, int) { ++count; });
+    return count;
+}
+
+} // namespace
+
+DiffSession::DiffSession()
+    : nextId(0)
+{
+    reset();
+}
+
+void DiffSession::reset()
+{
+    arena.reset();
+    nextId = 0;
+
+    forward.clear();
+    backward.clear();
+    edits.clear();
+    hunks.clear();
+    capacities[0] = forward.capacity();
+    capacities[1] = backward.capacity();
+    capacities[2] = edits.capacity();
+    capacities[3] = hunks.capacity();
+}
+
+int DiffSession::vectorsGrown() const
+{
+    return (forward.capacity() != capacities[0])
+         + (backward.capacity() != capacities[1])
+         + (edits.capacity() != capacities[2])
+         + (hunks.capacity() != capacities[3]);
+}
+
+void DiffSession::internLines(const QString &text1, const QString &text2, DiffLines *lines1, DiffLines *lines2)
+{
+    const int count1 = countUnits(text1);
+    const int count2 = countUnits(text2);
+
+    // Open addressing, kept at most half full
+    int capacity = 16;
+    while (capacity < 2 * (count1 + count2)) {
+        capacity *= 2;
+    }
+    Slot *table = arena.allocate<Slot>(capacity);
+    for (int i = 0; i < capacity; ++i) {
+        table[i].id = -1;
+    }
+
+    intern(text1, count1, table, capacity - 1, lines1);
+    intern(text2, count2, table, capacity - 1, lines2);
+}
+
+void DiffSession::intern(const QString &text, int count, Slot *table, int mask, DiffLines *lines)
+{
+    int *ids = arena.allocate<int>(count);
+    int *starts = arena.allocate<int>(count + 1);
+    int *ends = arena.allocate<int>(count);
+
+    int i = 0;
+    forEachUnit(text, [&](int start, int end) {
+        QStringView unit(text.constData() + start, end - start);
+        int slot = int(qHash(unit) & uint(mask));
+        while (table[slot].id >= 0
+               && (table[slot].length != unit.size() || QStringView(table[slot].text, table[slot].length) != unit)) {
+            slot = (slot + 1) & mask;
+        }
+        if (table[slot].id < 0) {
+            table[slot].text = unit.data();
+            table[slot].length = int(unit.size());
+            table[slot].id = nextId++;
+        }
+
+        ids[i] = table[slot].id;
+        starts[i] = start;
+        ends[i] = end;
+        ++i;
+    });
+    starts[count] = text.length() + 1;
+
+    lines->ids = ids;
+    lines->starts = starts;
+    lines->ends = ends;
+    lines->count = count;
+}
@@ -0,0 +1,61 @@
+#ifndef DIFFSESSION_H
+#define DIFFSESSION_H
+
+#include <QString>
+#include <QVector>
+#include "diffengine.h"
+#include "monotonicarena.h"
+
+// The lines of one text as interned IDs. A line that LineSegmenter
+// considers long contributes one unit per segment instead. Unit i covers
+// [starts[i], ends[i]), without the line break; starts has a sentinel
+// entry one past the end of the text.
+struct DiffLines {
+    const int *ids;
+    const int *starts;
+    const int *ends;
+    int count;
+};
+
+// Scratch memory for line diffs, owned by a DiffEngine and reused from one
+// diff to the next. Line IDs, offsets and the interning table come from a
+// monotonic arena; the Myers buffers, edit script and hunks are vectors
+// that keep their capacity. After the first few diffs a new one of similar
+// size runs without touching the heap, apart from the returned hunks.
+class DiffSession
+{
+public:
+    DiffSession();
+
+    // Starts a new diff; everything handed out before becomes invalid
+    void reset();
+
+    // Assigns each distinct line or segment an ID shared by both texts
+    void internLines(const QString &text1, const QString &text2, DiffLines *lines1, DiffLines *lines2);
+
+    // Arena chunks taken from the heap since reset()
+    int arenaAllocations() const { return arena.heapAllocations(); }
+    // Scratch vectors that had to grow since reset(), however many times
+    int vectorsGrown() const;
+
+    QVector<int> forward;
+    QVector<int> backward;
+    QVector<DiffEngine::Edit> edits;
+    QVector<DiffHunk> hunks;
+
+private:
+    struct Slot {
+        const QChar *text;
+        int length;
+        int id;         // -1 while the slot is free
+    };
+
+    void intern(const QString &text, int count, Slot *table, int mask, DiffLines *lines);
+
+    MonotonicArena arena;
+    int nextId;
+    // Vector capacities at reset(), to count growth
+    qsizetype capacities[4];
+};
+
+#endif // DIFFSESSION_H
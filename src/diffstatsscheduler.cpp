@@ -0,0 +1,231 @@
+#include "diffstatsscheduler.h"
+#include "fasthash.h"
+#include "textdecoder.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace {
+
+const int kFlushIntervalMs = 100;
+
+// Statistics are for triage; files this large are left to the diff view
+const qint64 kMaxStatsBytes = 16 * 1024 * 1024;
+
+// Pairs whose statistics are remembered, by path and by content; each table
+// is simply dropped when full, so long sessions and rescans stay bounded
+const int kMaxKnownStats = 65536;
+
+bool sameMeta(const FileMeta &a, const FileMeta &b)
+{
+    return a.size == b.size && a.mtime == b.mtime && a.inode == b.inode;
+}
+
+bool readForStats(const QString &path, QByteArray *data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() > kMaxStatsBytes) {
+        return false;
+    }
+    *data = file.readAll();
+    // A NUL byte near the start is a good sign of binary content, unless
+    // the file is UTF-16
+    return TextDecoder::isUtf16(*data) || !data->left(8192).contains('\0');
+}
+
+} // namespace
+
+DiffStatsScheduler::DiffStatsScheduler(QObject *parent)
+    : QObject(parent)
+    , activeWorkers(0)
+    , generation(0)
+{
+    // Leave most cores to the folder comparison and the GUI
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+    pool->setThreadPriority(QThread::LowPriority);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(kFlushIntervalMs);
+    connect(flushTimer, &QTimer::timeout, this, &DiffStatsScheduler::flushResults);
+}
+
+DiffStatsScheduler::~DiffStatsScheduler()
+{
+    clear();
+    pool->waitForDone();
+}
+
+void DiffStatsScheduler::request(quint32 id, const QString &path1, const QString &path2)
+{
+    {
+        QMutexLocker locker(&mutex);
+        Job job;
+        job.path1 = path1;
+        job.path2 = path2;
+        if (!jobs.contains(id)) {
+            queue.append(id);
+        }
+        jobs.insert(id, job);
+    }
+
+    startWorkers();
+    if (!flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+void DiffStatsScheduler::prioritize(const QVector<quint32> &ids)
+{
+    QMutexLocker locker(&mutex);
+    // Newest request first; ids still in the normal queue are skipped there
+    // once their job has been taken
+    for (int i = ids.size() - 1; i >= 0; --i) {
+        if (jobs.contains(ids[i])) {
+            priorityQueue.prepend(ids[i]);
+        }
+    }
+}
+
+void DiffStatsScheduler::clear()
+{
+    QMutexLocker locker(&mutex);
+    jobs.clear();
+    queue.clear();
+    priorityQueue.clear();
+    results.clear();
+    ++generation;
+}
+
+void DiffStatsScheduler::startWorkers()
+{
+    QMutexLocker locker(&mutex);
+    while (activeWorkers < pool->maxThreadCount() && activeWorkers < jobs.size()) {
+        ++activeWorkers;
+        pool->start([this]() { runWorker(); });
+    }
+}
+
+void DiffStatsScheduler::runWorker()
+{
+    // One engine per worker, so its diff session is reused across files
+    DiffEngine engine;
+
+    QMutexLocker locker(&mutex);
+    while (true) {
+        quint32 id = 0;
+        bool found = false;
+        while (!found && (!priorityQueue.isEmpty() || !queue.isEmpty())) {
+            id = !priorityQueue.isEmpty() ? priorityQueue.takeFirst() : queue.takeFirst();
+            found = jobs.contains(id);
+        }
+        if (!found) {
+            --activeWorkers;
+            return;
+        }
+
+        Job job = jobs.take(id);
+        int jobGeneration = generation;
+
+        locker.unlock();
+        DiffStatsResult result = computeStats(id, job, engine);
+        locker.relock();
+
+        if (jobGeneration == generation) {
+            results.append(result);
+        }
+    }
+}
+
+DiffStatsResult DiffStatsScheduler::computeStats(quint32 id, const Job &job, DiffEngine &engine)
+{
+    DiffStatsResult result;
+    result.id = id;
+    result.diffable = false;
+
+    // A stat per side decides whether the pair changed since its statistics
+    // were computed; only then are the files read
+    const QPair<QString, QString> paths(job.path1, job.path2);
+    const FileMeta meta1 = FileMeta::read(job.path1);
+    const FileMeta meta2 = FileMeta::read(job.path2);
+    if (meta1.size < 0 || meta2.size < 0) {
+        return result;
+    }
+    {
+        QMutexLocker locker(&mutex);
+        auto it = knownStats.constFind(paths);
+        if (it != knownStats.constEnd() && sameMeta(it->meta1, meta1) && sameMeta(it->meta2, meta2)) {
+            result.diffable = it->diffable;
+            result.stats = it->stats;
+            return result;
+        }
+    }
+
+    // Racy files may change again without a new mtime
+    auto remember = [&]() {
+        if (meta1.isRacy() || meta2.isRacy()) {
+            return;
+        }
+        KnownStats known;
+        known.meta1 = meta1;
+        known.meta2 = meta2;
+        known.diffable = result.diffable;
+        known.stats = result.stats;
+        QMutexLocker locker(&mutex);
+        if (knownStats.size() >= kMaxKnownStats) {
+            knownStats.clear();
+        }
+        knownStats.insert(paths, known);
+    };
+
+    QByteArray data1, data2;
+    if (meta1.size > kMaxStatsBytes || meta2.size > kMaxStatsBytes
+        || !readForStats(job.path1, &data1) || !readForStats(job.path2, &data2)) {
+        remember();
+        return result;
+    }
+    result.diffable = true;
+
+    QPair<quint64, quint64> key(FastHash::hash(data1.constData(), data1.size()),
+                                FastHash::hash(data2.constData(), data2.size()));
+    bool cached = false;
+    {
+        QMutexLocker locker(&mutex);
+        auto it = cache.constFind(key);
+        if (it != cache.constEnd()) {
+            result.stats = it.value();
+            cached = true;
+        }
+    }
+
+    if (!cached) {
+        result.stats = engine.computeStats(TextDecoder::decode(data1), TextDecoder::decode(data2));
+        QMutexLocker locker(&mutex);
+        if (cache.size() >= kMaxKnownStats) {
+            cache.clear();
+        }
+        cache.insert(key, result.stats);
+    }
+    remember();
+    return result;
+}
+
+void DiffStatsScheduler::flushResults()
+{
+    QVector<DiffStatsResult> ready;
+    bool idle;
+    {
+        QMutexLocker locker(&mutex);
+        ready.swap(results);
+        idle = activeWorkers == 0 && jobs.isEmpty();
+    }
+
+    if (!ready.isEmpty()) {
+        emit statsReady(ready);
+    }
+    if (idle) {
+        flushTimer->stop();
+    }
+}
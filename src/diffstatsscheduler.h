@@ -0,0 +1,81 @@
+#ifndef DIFFSTATSSCHEDULER_H
+#define DIFFSTATSSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include "diffengine.h"
+#include "foldermanifest.h"
+
+class QThreadPool;
+class QTimer;
+
+struct DiffStatsResult {
+    quint32 id;
+    bool diffable;      // False for binary, oversized or unreadable files
+    DiffStats stats;
+};
+
+// Computes line statistics for modified file pairs in the background.
+//
+// Jobs run on a small pool of low-priority threads. Prioritized jobs (rows
+// the user can see) are taken before the rest, whatever order they were
+// requested in. Results are cached by the paths and metadata of both files,
+// so a pair that has not changed is not read again, and by their content
+// hashes. They are delivered in batches on the scheduler's thread.
+class DiffStatsScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DiffStatsScheduler(QObject *parent = nullptr);
+    ~DiffStatsScheduler();
+
+    void request(quint32 id, const QString &path1, const QString &path2);
+    void prioritize(const QVector<quint32> &ids);
+    // Drops queued jobs; results of running ones are discarded
+    void clear();
+
+signals:
+    void statsReady(const QVector<DiffStatsResult> &results);
+
+private slots:
+    void flushResults();
+
+private:
+    struct Job {
+        QString path1;
+        QString path2;
+    };
+
+    struct KnownStats {
+        FileMeta meta1;
+        FileMeta meta2;
+        bool diffable;
+        DiffStats stats;
+    };
+
+    void startWorkers();
+    void runWorker();
+    DiffStatsResult computeStats(quint32 id, const Job &job, DiffEngine &engine);
+
+    QThreadPool *pool;
+    QTimer *flushTimer;
+
+    // Guards everything below
+    QMutex mutex;
+    QHash<quint32, Job> jobs;
+    QList<quint32> queue;
+    QList<quint32> priorityQueue;
+    int activeWorkers;
+    int generation;
+    QVector<DiffStatsResult> results;
+    QHash<QPair<QString, QString>, KnownStats> knownStats;
+    QHash<QPair<quint64, quint64>, DiffStats> cache;
+};
+
+#endif // DIFFSTATSSCHEDULER_H
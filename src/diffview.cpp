@@ -1,24 +1,87 @@
 #include "diffview.h"
+#include "diffpreloader.h"
+#include "largefilediff.h"
+#include "linesegmenter.h"
+#include "overviewruler.h"
+#include "textdecoder.h"
+#include "tracer.h"
+#include <QAbstractTextDocumentLayout>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QFile>
-#include <QTextStream>
 #include <QFileInfo>
+#include <QTextBlock>
+#include <QFileSystemWatcher>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+const qint64 kDefaultMemoryBudget = qint64(1024) * 1024 * 1024;
+
+// Bytes of memory per byte of file for the in-memory path: two UTF-16
+// copies during normalization plus the text documents of both panes
+const qint64 kTextMemoryFactor = 16;
+
+// Share of the memory budget for cached diffs
+const qint64 kCacheBudgetDivisor = 4;
+
+// The large file view is an excerpt; these keep it to a size the panes
+// can lay out quickly
+const int kLargeContextLines = 3;
+const int kMaxLargeRows = 100000;
+const int kMaxLargeHunkLines = 500;
+const int kMaxLargeLineBytes = 300;
+
+} // namespace
 
 DiffView::DiffView(QWidget *parent)
     : QWidget(parent)
     , ignoreWhitespace(false)
     , ignoreReflow(false)
     , ignorePunctuation(false)
+    , foldUnchanged(false)
+    , syncingScroll(false)
+    , rowAligned(false)
+    , budget(kDefaultMemoryBudget)
+    , diffCache(kDefaultMemoryBudget / kCacheBudgetDivisor)
+    , loadGeneration(0)
+    , loadedSize1(-1)
+    , loadedSize2(-1)
 {
     diffEngine = new DiffEngine(this);
-    docParser = new DocumentParser(this);
+    docParser = nullptr;
+    
+    prefetchPool = new QThreadPool(this);
+    prefetchPool->setMaxThreadCount(1);
+    largeDiffPool = new QThreadPool(this);
+    largeDiffPool->setMaxThreadCount(1);
+    
+    // Editors often write a file in several steps; wait until they are done
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(200);
+    connect(reloadTimer, &QTimer::timeout, this, &DiffView::reloadFiles);
+    
+    fileWatcher = new QFileSystemWatcher(this);
+    connect(fileWatcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+        reloadTimer->start();
+    });
+    
     setupUI();
 }
 
 DiffView::~DiffView()
 {
+    // A running large diff stops at its next check
+    ++loadGeneration;
+    // Running prefetches write into diffCache
+    prefetchPool->clear();
+    prefetchPool->waitForDone();
+    largeDiffPool->clear();
+    largeDiffPool->waitForDone();
 }
 
 void DiffView::setupUI()
@@ -57,13 +120,22 @@ void DiffView::setupUI()
     splitter->setStretchFactor(0, 1);
     splitter->setStretchFactor(1, 1);
     
-    mainLayout->addWidget(splitter);
+    // Overview of all changes beside the panes
+    ruler = new OverviewRuler(this);
+    ruler->setFixedWidth(14);
+    connect(ruler, &OverviewRuler::rowRequested, this, &DiffView::scrollToRow);
+    
+    QHBoxLayout *contentLayout = new QHBoxLayout();
+    contentLayout->addWidget(splitter);
+    contentLayout->addWidget(ruler);
+    mainLayout->addLayout(contentLayout);
     
-    // Synchronize scroll bars
+    // Vertical scrolling goes through the alignment map so both panes show
+    // corresponding lines; horizontal offsets are simply shared
     connect(leftPane->verticalScrollBar(), &QScrollBar::valueChanged,
-            rightPane->verticalScrollBar(), &QScrollBar::setValue);
+            this, [this]() { syncVerticalScroll(1); });
     connect(rightPane->verticalScrollBar(), &QScrollBar::valueChanged,
-            leftPane->verticalScrollBar(), &QScrollBar::setValue);
+            this, [this]() { syncVerticalScroll(2); });
     
     connect(leftPane->horizontalScrollBar(), &QScrollBar::valueChanged,
             rightPane->horizontalScrollBar(), &QScrollBar::setValue);
@@ -73,91 +145,266 @@ void DiffView::setupUI()
 
 void DiffView::loadFiles(const QString &file1, const QString &file2)
 {
-    currentFile1 = file1;
-    currentFile2 = file2;
+    // Prefetches queued for the previous selection are stale now
+    prefetchPool->clear();
     
-    QFileInfo info1(file1);
-    QFileInfo info2(file2);
+    int traceMark = Tracer::mark();
+    if (displayFiles(file1, file2, traceMark)) {
+        finishLoad(traceMark);
+    }
+}
+
+void DiffView::showPreloaded(const DiffPreloader &preloader)
+{
+    if (!currentFile1.isEmpty() || !currentFile2.isEmpty()) {
+        return;
+    }
+    
+    int traceMark = Tracer::mark();
+    {
+        TraceScope trace("loadFiles");
+        setCurrentFiles(preloader.file1(), preloader.file2());
+        if (ignoreWhitespace || ignoreReflow || ignorePunctuation) {
+            // An option was switched on while the preload ran
+            displayTextDiff(preloader.text1(), preloader.text2());
+        } else {
+            setPaneTexts(preloader.text1(), preloader.text2());
+            highlightDifferences(preloader.hunks());
+        }
+    }
+    finishLoad(traceMark);
+}
+
+void DiffView::finishLoad(int traceMark)
+{
+    if (Tracer::isEnabled()) {
+        emit timingsAvailable(Tracer::summary(traceMark));
+    }
+    emit diffShown();
+}
+
+bool DiffView::displayFiles(const QString &file1, const QString &file2, int traceMark)
+{
+    TraceScope trace("loadFiles");
+    setCurrentFiles(file1, file2);
     
-    QString ext1 = info1.suffix().toLower();
-    QString ext2 = info2.suffix().toLower();
+    QString ext1 = QFileInfo(file1).suffix().toLower();
+    QString ext2 = QFileInfo(file2).suffix().toLower();
     
     // Determine file type and display accordingly
     if (ext1 == "pdf" && ext2 == "pdf") {
         displayPdfDiff(file1, file2);
     } else if (ext1 == "docx" && ext2 == "docx") {
         displayDocxDiff(file1, file2);
-    } else if ((ext1 == "txt" || ext1 == "md") && (ext2 == "txt" || ext2 == "md")) {
-        // Read text files
-        QFile f1(file1), f2(file2);
-        QString text1, text2;
-        
-        if (f1.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&f1);
-            text1 = in.readAll();
-            f1.close();
-        }
-        
-        if (f2.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&f2);
-            text2 = in.readAll();
-            f2.close();
-        }
-        
-        displayTextDiff(text1, text2);
+    } else if (needsLargeFileMode(file1, file2, budget)) {
+        displayLargeDiff(file1, file2, traceMark);
+        return false;
+    } else if (ext1 == "md" && ext2 == "md") {
+        displayMarkdownDiff(readTextFile(file1), readTextFile(file2));
     } else {
-        // Try as text by default
-        QFile f1(file1), f2(file2);
-        QString text1, text2;
-        
-        if (f1.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&f1);
-            text1 = in.readAll();
-            f1.close();
+        // Plain text, and anything else is tried as text
+        displayCachedTextDiff(file1, file2);
+    }
+    return true;
+}
+
+void DiffView::prefetchFiles(const QString &file1, const QString &file2)
+{
+    if (!isPlainTextPair(file1, file2, budget)) {
+        return;
+    }
+    
+    // Each task has its own engine; the cache is shared and locked
+    DiffCache *cache = &diffCache;
+    const quint32 options = diffOptions();
+    prefetchPool->start([cache, file1, file2, options]() {
+        TraceScope trace("prefetch");
+        DiffCache::Key key;
+        QByteArray data1, data2;
+        if (!cache->makeKey(file1, file2, options, &key, &data1, &data2) || !cache->markPending(key)) {
+            return;
         }
-        
-        if (f2.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&f2);
-            text2 = in.readAll();
-            f2.close();
+        DiffCache::Entry entry;
+        entry.text1 = decodeText(file1, data1);
+        entry.text2 = decodeText(file2, data2);
+        DiffEngine engine;
+        entry.hunks = computeTextDiff(&engine, entry.text1, entry.text2, options);
+        cache->insert(key, entry);
+    });
+}
+
+void DiffView::setCurrentFiles(const QString &file1, const QString &file2)
+{
+    // A large diff still running is for the previous files
+    ++loadGeneration;
+    currentFile1 = file1;
+    currentFile2 = file2;
+    
+    QFileInfo info1(file1);
+    QFileInfo info2(file2);
+    loadedModified1 = info1.lastModified();
+    loadedModified2 = info2.lastModified();
+    loadedSize1 = info1.size();
+    loadedSize2 = info2.size();
+    watchCurrentFiles();
+}
+
+void DiffView::watchCurrentFiles()
+{
+    const QStringList watched = fileWatcher->files();
+    if (!watched.isEmpty()) {
+        fileWatcher->removePaths(watched);
+    }
+    
+    // Files replaced by rename drop out of the watcher and are added again
+    for (const QString &file : { currentFile1, currentFile2 }) {
+        if (!file.isEmpty() && QFileInfo::exists(file)) {
+            fileWatcher->addPath(file);
         }
-        
-        displayTextDiff(text1, text2);
     }
 }
 
-void DiffView::displayTextDiff(const QString &text1, const QString &text2)
+void DiffView::reloadFiles()
 {
-    // Apply preprocessing based on options
-    QString processedText1 = text1;
-    QString processedText2 = text2;
-    
-    if (ignoreWhitespace) {
-        processedText1 = diffEngine->normalizeWhitespace(processedText1);
-        processedText2 = diffEngine->normalizeWhitespace(processedText2);
+    if (currentFile1.isEmpty() || currentFile2.isEmpty()) {
+        return;
     }
     
-    if (ignorePunctuation) {
-        processedText1 = diffEngine->removePunctuation(processedText1);
-        processedText2 = diffEngine->removePunctuation(processedText2);
+    QFileInfo info1(currentFile1);
+    QFileInfo info2(currentFile2);
+    if (info1.lastModified() == loadedModified1 && info1.size() == loadedSize1
+        && info2.lastModified() == loadedModified2 && info2.size() == loadedSize2) {
+        watchCurrentFiles();
+        return;
     }
     
-    // Compute diff
-    QVector<DiffHunk> hunks = diffEngine->computeDiff(processedText1, processedText2);
+    // Re-diffing is cheap for local edits: the diff engine matches the
+    // common prefix and suffix up front and only runs Myers on the rest.
+    // Keep the reader where they were.
+    int vertical = leftPane->verticalScrollBar()->value();
+    int horizontal = leftPane->horizontalScrollBar()->value();
+    
+    loadFiles(currentFile1, currentFile2);
+    
+    leftPane->verticalScrollBar()->setValue(vertical);
+    leftPane->horizontalScrollBar()->setValue(horizontal);
+}
+
+QString DiffView::readTextFile(const QString &filePath)
+{
+    // Encoding detection and CRLF handling happen while decoding
+    TraceScope trace("readFile");
+    QString text = TextDecoder::decodeFile(filePath);
+    trace.arg("chars", text.size());
+    return text;
+}
+
+QString DiffView::decodeText(const QString &filePath, const QByteArray &data)
+{
+    return data.isNull() ? readTextFile(filePath) : TextDecoder::decode(data);
+}
+
+DocumentParser *DiffView::parser()
+{
+    // Text diffs, the common case at startup, never need the parser
+    if (!docParser) {
+        docParser = new DocumentParser(this);
+    }
+    return docParser;
+}
+
+void DiffView::displayTextDiff(const QString &text1, const QString &text2)
+{
+    QVector<DiffHunk> hunks = computeTextDiff(diffEngine, text1, text2, diffOptions());
     
     // Display in panes
-    leftPane->setPlainText(text1);
-    rightPane->setPlainText(text2);
+    setPaneTexts(text1, text2);
     
     // Highlight differences
     highlightDifferences(hunks);
 }
 
+void DiffView::displayCachedTextDiff(const QString &file1, const QString &file2)
+{
+    DiffCache::Key key;
+    DiffCache::Entry entry;
+    QByteArray data1, data2;
+    bool keyed;
+    bool hit;
+    {
+        TraceScope trace("diffCache");
+        keyed = diffCache.makeKey(file1, file2, diffOptions(), &key, &data1, &data2);
+        hit = keyed && diffCache.find(key, &entry);
+        // Only a prefetch of this very pair is worth waiting for; finishing
+        // it beats starting over
+        if (keyed && !hit && diffCache.waitForPending(key)) {
+            hit = diffCache.find(key, &entry);
+        }
+        trace.arg("hit", hit ? 1 : 0);
+    }
+    
+    if (!hit) {
+        // Files read for their hash are decoded from the same bytes
+        entry.text1 = decodeText(file1, data1);
+        entry.text2 = decodeText(file2, data2);
+        entry.hunks = computeTextDiff(diffEngine, entry.text1, entry.text2, diffOptions());
+        if (keyed) {
+            diffCache.insert(key, entry);
+        }
+    }
+    
+    setPaneTexts(entry.text1, entry.text2);
+    highlightDifferences(entry.hunks);
+}
+
+quint32 DiffView::diffOptions() const
+{
+    quint32 options = 0;
+    if (ignoreWhitespace) {
+        options |= IgnoreWhitespaceOption;
+    }
+    if (ignoreReflow) {
+        options |= IgnoreReflowOption;
+    }
+    if (ignorePunctuation) {
+        options |= IgnorePunctuationOption;
+    }
+    return options;
+}
+
+QVector<DiffHunk> DiffView::computeTextDiff(DiffEngine *engine, const QString &text1,
+                                            const QString &text2, quint32 options)
+{
+    const bool punctuation = options & IgnorePunctuationOption;
+    if (options & IgnoreReflowOption) {
+        // Word tokens ignore line breaks and whitespace by construction and
+        // skip punctuation themselves, so the original texts are diffed and
+        // the hunks line up with what is displayed
+        return engine->computeTokenDiff(text1, text2, punctuation);
+    }
+    
+    // Apply preprocessing based on options
+    QString processedText1 = text1;
+    QString processedText2 = text2;
+    
+    if (options & IgnoreWhitespaceOption) {
+        processedText1 = engine->normalizeWhitespace(processedText1);
+        processedText2 = engine->normalizeWhitespace(processedText2);
+    }
+    
+    if (punctuation) {
+        processedText1 = engine->removePunctuation(processedText1);
+        processedText2 = engine->removePunctuation(processedText2);
+    }
+    
+    return engine->computeDiff(processedText1, processedText2);
+}
+
 void DiffView::displayPdfDiff(const QString &file1, const QString &file2)
 {
     // Parse PDF files
-    QString text1 = docParser->parsePdf(file1);
-    QString text2 = docParser->parsePdf(file2);
+    QString text1 = parser()->parsePdf(file1);
+    QString text2 = parser()->parsePdf(file2);
     
     // For now, display as text diff
     // TODO: Implement page overlay mode
@@ -167,18 +414,286 @@ void DiffView::displayPdfDiff(const QString &file1, const QString &file2)
 void DiffView::displayDocxDiff(const QString &file1, const QString &file2)
 {
     // Parse DOCX with rich structure
-    DocumentStructure doc1 = docParser->parseDocx(file1);
-    DocumentStructure doc2 = docParser->parseDocx(file2);
+    DocumentStructure doc1 = parser()->parseDocx(file1);
+    DocumentStructure doc2 = parser()->parseDocx(file2);
     
     // Format as text preserving structure
-    QString text1 = docParser->formatStructure(doc1);
-    QString text2 = docParser->formatStructure(doc2);
+    QVector<DiffBlock> blocks1, blocks2;
+    QString text1 = parser()->formatStructure(doc1, &blocks1);
+    QString text2 = parser()->formatStructure(doc2, &blocks2);
     
-    displayTextDiff(text1, text2);
+    // Normalization shifts character offsets away from the element ranges,
+    // so those options go through the plain line or token diff
+    if (ignoreWhitespace || ignoreReflow || ignorePunctuation) {
+        displayTextDiff(text1, text2);
+        return;
+    }
+    
+    // Match elements first, then diff only inside the changed ones
+    QVector<DiffHunk> hunks = diffEngine->computeBlockDiff(text1, blocks1, text2, blocks2);
+    
+    setPaneTexts(text1, text2);
+    
+    highlightDifferences(hunks);
 }
 
-void DiffView::highlightDifferences(const QVector<DiffHunk> &hunks)
+void DiffView::displayMarkdownDiff(const QString &text1, const QString &text2)
 {
+    // Same restriction as DOCX: normalized text no longer matches the
+    // block ranges, so fall back to the line or token diff
+    if (ignoreWhitespace || ignoreReflow || ignorePunctuation) {
+        displayTextDiff(text1, text2);
+        return;
+    }
+    
+    QVector<DiffSection> sections1 = parser()->buildSections(parser()->parseMarkdown(text1));
+    QVector<DiffSection> sections2 = parser()->buildSections(parser()->parseMarkdown(text2));
+    
+    // Align sections by heading and content, then diff inside matched ones
+    QVector<DiffHunk> hunks = diffEngine->computeSectionDiff(text1, sections1, text2, sections2);
+    
+    setPaneTexts(text1, text2);
+    
+    highlightDifferences(hunks);
+    
+    if (foldUnchanged) {
+        foldUnchangedSections(leftPane, sections1, hunks, true);
+        foldUnchangedSections(rightPane, sections2, hunks, false);
+    }
+}
+
+void DiffView::displayLargeDiff(const QString &file1, const QString &file2, int traceMark)
+{
+    // Hashing and diffing files this size takes seconds; keep the window
+    // responsive meanwhile
+    const QString waiting = tr("Comparing large files...");
+    setPaneTexts(waiting, waiting);
+    
+    const int generation = loadGeneration;
+    const qint64 memoryBudget = budget;
+    largeDiffPool->start([this, file1, file2, memoryBudget, generation, traceMark]() {
+        auto cancelled = [this, generation]() { return generation != loadGeneration; };
+        const LargeExcerpt excerpt = largeExcerpt(file1, file2, memoryBudget, cancelled);
+        QMetaObject::invokeMethod(this, [this, excerpt, generation, traceMark]() {
+            if (generation != loadGeneration) {
+                return;
+            }
+            setPaneTexts(excerpt.text1, excerpt.text2);
+            rowAligned = true;
+            highlightDifferences(excerpt.hunks);
+            finishLoad(traceMark);
+        }, Qt::QueuedConnection);
+    });
+}
+
+DiffView::LargeExcerpt DiffView::largeExcerpt(const QString &file1, const QString &file2, qint64 memoryBudget,
+                                               const std::function<bool()> &cancelled)
+{
+    LargeExcerpt excerpt;
+    LargeFileDiff diff(memoryBudget);
+    if (!diff.compare(file1, file2, cancelled)) {
+        excerpt.text1 = diff.errorString();
+        excerpt.text2 = diff.errorString();
+        return excerpt;
+    }
+    
+    // Like a unified diff split in two: each run of hunks with a few lines
+    // of context, rows padded so both sides stay aligned
+    QString text1, text2;
+    QVector<DiffHunk> &hunks = excerpt.hunks;
+    int rows = 0;
+    
+    auto appendLines = [&](QString &text, int side, qint64 from, qint64 to) {
+        const qint64 shown = qMin(to - from, qint64(kMaxLargeHunkLines));
+        for (qint64 i = from; i < from + shown; ++i) {
+            text += diff.text(side, i, kMaxLargeLineBytes);
+            text += QLatin1Char('\n');
+        }
+        if (shown < to - from) {
+            text += tr("[%1 more lines]\n").arg(to - from - shown);
+            return shown + 1;
+        }
+        return shown;
+    };
+    
+    qint64 shownHunks = 0;
+    qint64 next1 = 0;   // Lines before this are already shown
+    for (; shownHunks < diff.hunkCount() && rows < kMaxLargeRows; ++shownHunks) {
+        const LineHunk hunk = diff.hunk(shownHunks);
+        
+        // Unchanged lines between hunks are the same number on both sides
+        const qint64 from1 = qMax(hunk.leftStart - kLargeContextLines, next1);
+        const qint64 from2 = hunk.rightStart - (hunk.leftStart - from1);
+        if (shownHunks == 0 || from1 > next1) {
+            text1 += QString("@@ line %1 @@\n").arg(from1 + 1);
+            text2 += QString("@@ line %1 @@\n").arg(from2 + 1);
+            ++rows;
+        }
+        rows += appendLines(text1, 1, from1, hunk.leftStart);
+        appendLines(text2, 2, from2, hunk.rightStart);
+        
+        DiffHunk shown;
+        shown.type = hunk.type;
+        shown.leftStart = text1.size();
+        shown.rightStart = text2.size();
+        qint64 rows1 = appendLines(text1, 1, hunk.leftStart, hunk.leftEnd);
+        qint64 rows2 = appendLines(text2, 2, hunk.rightStart, hunk.rightEnd);
+        shown.leftEnd = rows1 > 0 ? text1.size() - 1 : shown.leftStart;
+        shown.rightEnd = rows2 > 0 ? text2.size() - 1 : shown.rightStart;
+        hunks.append(shown);
+        for (; rows1 < rows2; ++rows1) {
+            text1 += QLatin1Char('\n');
+        }
+        for (; rows2 < rows1; ++rows2) {
+            text2 += QLatin1Char('\n');
+        }
+        rows += int(rows1);
+        
+        qint64 until1 = qMin(hunk.leftEnd + kLargeContextLines, diff.lineCount(1));
+        if (shownHunks + 1 < diff.hunkCount()) {
+            until1 = qMin(until1, diff.hunk(shownHunks + 1).leftStart);
+        }
+        const qint64 until2 = hunk.rightEnd + (until1 - hunk.leftEnd);
+        rows += appendLines(text1, 1, hunk.leftEnd, until1);
+        appendLines(text2, 2, hunk.rightEnd, until2);
+        next1 = until1;
+    }
+    
+    // Header line; hunk offsets move past it
+    const qint64 peak = LargeFileDiff::peakResidentBytes();
+    QString header = tr("Large file mode: %1 of %2 changes shown, diff options do not apply")
+                         .arg(shownHunks).arg(diff.hunkCount());
+    if (peak >= 0) {
+        header += tr(", peak memory %1 MiB").arg(peak >> 20);
+    }
+    header += QLatin1Char('\n');
+    for (DiffHunk &hunk : hunks) {
+        hunk.leftStart += header.size();
+        hunk.leftEnd += header.size();
+        hunk.rightStart += header.size();
+        hunk.rightEnd += header.size();
+    }
+    
+    excerpt.text1 = header + text1;
+    excerpt.text2 = header + text2;
+    return excerpt;
+}
+
+void DiffView::foldUnchangedSections(QTextEdit *pane, const QVector<DiffSection> &sections,
+                                     const QVector<DiffHunk> &hunks, bool leftSide)
+{
+    if (sections.isEmpty()) {
+        return;
+    }
+    
+    // Hunks never cross sections, so the one holding a hunk's start is the
+    // only one it touches
+    QVector<bool> changed(sections.size(), false);
+    for (const DiffHunk &hunk : hunks) {
+        int start = leftSide ? hunk.leftStart : hunk.rightStart;
+        int end = leftSide ? hunk.leftEnd : hunk.rightEnd;
+        if (start == end) {
+            continue;
+        }
+        auto it = std::upper_bound(sections.constBegin(), sections.constEnd(), start,
+                                   [](int pos, const DiffSection &section) { return pos < section.start; });
+        if (it != sections.constBegin()) {
+            changed[int(it - sections.constBegin()) - 1] = true;
+        }
+    }
+    
+    // Keep the heading line of an unchanged section, hide its body
+    QTextDocument *document = pane->document();
+    for (int i = 0; i < sections.size(); ++i) {
+        if (changed[i]) {
+            continue;
+        }
+        const DiffSection &section = sections[i];
+        const QVector<int> &segmentStarts = leftSide ? segmentStarts1 : segmentStarts2;
+        int start = displayPosition(segmentStarts, section.start, false);
+        int end = displayPosition(segmentStarts, section.start + section.length, true);
+        QTextBlock block = document->findBlock(start).next();
+        QTextBlock last = document->findBlock(end);
+        while (block.isValid() && block.blockNumber() <= last.blockNumber()) {
+            block.setVisible(false);
+            block = block.next();
+        }
+        document->markContentsDirty(start, end - start);
+    }
+}
+
+void DiffView::setPaneTexts(const QString &text1, const QString &text2)
+{
+    TraceScope trace("setPlainText");
+    trace.arg("chars", text1.size() + text2.size());
+    // The old alignment does not apply to the new texts
+    alignment.clear();
+    rowAligned = false;
+    ruler->setAlignment(alignment);
+    
+    // A multi-megabyte line would be laid out as one block; segment rows
+    // keep every block short
+    segmentStarts1 = LineSegmenter::segmentStarts(text1);
+    segmentStarts2 = LineSegmenter::segmentStarts(text2);
+    trace.arg("segments", segmentStarts1.size() + segmentStarts2.size());
+    leftPane->setPlainText(segmentedText(text1, segmentStarts1));
+    rightPane->setPlainText(segmentedText(text2, segmentStarts2));
+}
+
+QString DiffView::segmentedText(const QString &text, const QVector<int> &segmentStarts)
+{
+    if (segmentStarts.isEmpty()) {
+        return text;
+    }
+    
+    QString segmented;
+    segmented.reserve(text.size() + segmentStarts.size());
+    int from = 0;
+    for (int start : segmentStarts) {
+        segmented.append(QStringView(text.constData() + from, start - from));
+        segmented.append(QLatin1Char('\n'));
+        from = start;
+    }
+    segmented.append(QStringView(text.constData() + from, text.size() - from));
+    return segmented;
+}
+
+int DiffView::displayPosition(const QVector<int> &segmentStarts, int pos, bool rangeEnd)
+{
+    // Each break sits just before its segment start: a range starting
+    // there begins after the break, one ending there stops before it
+    auto it = rangeEnd
+        ? std::lower_bound(segmentStarts.constBegin(), segmentStarts.constEnd(), pos)
+        : std::upper_bound(segmentStarts.constBegin(), segmentStarts.constEnd(), pos);
+    return pos + int(it - segmentStarts.constBegin());
+}
+
+QVector<DiffHunk> DiffView::toDisplay(const QVector<DiffHunk> &hunks) const
+{
+    if (segmentStarts1.isEmpty() && segmentStarts2.isEmpty()) {
+        return hunks;
+    }
+    
+    // Empty ranges mark insertion points and stay empty
+    auto mapRange = [](const QVector<int> &segmentStarts, int *start, int *end) {
+        const bool empty = *start == *end;
+        *start = displayPosition(segmentStarts, *start, false);
+        *end = empty ? *start : displayPosition(segmentStarts, *end, true);
+    };
+    
+    QVector<DiffHunk> mapped = hunks;
+    for (DiffHunk &hunk : mapped) {
+        mapRange(segmentStarts1, &hunk.leftStart, &hunk.leftEnd);
+        mapRange(segmentStarts2, &hunk.rightStart, &hunk.rightEnd);
+    }
+    return mapped;
+}
+
+void DiffView::highlightDifferences(const QVector<DiffHunk> &diffHunks)
+{
+    TraceScope trace("highlightDifferences");
+    trace.arg("hunks", diffHunks.size());
+    const QVector<DiffHunk> hunks = toDisplay(diffHunks);
     QTextCursor leftCursor(leftPane->document());
     QTextCursor rightCursor(rightPane->document());
     
@@ -191,6 +706,9 @@ void DiffView::highlightDifferences(const QVector<DiffHunk> &hunks)
     QTextCharFormat modifiedFormat;
     modifiedFormat.setBackground(QColor(255, 255, 200)); // Light yellow
     
+    QTextCharFormat movedFormat;
+    movedFormat.setBackground(QColor(200, 225, 255)); // Light blue
+    
     for (const DiffHunk &hunk : hunks) {
         if (hunk.type == DiffHunk::Added) {
             rightCursor.setPosition(hunk.rightStart);
@@ -200,6 +718,14 @@ void DiffView::highlightDifferences(const QVector<DiffHunk> &hunks)
             leftCursor.setPosition(hunk.leftStart);
             leftCursor.setPosition(hunk.leftEnd, QTextCursor::KeepAnchor);
             leftCursor.setCharFormat(deletedFormat);
+        } else if (hunk.type == DiffHunk::Moved) {
+            leftCursor.setPosition(hunk.leftStart);
+            leftCursor.setPosition(hunk.leftEnd, QTextCursor::KeepAnchor);
+            leftCursor.setCharFormat(movedFormat);
+            
+            rightCursor.setPosition(hunk.rightStart);
+            rightCursor.setPosition(hunk.rightEnd, QTextCursor::KeepAnchor);
+            rightCursor.setCharFormat(movedFormat);
         } else if (hunk.type == DiffHunk::Modified) {
             leftCursor.setPosition(hunk.leftStart);
             leftCursor.setPosition(hunk.leftEnd, QTextCursor::KeepAnchor);
@@ -210,6 +736,118 @@ void DiffView::highlightDifferences(const QVector<DiffHunk> &hunks)
             rightCursor.setCharFormat(modifiedFormat);
         }
     }
+    
+    buildAlignment(hunks);
+}
+
+void DiffView::buildAlignment(const QVector<DiffHunk> &hunks)
+{
+    TraceScope trace("buildAlignment");
+    QTextDocument *document1 = leftPane->document();
+    QTextDocument *document2 = rightPane->document();
+    
+    // Hunk ends exclude the last line break, so end - 1 is on the last line
+    auto lineRange = [](QTextDocument *document, int start, int end, int *line0, int *line1) {
+        *line0 = document->findBlock(start).blockNumber();
+        *line1 = end > start ? document->findBlock(end - 1).blockNumber() + 1 : *line0;
+    };
+    
+    QVector<AlignmentMap::Change> changes;
+    changes.reserve(hunks.size());
+    for (const DiffHunk &hunk : hunks) {
+        AlignmentMap::Change change;
+        change.type = hunk.type;
+        lineRange(document1, hunk.leftStart, hunk.leftEnd, &change.left0, &change.left1);
+        lineRange(document2, hunk.rightStart, hunk.rightEnd, &change.right0, &change.right1);
+        if (rowAligned) {
+            // Hunk ranges stop before the padding; the change spans it too
+            const int rows = qMax(change.left1 - change.left0, change.right1 - change.right0);
+            change.left1 = change.left0 + rows;
+            change.right1 = change.right0 + rows;
+        }
+        changes.append(change);
+    }
+    alignment.build(changes, document1->blockCount(), document2->blockCount());
+    trace.arg("rows", alignment.rowCount());
+    
+    ruler->setAlignment(alignment);
+    updateRuler();
+}
+
+void DiffView::syncVerticalScroll(int fromSide)
+{
+    if (syncingScroll) {
+        return;
+    }
+    syncingScroll = true;
+    
+    QTextEdit *from = fromSide == 1 ? leftPane : rightPane;
+    QTextEdit *to = fromSide == 1 ? rightPane : leftPane;
+    if (alignment.isEmpty()) {
+        to->verticalScrollBar()->setValue(from->verticalScrollBar()->value());
+    } else {
+        scrollToLine(to, alignment.map(fromSide, topLine(from)));
+    }
+    
+    syncingScroll = false;
+    updateRuler();
+}
+
+double DiffView::topLine(QTextEdit *pane) const
+{
+    // Binary search for the block under the top edge, plus the part of it
+    // already scrolled past; block positions come from the layout
+    QTextDocument *document = pane->document();
+    QAbstractTextDocumentLayout *layout = document->documentLayout();
+    const double y = pane->verticalScrollBar()->value();
+    int low = 0;
+    int high = document->blockCount() - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (layout->blockBoundingRect(document->findBlockByNumber(mid)).top() <= y) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    
+    QRectF rect = layout->blockBoundingRect(document->findBlockByNumber(low));
+    double fraction = rect.height() > 0 ? (y - rect.top()) / rect.height() : 0;
+    return low + qBound(0.0, fraction, 1.0);
+}
+
+double DiffView::visibleLines(QTextEdit *pane) const
+{
+    return double(pane->viewport()->height()) / qMax(1, pane->fontMetrics().lineSpacing());
+}
+
+void DiffView::scrollToLine(QTextEdit *pane, double line)
+{
+    QTextDocument *document = pane->document();
+    int number = qBound(0, int(line), document->blockCount() - 1);
+    QRectF rect = document->documentLayout()->blockBoundingRect(document->findBlockByNumber(number));
+    pane->verticalScrollBar()->setValue(int(rect.top() + (line - number) * rect.height()));
+}
+
+void DiffView::updateRuler()
+{
+    if (alignment.isEmpty()) {
+        ruler->setViewport(0, 0);
+        return;
+    }
+    const double first = topLine(leftPane);
+    const double row0 = alignment.toRow(1, first);
+    ruler->setViewport(row0, alignment.toRow(1, first + visibleLines(leftPane)) - row0);
+}
+
+void DiffView::scrollToRow(double row)
+{
+    if (alignment.isEmpty()) {
+        return;
+    }
+    // Centre the requested row; the right pane follows through the map
+    double line = alignment.fromRow(1, row) - visibleLines(leftPane) / 2;
+    scrollToLine(leftPane, qMax(0.0, line));
 }
 
 void DiffView::setIgnoreWhitespace(bool ignore)
@@ -220,6 +858,44 @@ void DiffView::setIgnoreWhitespace(bool ignore)
     }
 }
 
+void DiffView::setMemoryBudget(qint64 bytes)
+{
+    budget = bytes;
+    diffCache.setCapacity(bytes / kCacheBudgetDivisor);
+    if (!currentFile1.isEmpty() && !currentFile2.isEmpty()) {
+        loadFiles(currentFile1, currentFile2);
+    }
+}
+
+qint64 DiffView::memoryBudget() const
+{
+    return budget;
+}
+
+qint64 DiffView::defaultMemoryBudget()
+{
+    return kDefaultMemoryBudget;
+}
+
+bool DiffView::needsLargeFileMode(const QString &file1, const QString &file2, qint64 budget)
+{
+    return (QFileInfo(file1).size() + QFileInfo(file2).size()) * kTextMemoryFactor > budget;
+}
+
+bool DiffView::isPlainTextPair(const QString &file1, const QString &file2, qint64 budget)
+{
+    if (needsLargeFileMode(file1, file2, budget)) {
+        return false;
+    }
+    
+    // Same dispatch as displayFiles(): a pair of PDF, DOCX or Markdown
+    // files is parsed, anything else is diffed as text
+    static const QStringList parsed = { "pdf", "docx", "md" };
+    QString ext1 = QFileInfo(file1).suffix().toLower();
+    QString ext2 = QFileInfo(file2).suffix().toLower();
+    return !(ext1 == ext2 && parsed.contains(ext1));
+}
+
 void DiffView::setIgnoreReflow(bool ignore)
 {
     ignoreReflow = ignore;
@@ -228,6 +904,14 @@ void DiffView::setIgnoreReflow(bool ignore)
     }
 }
 
+void DiffView::setFoldUnchangedSections(bool fold)
+{
+    foldUnchanged = fold;
+    if (!currentFile1.isEmpty() && !currentFile2.isEmpty()) {
+        loadFiles(currentFile1, currentFile2);
+    }
+}
+
 void DiffView::setIgnorePunctuation(bool ignore)
 {
     ignorePunctuation = ignore;
@@ -5,8 +5,19 @@
 #include <QTextEdit>
 #include <QScrollBar>
 #include <QSplitter>
+#include <QDateTime>
+#include <atomic>
+#include <functional>
 #include "diffengine.h"
 #include "documentparser.h"
+#include "alignmentmap.h"
+#include "diffcache.h"
+
+class DiffPreloader;
+class OverviewRuler;
+class QFileSystemWatcher;
+class QThreadPool;
+class QTimer;
 
 class DiffView : public QWidget
 {
@@ -19,30 +30,133 @@ public:
     void setIgnoreWhitespace(bool ignore);
     void setIgnoreReflow(bool ignore);
     void setIgnorePunctuation(bool ignore);
+    void setFoldUnchangedSections(bool fold);
+    
+    // Files whose text would not fit are diffed by LargeFileDiff and shown
+    // as changed regions with context
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+    static qint64 defaultMemoryBudget();
+    static bool needsLargeFileMode(const QString &file1, const QString &file2, qint64 budget);
+    // Pairs that are diffed as plain text: no PDF, DOCX or Markdown pair
+    // and nothing beyond the memory budget
+    static bool isPlainTextPair(const QString &file1, const QString &file2, qint64 budget);
+    
+    // Shows a diff computed ahead of time, unless other files were opened
+    // in the meantime
+    void showPreloaded(const DiffPreloader &preloader);
+    
+    static QString readTextFile(const QString &filePath);
+    // Decodes bytes already read, or reads the file if data is null
+    static QString decodeText(const QString &filePath, const QByteArray &data);
 
 public slots:
     void loadFiles(const QString &file1, const QString &file2);
+    // Diffs a plain text pair in the background with the current options,
+    // so that opening it later is a cache hit
+    void prefetchFiles(const QString &file1, const QString &file2);
+
+signals:
+    // Per-stage timings of the last diff, only while tracing is enabled
+    void timingsAvailable(const QString &summary);
+    // A diff was highlighted in the panes
+    void diffShown();
+
+private slots:
+    void reloadFiles();
+    void scrollToRow(double row);
 
 private:
+    enum DiffOption {
+        IgnoreWhitespaceOption = 0x1,
+        IgnoreReflowOption = 0x2,
+        IgnorePunctuationOption = 0x4
+    };
+    
+    // Excerpt of a large file diff, ready for the panes
+    struct LargeExcerpt {
+        QString text1;
+        QString text2;
+        QVector<DiffHunk> hunks;
+    };
+    
+    quint32 diffOptions() const;
+    static QVector<DiffHunk> computeTextDiff(DiffEngine *engine, const QString &text1,
+                                             const QString &text2, quint32 options);
+    // False if the diff is shown later, when a worker has computed it
+    bool displayFiles(const QString &file1, const QString &file2, int traceMark);
+    void setCurrentFiles(const QString &file1, const QString &file2);
+    void watchCurrentFiles();
+    void finishLoad(int traceMark);
     void setupUI();
     void displayTextDiff(const QString &text1, const QString &text2);
+    void displayCachedTextDiff(const QString &file1, const QString &file2);
     void displayPdfDiff(const QString &file1, const QString &file2);
     void displayDocxDiff(const QString &file1, const QString &file2);
+    void displayMarkdownDiff(const QString &text1, const QString &text2);
+    void displayLargeDiff(const QString &file1, const QString &file2, int traceMark);
+    static LargeExcerpt largeExcerpt(const QString &file1, const QString &file2, qint64 memoryBudget,
+                                     const std::function<bool()> &cancelled);
+    void foldUnchangedSections(QTextEdit *pane, const QVector<DiffSection> &sections,
+                               const QVector<DiffHunk> &hunks, bool leftSide);
+    DocumentParser *parser();
+    void setPaneTexts(const QString &text1, const QString &text2);
+    static QString segmentedText(const QString &text, const QVector<int> &segmentStarts);
+    static int displayPosition(const QVector<int> &segmentStarts, int pos, bool rangeEnd);
+    QVector<DiffHunk> toDisplay(const QVector<DiffHunk> &hunks) const;
     void highlightDifferences(const QVector<DiffHunk> &hunks);
+    void buildAlignment(const QVector<DiffHunk> &hunks);
+    void syncVerticalScroll(int fromSide);
+    double topLine(QTextEdit *pane) const;
+    double visibleLines(QTextEdit *pane) const;
+    void scrollToLine(QTextEdit *pane, double line);
+    void updateRuler();
     
     QTextEdit *leftPane;
     QTextEdit *rightPane;
     QSplitter *splitter;
+    OverviewRuler *ruler;
+    
+    // Long lines are shown one segment per row; these are the offsets in
+    // the diffed texts where a row break was inserted
+    QVector<int> segmentStarts1;
+    QVector<int> segmentStarts2;
+    
+    // Line correspondence of the shown diff; drives scrolling and the ruler
+    AlignmentMap alignment;
+    bool syncingScroll;
+    // The shorter side of every change is padded with blank rows, as in
+    // large file mode, so equal row numbers correspond
+    bool rowAligned;
     
     DiffEngine *diffEngine;
+    // Created when the first PDF, DOCX or Markdown pair is opened
     DocumentParser *docParser;
     
     bool ignoreWhitespace;
     bool ignoreReflow;
     bool ignorePunctuation;
+    bool foldUnchanged;
+    qint64 budget;
+    
+    // Recent and prefetched text diffs; prefetches run one at a time
+    DiffCache diffCache;
+    QThreadPool *prefetchPool;
+    // Large file diffs run here, one at a time; one is abandoned as soon as
+    // other files are opened, so the next never waits behind it
+    QThreadPool *largeDiffPool;
+    std::atomic<int> loadGeneration;
     
     QString currentFile1;
     QString currentFile2;
+    
+    // The open pair is re-diffed when either file changes on disk
+    QFileSystemWatcher *fileWatcher;
+    QTimer *reloadTimer;
+    QDateTime loadedModified1;
+    QDateTime loadedModified2;
+    qint64 loadedSize1;
+    qint64 loadedSize2;
 };
 
 #endif // DIFFVIEW_H
@@ -1,13 +1,30 @@
 #include "documentparser.h"
+#include "tracer.h"
+#include "zipreader.h"
 #include <QFile>
 #include <QTextStream>
 #include <QXmlStreamReader>
+#include <QRegularExpression>
 #include <QDebug>
+#include <QVector>
+#include <memory>
 
 #ifdef HAVE_POPPLER
 #include <poppler/qt6/poppler-qt6.h>
 #endif
 
+namespace {
+
+// A DOCX paragraph interrupted by one nested in a text box
+struct OpenParagraph
+{
+    DocumentElement element;
+    QString text;
+    int runDepth = 0;
+};
+
+} // namespace
+
 DocumentParser::DocumentParser(QObject *parent)
     : QObject(parent)
 {
@@ -19,6 +36,7 @@ DocumentParser::~DocumentParser()
 
 QString DocumentParser::parsePdf(const QString &filePath)
 {
+    TraceScope trace("parsePdf");
 #ifdef HAVE_POPPLER
     // Use Poppler to extract text from PDF
     Poppler::Document *document = Poppler::Document::load(filePath);
@@ -42,6 +60,8 @@ QString DocumentParser::parsePdf(const QString &filePath)
     }
     
     delete document;
+    trace.arg("pages", numPages);
+    trace.arg("chars", text.size());
     return text;
 #else
     qWarning() << "PDF support not available (Poppler not found)";
@@ -51,58 +71,68 @@ QString DocumentParser::parsePdf(const QString &filePath)
 
 DocumentStructure DocumentParser::parseDocx(const QString &filePath)
 {
-    DocumentStructure structure;
-    
-    // DOCX is a ZIP file containing XML
-    // For simplicity, we'll extract text from document.xml
-    QString xmlContent = extractTextFromZip(filePath, "word/document.xml");
-    
-    if (xmlContent.isEmpty()) {
-        qWarning() << "Failed to parse DOCX:" << filePath;
-        return structure;
+    // DOCX is a ZIP file containing XML; stream word/document.xml
+    // straight out of the archive into the XML reader
+    TraceScope trace("parseDocx");
+    ZipReader zip(filePath);
+    if (!zip.open()) {
+        qWarning() << "Failed to open DOCX:" << filePath << zip.errorString();
+        return DocumentStructure();
     }
     
-    return parseDocxXml(xmlContent);
-}
-
-QString DocumentParser::extractTextFromZip(const QString &filePath, const QString &entryName)
-{
-    // This is a placeholder implementation
-    // In a real implementation, you would use QuaZip or similar library
-    // For now, we'll return a simple message
-    
-    qWarning() << "DOCX parsing requires QuaZip library (not implemented in this basic version)";
-    
-    // Try to read as plain text as fallback
-    QFile file(filePath);
-    if (file.open(QIODevice::ReadOnly)) {
-        // DOCX files are binary, so this won't work well
-        // but it's a fallback
-        return QString("DOCX support requires QuaZip library\nFile: %1").arg(filePath);
+    std::unique_ptr<QIODevice> xmlDevice(zip.openEntry("word/document.xml"));
+    if (!xmlDevice) {
+        qWarning() << "Failed to parse DOCX:" << filePath << zip.errorString();
+        return DocumentStructure();
     }
     
-    return QString();
+    DocumentStructure structure = parseDocxXml(xmlDevice.get());
+    trace.arg("elements", structure.elements.size());
+    return structure;
 }
 
-DocumentStructure DocumentParser::parseDocxXml(const QString &xmlContent)
+DocumentStructure DocumentParser::parseDocxXml(QIODevice *xmlDevice)
 {
     DocumentStructure structure;
-    QXmlStreamReader xml(xmlContent);
+    QXmlStreamReader xml(xmlDevice);
     
     DocumentElement currentElement;
     QString currentText;
     
+    // Paragraphs inside a table cell are joined into one TableCell element
+    QString cellText;
+    int cellDepth = 0;
+    int column = 0;
+    // w:tab also defines tab stops in paragraph properties; only a tab
+    // inside a run is text
+    int runDepth = 0;
+    // Text boxes hold whole paragraphs inside a run of the enclosing one,
+    // which is resumed once they end
+    QVector<OpenParagraph> outerParagraphs;
+    int paragraphDepth = 0;
+    
     while (!xml.atEnd()) {
         xml.readNext();
         
         if (xml.isStartElement()) {
             if (xml.name() == QString("p")) {
                 // Paragraph
+                if (paragraphDepth++ > 0) {
+                    outerParagraphs.append({currentElement, currentText, runDepth});
+                    runDepth = 0;
+                }
+                currentElement = DocumentElement();
                 currentElement.type = DocumentElement::Paragraph;
                 currentText.clear();
             } else if (xml.name() == QString("t")) {
                 // Text run
                 currentText += xml.readElementText();
+            } else if (xml.name() == QString("r")) {
+                ++runDepth;
+            } else if (xml.name() == QString("tab")) {
+                if (runDepth > 0) {
+                    currentText += '\t';
+                }
             } else if (xml.name() == QString("pStyle")) {
                 // Check for heading style
                 QString val = xml.attributes().value("val").toString();
@@ -110,16 +140,55 @@ DocumentStructure DocumentParser::parseDocxXml(const QString &xmlContent)
                     currentElement.type = DocumentElement::Heading;
                     currentElement.level = val.mid(7).toInt(); // Extract number from "Heading1"
                 }
+            } else if (xml.name() == QString("numPr")) {
+                // Numbering properties mark a list item; depth follows in ilvl
+                if (currentElement.type != DocumentElement::Heading) {
+                    currentElement.type = DocumentElement::ListItem;
+                }
+            } else if (xml.name() == QString("ilvl")) {
+                if (currentElement.type == DocumentElement::ListItem) {
+                    currentElement.level = xml.attributes().value("val").toInt();
+                }
+            } else if (xml.name() == QString("tr")) {
+                if (cellDepth == 0) {
+                    column = 0;
+                }
+            } else if (xml.name() == QString("tc")) {
+                if (cellDepth++ == 0) {
+                    cellText.clear();
+                }
             }
         } else if (xml.isEndElement()) {
-            if (xml.name() == QString("p")) {
+            if (xml.name() == QString("r")) {
+                --runDepth;
+            } else if (xml.name() == QString("p")) {
                 // End of paragraph
-                currentElement.content = currentText;
-                if (!currentText.trimmed().isEmpty()) {
+                if (cellDepth > 0) {
+                    if (!cellText.isEmpty() && !currentText.isEmpty()) {
+                        cellText += ' ';
+                    }
+                    cellText += currentText;
+                } else if (!currentText.trimmed().isEmpty()) {
+                    currentElement.content = currentText;
                     structure.elements.append(currentElement);
                 }
                 currentElement = DocumentElement();
                 currentText.clear();
+                if (--paragraphDepth > 0 && !outerParagraphs.isEmpty()) {
+                    const OpenParagraph outer = outerParagraphs.takeLast();
+                    currentElement = outer.element;
+                    currentText = outer.text;
+                    runDepth = outer.runDepth;
+                }
+            } else if (xml.name() == QString("tc")) {
+                // Empty cells are kept so columns stay aligned
+                if (--cellDepth == 0) {
+                    DocumentElement cell;
+                    cell.type = DocumentElement::TableCell;
+                    cell.level = column++;
+                    cell.content = cellText;
+                    structure.elements.append(cell);
+                }
             }
         }
     }
@@ -131,28 +200,195 @@ DocumentStructure DocumentParser::parseDocxXml(const QString &xmlContent)
     return structure;
 }
 
-QString DocumentParser::formatStructure(const DocumentStructure &structure)
+DocumentStructure DocumentParser::parseMarkdown(const QString &text)
 {
+    TraceScope trace("parseMarkdown");
+    trace.arg("chars", text.size());
+    static const QRegularExpression atxHeading("^ {0,3}(#{1,6})(?:[ \\t]+|$)(.*?)(?:[ \\t]+#+)?[ \\t]*$");
+    static const QRegularExpression setextUnderline("^ {0,3}(?:=+|-+)[ \\t]*$");
+    static const QRegularExpression listMarker("^([ \\t]*)(?:[-*+]|\\d{1,9}[.)])(?:[ \\t]+|$)");
+    static const QRegularExpression fence("^ {0,3}(`{3,}|~{3,})");
+    
+    DocumentStructure structure;
+    
+    // Paragraphs, list items and code blocks span lines until closed
+    DocumentElement current;
+    bool open = false;
+    QString fenceMarker;
+    
+    auto flush = [&]() {
+        if (!open) {
+            return;
+        }
+        if (current.content.isEmpty()) {
+            current.content = text.mid(current.offset, current.length).trimmed();
+        }
+        structure.elements.append(current);
+        current = DocumentElement();
+        open = false;
+    };
+    
+    auto begin = [&](DocumentElement::Type type, int level, int offset, int length) {
+        flush();
+        current.type = type;
+        current.level = level;
+        current.offset = offset;
+        current.length = length;
+        open = true;
+    };
+    
+    const int textLength = text.length();
+    int lineStart = 0;
+    while (true) {
+        int lineEnd = text.indexOf('\n', lineStart);
+        if (lineEnd < 0) {
+            lineEnd = textLength;
+        }
+        const QString line = text.mid(lineStart, lineEnd - lineStart);
+        const QString trimmed = line.trimmed();
+        
+        if (!fenceMarker.isEmpty()) {
+            // Everything up to the closing fence belongs to the code block
+            current.length = lineEnd - current.offset;
+            if (trimmed.startsWith(fenceMarker)) {
+                fenceMarker.clear();
+                flush();
+            }
+        } else if (trimmed.isEmpty()) {
+            flush();
+        } else if (QRegularExpressionMatch match = fence.match(line); match.hasMatch()) {
+            begin(DocumentElement::CodeBlock, 0, lineStart, lineEnd - lineStart);
+            fenceMarker = match.captured(1);
+        } else if (QRegularExpressionMatch match = atxHeading.match(line); match.hasMatch()) {
+            begin(DocumentElement::Heading, match.capturedLength(1), lineStart, lineEnd - lineStart);
+            current.content = match.captured(2);
+            flush();
+        } else if (open && current.type == DocumentElement::Paragraph && setextUnderline.match(line).hasMatch()) {
+            // Underlined paragraph: === is level 1, --- level 2
+            current.type = DocumentElement::Heading;
+            current.level = trimmed.startsWith('=') ? 1 : 2;
+            current.content = text.mid(current.offset, lineStart - current.offset).trimmed();
+            current.length = lineEnd - current.offset;
+            flush();
+        } else if (trimmed.startsWith('|')) {
+            begin(DocumentElement::TableRow, 0, lineStart, lineEnd - lineStart);
+            flush();
+        } else if (QRegularExpressionMatch match = listMarker.match(line); match.hasMatch()) {
+            QString indent = match.captured(1);
+            int depth = indent.count('\t') * 2 + indent.count(' ');
+            begin(DocumentElement::ListItem, depth / 2, lineStart, lineEnd - lineStart);
+        } else if (open) {
+            // Lazy continuation of the open paragraph or list item
+            current.length = lineEnd - current.offset;
+        } else {
+            begin(DocumentElement::Paragraph, 0, lineStart, lineEnd - lineStart);
+        }
+        
+        if (lineEnd == textLength) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+    }
+    
+    flush();
+    return structure;
+}
+
+QVector<DiffSection> DocumentParser::buildSections(const DocumentStructure &structure)
+{
+    QVector<DiffSection> sections;
+    DiffSection current;
+    bool started = false;
+    
+    for (const DocumentElement &element : structure.elements) {
+        DiffBlock block(element.kind(), element.offset, element.length);
+        
+        if (element.type == DocumentElement::Heading) {
+            if (started) {
+                sections.append(current);
+            }
+            current = DiffSection();
+            current.heading = block;
+            current.start = element.offset;
+            started = true;
+        } else {
+            if (!started) {
+                // Preamble before the first heading
+                current.heading = DiffBlock(0, element.offset, 0);
+                current.start = element.offset;
+                started = true;
+            }
+            current.blocks.append(block);
+        }
+        
+        current.length = element.offset + element.length - current.start;
+    }
+    
+    if (started) {
+        sections.append(current);
+    }
+    
+    return sections;
+}
+
+QString DocumentParser::formatStructure(const DocumentStructure &structure, QVector<DiffBlock> *blocks)
+{
+    TraceScope trace("formatStructure");
+    trace.arg("elements", structure.elements.size());
     QString result;
+    bool inTable = false;
     
     for (const DocumentElement &element : structure.elements) {
+        // Close the current table row before a new row or a non-cell element
+        if (inTable && (element.type != DocumentElement::TableCell || element.level == 0)) {
+            result += "|\n";
+            if (element.type != DocumentElement::TableCell) {
+                result += "\n";
+            }
+        }
+        inTable = element.type == DocumentElement::TableCell;
+        
+        int start = result.length();
+        
         switch (element.type) {
         case DocumentElement::Heading:
-            result += QString("#").repeated(element.level) + " " + element.content + "\n\n";
+            result += QString("#").repeated(element.level) + " " + element.content;
             break;
         case DocumentElement::ListItem:
-            result += QString("  ").repeated(element.level) + "* " + element.content + "\n";
+            result += QString("  ").repeated(element.level) + "* " + element.content;
             break;
         case DocumentElement::TableCell:
             result += "| " + element.content + " ";
             break;
+        case DocumentElement::TableRow:
+        case DocumentElement::CodeBlock:
         case DocumentElement::Paragraph:
         case DocumentElement::Text:
         default:
-            result += element.content + "\n\n";
+            result += element.content;
+            break;
+        }
+        
+        if (blocks) {
+            blocks->append(DiffBlock(element.kind(), start, result.length() - start));
+        }
+        
+        switch (element.type) {
+        case DocumentElement::ListItem:
+        case DocumentElement::TableRow:
+            result += "\n";
+            break;
+        case DocumentElement::TableCell:
+            break;
+        default:
+            result += "\n\n";
             break;
         }
     }
     
+    if (inTable) {
+        result += "|\n";
+    }
+    
     return result;
 }
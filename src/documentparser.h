@@ -4,6 +4,9 @@
 #include <QObject>
 #include <QString>
 #include <QVector>
+#include "diffengine.h"
+
+class QIODevice;
 
 struct DocumentElement {
     enum Type {
@@ -11,14 +14,25 @@ struct DocumentElement {
         Paragraph,
         ListItem,
         TableCell,
-        Text
+        Text,
+        CodeBlock,
+        TableRow
     };
     
     Type type;
-    int level;  // For headings, list depth
+    int level;  // For headings, list depth, table column
     QString content;
     
-    DocumentElement() : type(Text), level(0) {}
+    // Range in the source text, for formats shown as written (Markdown)
+    int offset;
+    int length;
+    
+    DocumentElement() : type(Text), level(0), offset(0), length(0) {}
+    
+    // Elements only match elements of the same type and level. The level
+    // gets the low 24 bits; deeper levels, which no real document has,
+    // share the largest one.
+    int kind() const { return (type << 24) | qBound(0, level, 0xFFFFFF); }
 };
 
 struct DocumentStructure {
@@ -36,13 +50,17 @@ public:
     // Parse different document formats
     QString parsePdf(const QString &filePath);
     DocumentStructure parseDocx(const QString &filePath);
+    DocumentStructure parseMarkdown(const QString &text);
+    
+    // Group elements with source ranges into heading-led sections
+    QVector<DiffSection> buildSections(const DocumentStructure &structure);
     
-    // Format structured document as text
-    QString formatStructure(const DocumentStructure &structure);
+    // Format structured document as text, optionally reporting the
+    // character range each element occupies in the result
+    QString formatStructure(const DocumentStructure &structure, QVector<DiffBlock> *blocks = nullptr);
 
 private:
-    QString extractTextFromZip(const QString &filePath, const QString &entryName);
-    DocumentStructure parseDocxXml(const QString &xmlContent);
+    DocumentStructure parseDocxXml(QIODevice *xmlDevice);
 };
 
 #endif // DOCUMENTPARSER_H
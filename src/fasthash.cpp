@@ -0,0 +1,139 @@
+#include "fasthash.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const quint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+const quint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const quint64 kPrime3 = 0x165667B19E3779F9ULL;
+const quint64 kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const quint64 kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 read64(const unsigned char *p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+inline quint32 read32(const unsigned char *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+inline quint64 accumulate(quint64 acc, quint64 input)
+{
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= accumulate(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+FastHash::FastHash(quint64 seed)
+{
+    reset(seed);
+}
+
+void FastHash::reset(quint64 seed)
+{
+    this->seed = seed;
+    acc[0] = seed + kPrime1 + kPrime2;
+    acc[1] = seed + kPrime2;
+    acc[2] = seed;
+    acc[3] = seed - kPrime1;
+    totalLength = 0;
+    bufferSize = 0;
+}
+
+void FastHash::addData(const char *data, qint64 length)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + length;
+    totalLength += quint64(length);
+
+    // Top up a partial stripe left over from the previous call
+    if (bufferSize > 0) {
+        int take = int(qMin<qint64>(32 - bufferSize, end - p));
+        std::memcpy(buffer + bufferSize, p, size_t(take));
+        bufferSize += take;
+        p += take;
+        if (bufferSize < 32) {
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            acc[i] = accumulate(acc[i], read64(buffer + 8 * i));
+        }
+        bufferSize = 0;
+    }
+
+    // Whole 32-byte stripes straight from the input
+    while (end - p >= 32) {
+        for (int i = 0; i < 4; ++i) {
+            acc[i] = accumulate(acc[i], read64(p + 8 * i));
+        }
+        p += 32;
+    }
+
+    if (p < end) {
+        bufferSize = int(end - p);
+        std::memcpy(buffer, p, size_t(bufferSize));
+    }
+}
+
+quint64 FastHash::digest() const
+{
+    quint64 h;
+    if (totalLength >= 32) {
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = mergeRound(h, acc[i]);
+        }
+    } else {
+        h = seed + kPrime5;
+    }
+    h += totalLength;
+
+    const unsigned char *p = buffer;
+    const unsigned char *end = buffer + bufferSize;
+    while (end - p >= 8) {
+        h ^= accumulate(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= quint64(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= quint64(*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++p;
+    }
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 FastHash::hash(const char *data, qint64 length, quint64 seed)
+{
+    FastHash hasher(seed);
+    hasher.addData(data, length);
+    return hasher.digest();
+}
@@ -0,0 +1,28 @@
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <QtGlobal>
+
+// Streaming XXH64: a fast non-cryptographic 64-bit hash for content
+// fingerprints. Feed data in any number of pieces; digest() does not
+// consume the state.
+class FastHash
+{
+public:
+    explicit FastHash(quint64 seed = 0);
+
+    void reset(quint64 seed = 0);
+    void addData(const char *data, qint64 length);
+    quint64 digest() const;
+
+    static quint64 hash(const char *data, qint64 length, quint64 seed = 0);
+
+private:
+    quint64 seed;
+    quint64 acc[4];
+    quint64 totalLength;
+    unsigned char buffer[32];
+    int bufferSize;
+};
+
+#endif // FASTHASH_H
@@ -0,0 +1,127 @@
+#include "filecomparator.h"
+#include "fasthash.h"
+#include <QFile>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace {
+
+bool openSequential(QFile &file)
+{
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    // Larger kernel read-ahead for a front-to-back scan
+    ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+// Fill the buffer unless the file ends first; -1 on read errors
+qint64 readChunk(QFile &file, char *buffer, qint64 capacity)
+{
+    qint64 total = 0;
+    while (total < capacity) {
+        qint64 n = file.read(buffer + total, capacity - total);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+} // namespace
+
+FileCompareResult FileComparator::compare(const QString &path1, const QString &path2, Mode mode)
+{
+    FileCompareResult result;
+
+    QFile file1(path1), file2(path2);
+    if (!openSequential(file1) || !openSequential(file2)) {
+        result.error = true;
+        return result;
+    }
+
+    bool same = file1.size() == file2.size();
+    if (!same && mode != ComputeHashes) {
+        return result;
+    }
+
+    QByteArray buffer1, buffer2;
+    buffer1.resize(kChunkSize);
+    buffer2.resize(kChunkSize);
+    FastHash hash1, hash2;
+
+    while (true) {
+        qint64 n1 = readChunk(file1, buffer1.data(), kChunkSize);
+        qint64 n2 = readChunk(file2, buffer2.data(), kChunkSize);
+        if (n1 < 0 || n2 < 0) {
+            result.error = true;
+            return result;
+        }
+
+        if (same && (n1 != n2 || std::memcmp(buffer1.constData(), buffer2.constData(), size_t(n1)) != 0)) {
+            same = false;
+            if (mode != ComputeHashes) {
+                break;
+            }
+        }
+
+        if (mode == ComputeHashes) {
+            hash1.addData(buffer1.constData(), n1);
+            hash2.addData(buffer2.constData(), n2);
+        } else if (mode == HashIdentical) {
+            // Equal so far, so one hash covers both files
+            hash1.addData(buffer1.constData(), n1);
+        }
+
+        if (n1 == 0 && n2 == 0) {
+            break;
+        }
+    }
+
+    result.identical = same;
+    if (mode == ComputeHashes) {
+        result.hashed = true;
+        result.hash1 = hash1.digest();
+        result.hash2 = hash2.digest();
+    } else if (mode == HashIdentical && same) {
+        result.hashed = true;
+        result.hash1 = hash1.digest();
+        result.hash2 = result.hash1;
+    }
+    return result;
+}
+
+quint64 FileComparator::hashFile(const QString &path, bool *ok)
+{
+    QFile file(path);
+    if (!openSequential(file)) {
+        if (ok) {
+            *ok = false;
+        }
+        return 0;
+    }
+
+    QByteArray buffer;
+    buffer.resize(kChunkSize);
+    FastHash hash;
+
+    qint64 n;
+    while ((n = readChunk(file, buffer.data(), kChunkSize)) > 0) {
+        hash.addData(buffer.constData(), n);
+    }
+
+    if (ok) {
+        *ok = n == 0;
+    }
+    return hash.digest();
+}
@@ -0,0 +1,34 @@
+#ifndef FILECOMPARATOR_H
+#define FILECOMPARATOR_H
+
+#include <QString>
+
+struct FileCompareResult {
+    bool identical;
+    bool error;     // One of the files could not be read
+    bool hashed;    // hash1/hash2 cover both files completely
+    quint64 hash1;
+    quint64 hash2;
+
+    FileCompareResult() : identical(false), error(false), hashed(false), hash1(0), hash2(0) {}
+};
+
+// Content equality for file pairs with bounded memory: both files are read
+// in fixed-size chunks and compared chunk by chunk, so memory use does not
+// depend on file size and a difference stops the comparison early.
+class FileComparator
+{
+public:
+    enum Mode {
+        EarlyExit,      // Stop at the first differing chunk
+        HashIdentical,  // Early exit, but hash the files if they turn out identical
+        ComputeHashes   // Read both files to the end and hash them in the same pass
+    };
+
+    static FileCompareResult compare(const QString &path1, const QString &path2, Mode mode = EarlyExit);
+    static quint64 hashFile(const QString &path, bool *ok = nullptr);
+
+    static const qint64 kChunkSize = 256 * 1024;
+};
+
+#endif // FILECOMPARATOR_H
@@ -0,0 +1,560 @@
+#include "foldercompareengine.h"
+#include "filecomparator.h"
+#include "tracer.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const int kFlushIntervalMs = 50;
+
+struct DirItem {
+    enum Kind { File, Dir, Other };
+
+    QByteArray name;
+    Kind kind;
+    bool symlink;
+};
+
+QString joinPath(const QString &root, const QString &relativePath)
+{
+    return relativePath.isEmpty() ? root : root + "/" + relativePath;
+}
+
+// List one directory, sorted by name. Hidden entries are skipped, as QDir
+// does by default. On Unix the entry type comes from d_type, so only
+// symlinks and filesystems without d_type cost a stat.
+QVector<DirItem> listDirectory(const QString &path)
+{
+    QVector<DirItem> items;
+
+#ifdef Q_OS_UNIX
+    DIR *dir = ::opendir(QFile::encodeName(path).constData());
+    if (!dir) {
+        return items;
+    }
+
+    while (struct dirent *ent = ::readdir(dir)) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        DirItem item;
+        item.name = QByteArray(ent->d_name);
+        item.symlink = false;
+
+        switch (ent->d_type) {
+        case DT_DIR:
+            item.kind = DirItem::Dir;
+            break;
+        case DT_REG:
+            item.kind = DirItem::File;
+            break;
+        case DT_LNK:
+        case DT_UNKNOWN: {
+            // Follow links like QFileInfo does
+            item.symlink = ent->d_type == DT_LNK;
+            struct stat st;
+            if (::fstatat(::dirfd(dir), ent->d_name, &st, 0) != 0) {
+                item.kind = DirItem::Other;
+            } else if (S_ISDIR(st.st_mode)) {
+                item.kind = DirItem::Dir;
+            } else if (S_ISREG(st.st_mode)) {
+                item.kind = DirItem::File;
+            } else {
+                item.kind = DirItem::Other;
+            }
+            break;
+        }
+        default:
+            item.kind = DirItem::Other;
+            break;
+        }
+
+        if (item.kind != DirItem::Other) {
+            items.append(item);
+        }
+    }
+    ::closedir(dir);
+#else
+    const QFileInfoList infos = QDir(path).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QFileInfo &info : infos) {
+        DirItem item;
+        item.name = QFile::encodeName(info.fileName());
+        item.kind = info.isDir() ? DirItem::Dir : DirItem::File;
+        item.symlink = info.isSymLink();
+        items.append(item);
+    }
+#endif
+
+    std::sort(items.begin(), items.end(), [](const DirItem &a, const DirItem &b) {
+        return a.name < b.name;
+    });
+    return items;
+}
+
+} // namespace
+
+FolderCompareEngine::FolderCompareEngine(QObject *parent)
+    : QObject(parent)
+    , running(false)
+    , incremental(false)
+    , renameStage(RenamesIdle)
+    , renameThreshold(60)
+    , useGitignore(true)
+    , cancelled(false)
+    , pendingTasks(0)
+{
+    pool = new QThreadPool(this);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(kFlushIntervalMs);
+    connect(flushTimer, &QTimer::timeout, this, &FolderCompareEngine::flushResults);
+}
+
+FolderCompareEngine::~FolderCompareEngine()
+{
+    // Tasks hold a pointer to this engine
+    cancelled = true;
+    pool->clear();
+    pool->waitForDone();
+}
+
+void FolderCompareEngine::start(const QString &root1, const QString &root2)
+{
+    cancel();
+    // A manifest from the previous run may still be saving
+    pool->waitForDone();
+
+    this->root1 = root1;
+    this->root2 = root2;
+    manifest1.reset(new FolderManifest(root1));
+    manifest2.reset(new FolderManifest(root2));
+    knownSubdirectories.clear();
+    ignoreScopes.clear();
+    IgnoreMatcher::Ptr userRules = IgnoreMatcher::create(ignoreRules);
+    ignoreScopes.insert(QString(), { userRules, userRules });
+    deletedCandidates.clear();
+    addedCandidates.clear();
+    renameStage = RenamesIdle;
+    cancelled = false;
+    pendingTasks = 0;
+    running = true;
+    incremental = false;
+
+    submit([this]() {
+        manifest1->load();
+        manifest2->load();
+        scanDirectory(QString());
+    });
+    flushTimer->start();
+}
+
+void FolderCompareEngine::rescan(const QStringList &relativePaths)
+{
+    if (root1.isEmpty()) {
+        return;
+    }
+    if (running) {
+        queuedRescans += relativePaths;
+        return;
+    }
+
+    // A manifest may still be saving
+    pool->waitForDone();
+
+    cancelled = false;
+    pendingTasks = 0;
+    running = true;
+    incremental = true;
+
+    for (const QString &relativePath : relativePaths) {
+        submit([this, relativePath]() { scanDirectory(relativePath); });
+    }
+    flushTimer->start();
+}
+
+void FolderCompareEngine::cancel()
+{
+    queuedRescans.clear();
+    if (!running) {
+        return;
+    }
+
+    cancelled = true;
+    pool->clear();
+    pool->waitForDone();
+
+    flushTimer->stop();
+    pendingTasks = 0;
+    running = false;
+
+    {
+        QMutexLocker locker(&resultMutex);
+        foundEntries.clear();
+        comparedEntries.clear();
+        emptiedDirectories.clear();
+        detectedRenames.clear();
+        deletedCandidates.clear();
+        addedCandidates.clear();
+    }
+
+    emit finished(true);
+}
+
+void FolderCompareEngine::submit(std::function<void()> task)
+{
+    if (cancelled) {
+        return;
+    }
+
+    // Children are submitted before their parent task finishes, so the
+    // counter only reaches zero once the whole tree has been processed
+    ++pendingTasks;
+    pool->start([this, task]() {
+        if (!cancelled) {
+            task();
+        }
+        --pendingTasks;
+    });
+}
+
+void FolderCompareEngine::flushResults()
+{
+    // Sample completion before draining: everything a finished task
+    // produced is queued by the time the counter drops
+    bool done = pendingTasks == 0;
+
+    QVector<FolderEntry> found;
+    QVector<FolderEntry> compared;
+    QStringList emptied;
+    QVector<FolderRename> renames;
+    {
+        QMutexLocker locker(&resultMutex);
+        found.swap(foundEntries);
+        compared.swap(comparedEntries);
+        emptied.swap(emptiedDirectories);
+        renames.swap(detectedRenames);
+    }
+
+    if (!emptied.isEmpty()) {
+        emit directoriesEmptied(emptied);
+    }
+    // Found entries first: a pending file must exist before its result
+    if (!found.isEmpty()) {
+        emit entriesFound(found);
+    }
+    if (!compared.isEmpty()) {
+        emit entriesCompared(compared);
+    }
+    if (!renames.isEmpty()) {
+        emit renamesDetected(renames);
+    }
+
+    // Rename detection needs the complete listing, so it runs as further
+    // stages once the scan is done
+    while (done && !incremental && renameStage != RenamesDone) {
+        if (advanceRenameDetection()) {
+            return;
+        }
+    }
+
+    if (done) {
+        flushTimer->stop();
+        running = false;
+
+        QStringList rescans;
+        rescans.swap(queuedRescans);
+
+        if (rescans.isEmpty()) {
+            // Written off the GUI thread; not counted as a task, start(),
+            // rescan() and the destructor wait for it
+            pool->start([this]() {
+                manifest1->save();
+                manifest2->save();
+            });
+        }
+
+        emit finished(false);
+
+        if (!rescans.isEmpty()) {
+            rescans.removeDuplicates();
+            rescan(rescans);
+        }
+    }
+}
+
+void FolderCompareEngine::scanDirectory(const QString &relativePath)
+{
+    TraceScope trace("scanDirectory");
+    const QString path1 = joinPath(root1, relativePath);
+    const QString path2 = joinPath(root2, relativePath);
+    const QVector<DirItem> list1 = listDirectory(path1);
+    const QVector<DirItem> list2 = listDirectory(path2);
+
+    // listDirectory() skips hidden files, so .gitignore is opened directly
+    const QByteArray directory = QFile::encodeName(relativePath);
+    IgnoreScope scope;
+    {
+        QMutexLocker locker(&directoryMutex);
+        scope = ignoreScopes.value(relativePath);
+    }
+    if (useGitignore) {
+        scope.side1 = IgnoreMatcher::withGitignore(scope.side1, path1, directory);
+        scope.side2 = IgnoreMatcher::withGitignore(scope.side2, path2, directory);
+    }
+    auto ignored = [&](const DirItem &item) {
+        bool isDirectory = item.kind == DirItem::Dir;
+        return (scope.side1 && scope.side1->isIgnored(directory, item.name, isDirectory))
+            || (scope.side2 && scope.side2->isIgnored(directory, item.name, isDirectory));
+    };
+
+    QVector<FolderEntry> batch;
+    batch.reserve(qMax(list1.size(), list2.size()));
+    QStringList subdirectories;
+    QVector<PendingPair> sameSize;
+    QVector<RenameCandidate> deletedFiles;
+    QVector<RenameCandidate> addedFiles;
+
+    // Merge the two sorted listings
+    int i = 0, j = 0;
+    while (i < list1.size() || j < list2.size()) {
+        int order;
+        if (i == list1.size()) {
+            order = 1;
+        } else if (j == list2.size()) {
+            order = -1;
+        } else {
+            order = qstrcmp(list1[i].name, list2[j].name);
+        }
+
+        // An entry either tree ignores is left out on both sides
+        if (order <= 0 && ignored(list1[i])) {
+            ++i;
+            j += order == 0 ? 1 : 0;
+            continue;
+        }
+        if (order >= 0 && ignored(list2[j])) {
+            ++j;
+            i += order == 0 ? 1 : 0;
+            continue;
+        }
+
+        const DirItem &item = order > 0 ? list2[j] : list1[i];
+        FolderEntry entry;
+        entry.name = QFile::decodeName(item.name);
+        entry.relativePath = relativePath.isEmpty() ? entry.name : relativePath + "/" + entry.name;
+
+        if (order != 0) {
+            if (order < 0) {
+                entry.status = FolderEntry::Deleted;
+                ++i;
+            } else {
+                entry.status = FolderEntry::Added;
+                ++j;
+            }
+
+            // One-sided directories are listed as well, so their files can
+            // be browsed and take part in rename detection
+            if (item.kind == DirItem::Dir) {
+                entry.directory = true;
+                if (!item.symlink) {
+                    subdirectories.append(entry.relativePath);
+                }
+            } else if (!incremental && renameThreshold > 0) {
+                RenameCandidate candidate;
+                candidate.relativePath = entry.relativePath;
+                if (order < 0) {
+                    candidate.size = FileMeta::read(joinPath(root1, entry.relativePath)).size;
+                    deletedFiles.append(candidate);
+                } else {
+                    candidate.size = FileMeta::read(joinPath(root2, entry.relativePath)).size;
+                    addedFiles.append(candidate);
+                }
+            }
+        } else {
+            const DirItem &item1 = list1[i++];
+            const DirItem &item2 = list2[j++];
+
+            if (item1.kind == DirItem::Dir && item2.kind == DirItem::Dir) {
+                entry.status = FolderEntry::Directory;
+                entry.directory = true;
+                // Linked directories are shown but not entered, which
+                // keeps symlink cycles from recursing forever
+                if (!item1.symlink && !item2.symlink) {
+                    subdirectories.append(entry.relativePath);
+                }
+            } else if (item1.kind == DirItem::File && item2.kind == DirItem::File) {
+                PendingPair pair;
+                pair.meta1 = FileMeta::read(joinPath(root1, entry.relativePath));
+                pair.meta2 = FileMeta::read(joinPath(root2, entry.relativePath));
+                quint64 hash1, hash2;
+                if (pair.meta1.size < 0 || pair.meta1.size != pair.meta2.size) {
+                    entry.status = FolderEntry::Modified;
+                } else if (manifest1->lookup(entry.relativePath, pair.meta1, &hash1)
+                           && manifest2->lookup(entry.relativePath, pair.meta2, &hash2)) {
+                    // Both sides unchanged since they were last hashed
+                    entry.status = hash1 == hash2 ? FolderEntry::Identical : FolderEntry::Modified;
+                    manifest1->record(entry.relativePath, pair.meta1, hash1);
+                    manifest2->record(entry.relativePath, pair.meta2, hash2);
+                } else {
+                    entry.status = FolderEntry::Pending;
+                    pair.entry = entry;
+                    sameSize.append(pair);
+                }
+            } else {
+                entry.status = FolderEntry::TypeMismatch;
+            }
+        }
+
+        batch.append(entry);
+    }
+
+    trace.arg("entries", batch.size());
+    trace.arg("sameSize", sameSize.size());
+
+    // Only subdirectories that were not listed before need a full scan;
+    // the others are rescanned on their own when they change
+    QStringList newSubdirectories;
+    {
+        QMutexLocker locker(&directoryMutex);
+        const QStringList previous = knownSubdirectories.value(relativePath);
+        const QSet<QString> previousSet(previous.begin(), previous.end());
+        const QSet<QString> currentSet(subdirectories.begin(), subdirectories.end());
+
+        for (const QString &subdirectory : subdirectories) {
+            if (!previousSet.contains(subdirectory)) {
+                newSubdirectories.append(subdirectory);
+            }
+        }
+        for (const QString &subdirectory : previous) {
+            if (!currentSet.contains(subdirectory)) {
+                forgetDirectory(subdirectory);
+            }
+        }
+        knownSubdirectories.insert(relativePath, subdirectories);
+        for (const QString &subdirectory : subdirectories) {
+            ignoreScopes.insert(subdirectory, scope);
+        }
+    }
+
+    {
+        QMutexLocker locker(&resultMutex);
+        foundEntries += batch;
+        if (incremental && batch.isEmpty()) {
+            emptiedDirectories.append(relativePath);
+        }
+        deletedCandidates += deletedFiles;
+        addedCandidates += addedFiles;
+    }
+
+    for (const QString &subdirectory : newSubdirectories) {
+        submit([this, subdirectory]() { scanDirectory(subdirectory); });
+    }
+    for (const PendingPair &pair : sameSize) {
+        submit([this, pair]() { compareFiles(pair); });
+    }
+}
+
+void FolderCompareEngine::forgetDirectory(const QString &relativePath)
+{
+    // Called with directoryMutex held
+    const QStringList subdirectories = knownSubdirectories.take(relativePath);
+    ignoreScopes.remove(relativePath);
+    for (const QString &subdirectory : subdirectories) {
+        forgetDirectory(subdirectory);
+    }
+}
+
+bool FolderCompareEngine::advanceRenameDetection()
+{
+    // Returns whether tasks were submitted for the next stage
+    if (renameStage == RenamesIdle) {
+        renameStage = RenamesFingerprinting;
+        if (renameThreshold <= 0 || deletedCandidates.isEmpty() || addedCandidates.isEmpty()) {
+            renameStage = RenamesDone;
+            return false;
+        }
+
+        // Exact renames need equal sizes, so a file too large to sketch is
+        // only read if the other side has a file of the same size
+        QSet<qint64> deletedSizes, addedSizes;
+        for (const RenameCandidate &candidate : deletedCandidates) {
+            deletedSizes.insert(candidate.size);
+        }
+        for (const RenameCandidate &candidate : addedCandidates) {
+            addedSizes.insert(candidate.size);
+        }
+
+        bool sketches = renameThreshold < 100;
+        auto fingerprintAll = [&](QVector<RenameCandidate> &candidates, const QString &root,
+                                  const QSet<qint64> &otherSizes) {
+            RenameCandidate *data = candidates.data();
+            for (int i = 0; i < candidates.size(); ++i) {
+                bool sketch = sketches && data[i].size <= RenameDetector::kMaxSketchBytes;
+                if (!sketch && !otherSizes.contains(data[i].size)) {
+                    continue;
+                }
+                RenameCandidate *candidate = data + i;
+                QString path = joinPath(root, candidate->relativePath);
+                submit([candidate, path, sketch]() {
+                    RenameDetector::fingerprint(path, candidate, sketch);
+                });
+            }
+        };
+        fingerprintAll(deletedCandidates, root1, addedSizes);
+        fingerprintAll(addedCandidates, root2, deletedSizes);
+        return pendingTasks > 0;
+    }
+
+    if (renameStage == RenamesFingerprinting) {
+        renameStage = RenamesPairing;
+        submit([this]() {
+            QVector<FolderRename> renames = RenameDetector::pair(deletedCandidates, addedCandidates,
+                                                                 renameThreshold);
+            QMutexLocker locker(&resultMutex);
+            detectedRenames += renames;
+        });
+        return true;
+    }
+
+    renameStage = RenamesDone;
+    deletedCandidates.clear();
+    addedCandidates.clear();
+    return false;
+}
+
+void FolderCompareEngine::compareFiles(const PendingPair &pair)
+{
+    TraceScope trace("compareFiles");
+    trace.arg("bytes", pair.meta1.size);
+    FolderEntry entry = pair.entry;
+    // Identical files are read to the end anyway, so hashing them for the
+    // manifests is nearly free; differing files still stop at the first
+    // difference. Racy files would not be recorded and are not hashed.
+    const bool recordable = !pair.meta1.isRacy() && !pair.meta2.isRacy();
+    FileCompareResult result = FileComparator::compare(joinPath(root1, entry.relativePath),
+                                                       joinPath(root2, entry.relativePath),
+                                                       recordable ? FileComparator::HashIdentical
+                                                                  : FileComparator::EarlyExit);
+    entry.status = result.identical ? FolderEntry::Identical : FolderEntry::Modified;
+    if (result.hashed) {
+        manifest1->record(entry.relativePath, pair.meta1, result.hash1);
+        manifest2->record(entry.relativePath, pair.meta2, result.hash2);
+    }
+
+    QMutexLocker locker(&resultMutex);
+    comparedEntries.append(entry);
+}
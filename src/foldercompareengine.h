@@ -0,0 +1,150 @@
+#ifndef FOLDERCOMPAREENGINE_H
+#define FOLDERCOMPAREENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QHash>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "foldermanifest.h"
+#include "ignorematcher.h"
+#include "renamedetector.h"
+
+class QThreadPool;
+class QTimer;
+
+struct FolderEntry {
+    enum Status {
+        Directory,
+        Identical,
+        Modified,
+        Added,
+        Deleted,
+        TypeMismatch,
+        Pending     // Same size on both sides, contents not compared yet
+    };
+
+    QString relativePath;  // '/'-separated, relative to both roots
+    QString name;
+    Status status;
+    bool directory;        // Also set for directories present on one side only
+
+    FolderEntry() : status(Pending), directory(false) {}
+};
+
+// Compares two directory trees off the GUI thread. Directory pairs are listed
+// concurrently on a thread pool and same-size file pairs are compared as
+// separate tasks on the same pool. Results are batched and delivered on the
+// engine's thread, parents always before their children. Content hashes are
+// kept in a FolderManifest per root, so pairs whose metadata did not change
+// since the last comparison are classified without reading them.
+//
+// After a comparison has finished, rescan() re-lists individual directories
+// and reports their entries again through the same signals. Only
+// subdirectories that were not there before are descended into.
+//
+// Once a full comparison has listed everything, files found on one side
+// only are fingerprinted and paired by RenameDetector before finished().
+//
+// Entries matched by the user's ignore rules or, optionally, by the
+// .gitignore files of either tree are left out before anything is compared
+// or descended into.
+class FolderCompareEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderCompareEngine(QObject *parent = nullptr);
+    ~FolderCompareEngine();
+
+    void start(const QString &root1, const QString &root2);
+    bool isRunning() const { return running; }
+
+    // Minimum similarity in percent for pairing edited renames; 100 pairs
+    // identical files only, 0 turns rename detection off
+    void setRenameThreshold(int percent) { renameThreshold = percent; }
+    int renameThresholdPercent() const { return renameThreshold; }
+
+    // gitignore syntax, relative to both roots; applied from the next start()
+    void setIgnoreRules(const QStringList &rules) { ignoreRules = rules; }
+    QStringList ignoreRulesList() const { return ignoreRules; }
+    void setUseGitignore(bool use) { useGitignore = use; }
+    bool usesGitignore() const { return useGitignore; }
+
+public slots:
+    // Stops scheduling work and waits for running tasks to return
+    void cancel();
+    // Re-evaluates the given directories; queued while a comparison runs
+    void rescan(const QStringList &relativePaths);
+
+signals:
+    void entriesFound(const QVector<FolderEntry> &entries);
+    // Rescanned directories that no longer contain anything
+    void directoriesEmptied(const QStringList &relativePaths);
+    void entriesCompared(const QVector<FolderEntry> &entries);
+    void renamesDetected(const QVector<FolderRename> &renames);
+    void finished(bool cancelled);
+
+private slots:
+    void flushResults();
+
+private:
+    // Ignore rules in effect for a directory on each side
+    struct IgnoreScope {
+        IgnoreMatcher::Ptr side1;
+        IgnoreMatcher::Ptr side2;
+    };
+
+    struct PendingPair {
+        FolderEntry entry;
+        FileMeta meta1;
+        FileMeta meta2;
+    };
+
+    void scanDirectory(const QString &relativePath);
+    void compareFiles(const PendingPair &pair);
+    void forgetDirectory(const QString &relativePath);
+    bool advanceRenameDetection();
+    void submit(std::function<void()> task);
+
+    QThreadPool *pool;
+    QTimer *flushTimer;
+
+    QString root1;
+    QString root2;
+    std::unique_ptr<FolderManifest> manifest1;
+    std::unique_ptr<FolderManifest> manifest2;
+    bool running;
+    bool incremental;
+    QStringList queuedRescans;
+
+    enum RenameStage { RenamesIdle, RenamesFingerprinting, RenamesPairing, RenamesDone };
+    RenameStage renameStage;
+    int renameThreshold;
+    QStringList ignoreRules;
+    bool useGitignore;
+    std::atomic<bool> cancelled;
+    std::atomic<int> pendingTasks;
+
+    // Filled by pool threads, drained by flushResults()
+    QMutex resultMutex;
+    QVector<FolderEntry> foundEntries;
+    QVector<FolderEntry> comparedEntries;
+    QStringList emptiedDirectories;
+    QVector<FolderRename> detectedRenames;
+    // Files on one side only; filled during the scan, fingerprinted in place
+    QVector<RenameCandidate> deletedCandidates;
+    QVector<RenameCandidate> addedCandidates;
+
+    // Subdirectories each scanned directory had when it was last listed
+    QMutex directoryMutex;
+    QHash<QString, QStringList> knownSubdirectories;
+    // Rules inherited by each directory from its ancestors, for rescans
+    QHash<QString, IgnoreScope> ignoreScopes;
+};
+
+#endif // FOLDERCOMPAREENGINE_H
@@ -0,0 +1,163 @@
+#include "foldermanifest.h"
+#include "fasthash.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const quint32 kManifestMagic = 0x44594d46;   // "DYMF"
+const quint32 kManifestVersion = 1;
+
+// Files modified this recently may change again within the same timestamp
+// tick, so their hashes are not trusted next time
+const qint64 kRacyWindowNs = 2000000000LL;
+
+} // namespace
+
+FileMeta FileMeta::read(const QString &path)
+{
+    FileMeta meta;
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return meta;
+    }
+    meta.size = st.st_size;
+#ifdef Q_OS_DARWIN
+    meta.mtime = qint64(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    meta.mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    meta.inode = st.st_ino;
+#else
+    QFileInfo info(path);
+    if (info.exists()) {
+        meta.size = info.size();
+        meta.mtime = info.lastModified().toMSecsSinceEpoch() * 1000000;
+    }
+#endif
+    return meta;
+}
+
+bool FileMeta::isRacy() const
+{
+    return mtime > QDateTime::currentMSecsSinceEpoch() * 1000000 - kRacyWindowNs;
+}
+
+FolderManifest::FolderManifest(const QString &rootPath)
+    : rootPath(rootPath)
+{
+}
+
+QString FolderManifest::manifestPath(const QString &rootPath)
+{
+    QByteArray key = QDir(rootPath).absolutePath().toUtf8();
+    quint64 id = FastHash::hash(key.constData(), key.size());
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+         + QString("/manifests/%1.manifest").arg(id, 16, 16, QChar('0'));
+}
+
+bool FolderManifest::load()
+{
+    previous.clear();
+
+    QFile file(manifestPath(rootPath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic, version;
+    QString storedRoot;
+    quint32 count;
+    in >> magic >> version >> storedRoot >> count;
+    // Different absolute paths can share a file name only on a hash collision
+    if (in.status() != QDataStream::Ok || magic != kManifestMagic
+        || version != kManifestVersion || storedRoot != QDir(rootPath).absolutePath()) {
+        return false;
+    }
+
+    previous.reserve(int(count));
+    for (quint32 i = 0; i < count; ++i) {
+        QString relativePath;
+        Record record;
+        in >> relativePath >> record.meta.size >> record.meta.mtime >> record.meta.inode >> record.hash;
+        if (in.status() != QDataStream::Ok) {
+            previous.clear();
+            return false;
+        }
+        previous.insert(relativePath, record);
+    }
+    return true;
+}
+
+bool FolderManifest::save()
+{
+    QString path = manifestPath(rootPath);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+
+    QMutexLocker locker(&mutex);
+    out << kManifestMagic << kManifestVersion << QDir(rootPath).absolutePath() << quint32(current.size());
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        const Record &record = it.value();
+        out << it.key() << record.meta.size << record.meta.mtime << record.meta.inode << record.hash;
+    }
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        return false;
+    }
+
+    // Later incremental scans look up what was just saved
+    previous = current;
+    return true;
+}
+
+bool FolderManifest::lookup(const QString &relativePath, const FileMeta &meta, quint64 *hash) const
+{
+    auto it = previous.constFind(relativePath);
+    if (it == previous.constEnd()) {
+        return false;
+    }
+
+    const FileMeta &known = it.value().meta;
+    if (known.size != meta.size || known.mtime != meta.mtime || known.inode != meta.inode) {
+        return false;
+    }
+
+    *hash = it.value().hash;
+    return true;
+}
+
+void FolderManifest::record(const QString &relativePath, const FileMeta &meta, quint64 hash)
+{
+    if (meta.isRacy()) {
+        return;
+    }
+
+    Record record;
+    record.meta = meta;
+    record.hash = hash;
+
+    QMutexLocker locker(&mutex);
+    current.insert(relativePath, record);
+}
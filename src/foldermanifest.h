@@ -0,0 +1,57 @@
+#ifndef FOLDERMANIFEST_H
+#define FOLDERMANIFEST_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// File metadata used to decide whether a recorded hash is still valid
+struct FileMeta {
+    qint64 size;
+    qint64 mtime;       // Nanoseconds since the epoch
+    quint64 inode;      // 0 where the platform has none
+
+    FileMeta() : size(-1), mtime(0), inode(0) {}
+
+    // size is -1 if the file cannot be stat'ed
+    static FileMeta read(const QString &path);
+    // Modified so recently that the file may change again within the same
+    // timestamp tick; a hash of it must not be trusted later
+    bool isRacy() const;
+};
+
+// Persistent index of content hashes for one folder tree.
+//
+// The manifest of the previous comparison is loaded read-only; hashes
+// computed during this comparison are recorded into a new one, which
+// replaces it on save(). lookup() must not run concurrently with save().
+// An entry is reused only while size, mtime and inode are all unchanged,
+// so an unchanged tree is classified from a metadata scan alone. Manifests
+// live in the user's cache directory, never inside the compared folders.
+class FolderManifest
+{
+public:
+    explicit FolderManifest(const QString &rootPath);
+
+    bool load();
+    bool save();
+
+    // Thread-safe once load() has returned
+    bool lookup(const QString &relativePath, const FileMeta &meta, quint64 *hash) const;
+    void record(const QString &relativePath, const FileMeta &meta, quint64 hash);
+
+    static QString manifestPath(const QString &rootPath);
+
+private:
+    struct Record {
+        FileMeta meta;
+        quint64 hash;
+    };
+
+    QString rootPath;
+    QHash<QString, Record> previous;
+    QHash<QString, Record> current;
+    QMutex mutex;
+};
+
+#endif // FOLDERMANIFEST_H
@@ -0,0 +1,729 @@
+#include "foldermodel.h"
+#include <QColor>
+#include <QSet>
+
+namespace {
+
+const quint32 kRootNode = 0;
+const quint32 kFetchBatch = 256;
+const int kColumnCount = 3;
+
+QString parentPathOf(const QString &relativePath)
+{
+    int slash = relativePath.lastIndexOf('/');
+    return slash < 0 ? QString() : relativePath.left(slash);
+}
+
+} // namespace
+
+FolderModel::FolderModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+    clear();
+}
+
+void FolderModel::setRoots(const QString &root1, const QString &root2)
+{
+    this->root1 = root1;
+    this->root2 = root2;
+}
+
+void FolderModel::clear()
+{
+    beginResetModel();
+
+    complete = false;
+    nodes.clear();
+    freeBlocks.clear();
+    names.clear();
+    nameIds.clear();
+    directoryNodes.clear();
+    pendingNodes.clear();
+    renames.clear();
+    fileStats.clear();
+    newlyModified.clear();
+
+    Node root;
+    root.parent = kRootNode;
+    root.name = internName(QString());
+    root.firstChild = 0;
+    root.childCount = 0;
+    root.fetchedCount = 0;
+    root.status = FolderEntry::Directory;
+    root.directory = true;
+    root.wanted = true;
+    nodes.append(root);
+    directoryNodes.insert(QString(), kRootNode);
+
+    endResetModel();
+}
+
+quint32 FolderModel::internName(const QString &name)
+{
+    auto it = nameIds.constFind(name);
+    if (it != nameIds.constEnd()) {
+        return it.value();
+    }
+
+    quint32 id = quint32(names.size());
+    names.append(name);
+    nameIds.insert(name, id);
+    return id;
+}
+
+void FolderModel::addEntries(const QVector<FolderEntry> &entries)
+{
+    int i = 0;
+    while (i < entries.size()) {
+        // One run per directory listing
+        QString parentPath = parentPathOf(entries[i].relativePath);
+        int end = i + 1;
+        while (end < entries.size() && parentPathOf(entries[end].relativePath) == parentPath) {
+            ++end;
+        }
+
+        auto parentIt = directoryNodes.constFind(parentPath);
+        if (parentIt != directoryNodes.constEnd()) {
+            if (nodes[parentIt.value()].childCount > 0) {
+                refreshChildren(parentIt.value(), entries, i, end);
+            } else {
+                appendChildren(parentIt.value(), entries, i, end);
+            }
+        }
+        i = end;
+    }
+}
+
+void FolderModel::appendChildren(quint32 parentId, const QVector<FolderEntry> &entries, int begin, int end,
+                                 const QHash<QString, quint32> &adoptable)
+{
+    // The new block may reuse the one the adopted directories came from
+    QHash<QString, Node> adopted;
+    for (auto it = adoptable.constBegin(); it != adoptable.constEnd(); ++it) {
+        adopted.insert(it.key(), nodes[it.value()]);
+    }
+
+    const quint32 firstChild = allocateBlock(quint32(end - begin));
+    nodes[parentId].firstChild = firstChild;
+    nodes[parentId].childCount = quint32(end - begin);
+
+    for (int i = begin; i < end; ++i) {
+        const FolderEntry &entry = entries[i];
+        quint32 id = firstChild + quint32(i - begin);
+
+        Node node;
+        node.parent = parentId;
+        node.name = internName(entry.name);
+        node.firstChild = 0;
+        node.childCount = 0;
+        node.fetchedCount = 0;
+        node.status = quint8(entry.status);
+        node.directory = entry.directory;
+        node.wanted = false;
+
+        // A directory that is still there keeps its subtree
+        auto adoptedIt = entry.directory ? adopted.constFind(entry.name) : adopted.constEnd();
+        if (adoptedIt != adopted.constEnd()) {
+            const Node &old = adoptedIt.value();
+            node.firstChild = old.firstChild;
+            node.childCount = old.childCount;
+            node.fetchedCount = old.fetchedCount;
+            node.wanted = old.wanted;
+            for (quint32 child = old.firstChild; child < old.firstChild + old.childCount; ++child) {
+                nodes[child].parent = id;
+            }
+        }
+        nodes[id] = node;
+
+        if (entry.directory) {
+            directoryNodes.insert(entry.relativePath, id);
+        } else if (entry.status == FolderEntry::Pending) {
+            pendingNodes.insert(entry.relativePath, id);
+        } else if (entry.status == FolderEntry::Modified) {
+            newlyModified.append(id);
+        }
+    }
+
+    if (nodes[parentId].wanted) {
+        fetchChildren(parentId);
+    }
+}
+
+void FolderModel::refreshChildren(quint32 parentId, const QVector<FolderEntry> &entries, int begin, int end)
+{
+    const quint32 firstChild = nodes[parentId].firstChild;
+    const quint32 childCount = nodes[parentId].childCount;
+
+    bool sameNames = childCount == quint32(end - begin);
+    for (quint32 k = 0; sameNames && k < childCount; ++k) {
+        sameNames = names[nodes[firstChild + k].name] == entries[begin + int(k)].name;
+    }
+
+    if (sameNames) {
+        // The common case, files changed in place: update statuses only
+        for (quint32 k = 0; k < childCount; ++k) {
+            const FolderEntry &entry = entries[begin + int(k)];
+            quint32 id = firstChild + k;
+            FolderEntry::Status oldStatus = FolderEntry::Status(nodes[id].status);
+            if (nodes[id].directory && !entry.directory) {
+                removeChildren(id);
+                directoryNodes.remove(entry.relativePath);
+                forgetSubtree(entry.relativePath);
+            }
+            if (entry.directory && !nodes[id].directory) {
+                directoryNodes.insert(entry.relativePath, id);
+            }
+            // Renames are only detected by full comparisons
+            if (renames.remove(id) > 0) {
+                oldStatus = FolderEntry::Pending;
+            }
+            if (entry.status == FolderEntry::Pending) {
+                pendingNodes.insert(entry.relativePath, id);
+            }
+            // Listed again because something changed; the statistics may be stale
+            if (fileStats.remove(id) > 0) {
+                emit dataChanged(indexOf(id, 2), indexOf(id, 2));
+            }
+            if (entry.status == FolderEntry::Modified && !entry.directory) {
+                newlyModified.append(id);
+            }
+
+            nodes[id].status = quint8(entry.status);
+            nodes[id].directory = entry.directory;
+            if (oldStatus != entry.status && k < nodes[parentId].fetchedCount) {
+                emit dataChanged(indexOf(id, 0), indexOf(id, 1));
+            }
+        }
+        return;
+    }
+
+    // Entries were added, removed or renamed: swap in a new child block.
+    // The old block, and the subtrees of directories that are gone, are
+    // freed for later blocks; with a watched tree that keeps changing they
+    // would otherwise pile up until the next full comparison.
+    QString parentPath = parentId == kRootNode ? QString() : relativePath(parentId);
+    QHash<QString, quint32> adoptable;
+    QSet<QString> stillDirectories;
+    for (int i = begin; i < end; ++i) {
+        if (entries[i].directory) {
+            stillDirectories.insert(entries[i].name);
+        }
+    }
+    for (quint32 id = firstChild; id < firstChild + childCount; ++id) {
+        const QString &name = names[nodes[id].name];
+        QString path = parentPath.isEmpty() ? name : parentPath + "/" + name;
+        pendingNodes.remove(path);
+        renames.remove(id);
+        fileStats.remove(id);
+        if (!nodes[id].directory) {
+            continue;
+        }
+        if (stillDirectories.contains(name)) {
+            adoptable.insert(name, id);
+        } else {
+            releaseSubtree(id);
+            directoryNodes.remove(path);
+            forgetSubtree(path);
+        }
+    }
+    freeBlocks.insert(childCount, firstChild);
+
+    if (nodes[parentId].fetchedCount > 0) {
+        beginRemoveRows(indexOf(parentId, 0), 0, int(nodes[parentId].fetchedCount - 1));
+        nodes[parentId].fetchedCount = 0;
+        endRemoveRows();
+    }
+
+    appendChildren(parentId, entries, begin, end, adoptable);
+}
+
+void FolderModel::clearDirectories(const QStringList &relativePaths)
+{
+    for (const QString &path : relativePaths) {
+        auto it = directoryNodes.constFind(path);
+        if (it != directoryNodes.constEnd()) {
+            removeChildren(it.value());
+            forgetSubtree(path);
+        }
+    }
+}
+
+void FolderModel::removeChildren(quint32 id)
+{
+    if (nodes[id].fetchedCount > 0) {
+        beginRemoveRows(indexOf(id, 0), 0, int(nodes[id].fetchedCount - 1));
+        nodes[id].fetchedCount = 0;
+        endRemoveRows();
+    }
+    releaseSubtree(id);
+    nodes[id].childCount = 0;
+}
+
+quint32 FolderModel::allocateBlock(quint32 count)
+{
+    if (count == 0) {
+        return kRootNode;
+    }
+    // Smallest free block that fits; the rest of it stays free
+    auto it = freeBlocks.lowerBound(count);
+    if (it != freeBlocks.end()) {
+        const quint32 size = it.key();
+        const quint32 first = it.value();
+        freeBlocks.erase(it);
+        if (size > count) {
+            freeBlocks.insert(size - count, first + count);
+        }
+        return first;
+    }
+
+    const quint32 first = quint32(nodes.size());
+    nodes.resize(nodes.size() + count);
+    return first;
+}
+
+void FolderModel::releaseSubtree(quint32 id)
+{
+    const quint32 firstChild = nodes[id].firstChild;
+    const quint32 childCount = nodes[id].childCount;
+    if (childCount == 0) {
+        return;
+    }
+    for (quint32 child = firstChild; child < firstChild + childCount; ++child) {
+        // Stale ids must not hand their details to the next owner
+        renames.remove(child);
+        fileStats.remove(child);
+        if (nodes[child].directory) {
+            releaseSubtree(child);
+        }
+    }
+    freeBlocks.insert(childCount, firstChild);
+}
+
+void FolderModel::forgetSubtree(const QString &relativePath)
+{
+    QString prefix = relativePath + "/";
+    for (auto it = directoryNodes.begin(); it != directoryNodes.end(); ) {
+        if (it.key().startsWith(prefix)) {
+            it = directoryNodes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = pendingNodes.begin(); it != pendingNodes.end(); ) {
+        if (it.key().startsWith(prefix)) {
+            it = pendingNodes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FolderModel::updateEntries(const QVector<FolderEntry> &entries)
+{
+    for (const FolderEntry &entry : entries) {
+        auto it = pendingNodes.find(entry.relativePath);
+        if (it == pendingNodes.end()) {
+            continue;
+        }
+
+        quint32 id = it.value();
+        pendingNodes.erase(it);
+        nodes[id].status = quint8(entry.status);
+        if (entry.status == FolderEntry::Modified) {
+            newlyModified.append(id);
+        }
+
+        // Rows the view has not fetched yet pick up the status when they are
+        quint32 parentId = nodes[id].parent;
+        if (id - nodes[parentId].firstChild < nodes[parentId].fetchedCount) {
+            QModelIndex statusIndex = indexOf(id, 1);
+            emit dataChanged(statusIndex, statusIndex);
+        }
+    }
+}
+
+QVector<quint32> FolderModel::takeNewlyModified()
+{
+    QVector<quint32> ids;
+    ids.swap(newlyModified);
+    return ids;
+}
+
+QString FolderModel::filePath(quint32 id, int side) const
+{
+    return (side == 1 ? root1 : root2) + "/" + relativePath(id);
+}
+
+quint32 FolderModel::adjacentModified(quint32 id, int direction) const
+{
+    if (id == kRootNode || id >= quint32(nodes.size())) {
+        return kRootNode;
+    }
+
+    // Unfetched children count too: the tree order does not depend on what
+    // the view has expanded
+    do {
+        id = direction > 0 ? nextInTree(id) : previousInTree(id);
+    } while (id != kRootNode && (nodes[id].directory || nodes[id].status != FolderEntry::Modified));
+    return id;
+}
+
+QVector<ChangedFile> FolderModel::changedFiles(int *identicalFiles) const
+{
+    QVector<ChangedFile> files;
+    int identical = 0;
+    for (quint32 id = nextInTree(kRootNode); id != kRootNode; id = nextInTree(id)) {
+        const Node &node = nodes[id];
+        if (node.directory) {
+            continue;
+        }
+        
+        ChangedFile file;
+        file.relativePath = relativePath(id);
+        file.status = FolderEntry::Status(node.status);
+        file.similarity = 0;
+        auto rename = renames.constFind(id);
+        if (rename != renames.constEnd()) {
+            // Reported once, from the side where the file is now
+            if (file.status == FolderEntry::Deleted) {
+                continue;
+            }
+            file.renamedFrom = rename.value().partner;
+            file.similarity = rename.value().similarity;
+            file.status = file.similarity == 100 ? FolderEntry::Identical : FolderEntry::Modified;
+            file.path1 = root1 + "/" + file.renamedFrom;
+            file.path2 = root2 + "/" + file.relativePath;
+        } else if (file.status == FolderEntry::Identical) {
+            ++identical;
+            continue;
+        } else {
+            if (file.status != FolderEntry::Added) {
+                file.path1 = root1 + "/" + file.relativePath;
+            }
+            if (file.status != FolderEntry::Deleted) {
+                file.path2 = root2 + "/" + file.relativePath;
+            }
+        }
+        files.append(file);
+    }
+
+    if (identicalFiles) {
+        *identicalFiles = identical;
+    }
+    return files;
+}
+
+quint32 FolderModel::nextInTree(quint32 id) const
+{
+    // Pre-order: first child, else the next sibling of the node or of its
+    // nearest ancestor that has one
+    if (nodes[id].childCount > 0) {
+        return nodes[id].firstChild;
+    }
+    while (id != kRootNode) {
+        const Node &parent = nodes[nodes[id].parent];
+        if (id + 1 < parent.firstChild + parent.childCount) {
+            return id + 1;
+        }
+        id = nodes[id].parent;
+    }
+    return kRootNode;
+}
+
+quint32 FolderModel::previousInTree(quint32 id) const
+{
+    // The last descendant of the previous sibling, else the parent
+    quint32 parentId = nodes[id].parent;
+    if (id == nodes[parentId].firstChild) {
+        return parentId;
+    }
+    id--;
+    while (nodes[id].childCount > 0) {
+        id = nodes[id].firstChild + nodes[id].childCount - 1;
+    }
+    return id;
+}
+
+void FolderModel::setStats(const QVector<DiffStatsResult> &results)
+{
+    for (const DiffStatsResult &result : results) {
+        if (result.id >= quint32(nodes.size()) || nodes[result.id].status != FolderEntry::Modified) {
+            continue;
+        }
+
+        FileStats stats;
+        stats.diffable = result.diffable;
+        stats.stats = result.stats;
+        fileStats.insert(result.id, stats);
+
+        quint32 parentId = nodes[result.id].parent;
+        if (result.id - nodes[parentId].firstChild < nodes[parentId].fetchedCount) {
+            QModelIndex statsIndex = indexOf(result.id, 2);
+            emit dataChanged(statsIndex, statsIndex);
+        }
+    }
+}
+
+void FolderModel::applyRenames(const QVector<FolderRename> &detected)
+{
+    // Child name tables, built once per directory touched
+    QHash<quint32, QHash<QString, quint32>> childIds;
+    auto findNode = [&](const QString &path) -> quint32 {
+        auto parentIt = directoryNodes.constFind(parentPathOf(path));
+        if (parentIt == directoryNodes.constEnd()) {
+            return kRootNode;
+        }
+        quint32 parentId = parentIt.value();
+        auto tableIt = childIds.find(parentId);
+        if (tableIt == childIds.end()) {
+            QHash<QString, quint32> table;
+            const Node &parent = nodes[parentId];
+            for (quint32 child = parent.firstChild; child < parent.firstChild + parent.childCount; ++child) {
+                table.insert(names[nodes[child].name], child);
+            }
+            tableIt = childIds.insert(parentId, table);
+        }
+        return tableIt.value().value(path.mid(path.lastIndexOf('/') + 1), kRootNode);
+    };
+
+    auto mark = [&](quint32 id, const QString &partner, int similarity) {
+        if (id == kRootNode) {
+            return;
+        }
+        Rename rename;
+        rename.partner = partner;
+        rename.similarity = similarity;
+        renames.insert(id, rename);
+
+        quint32 parentId = nodes[id].parent;
+        if (id - nodes[parentId].firstChild < nodes[parentId].fetchedCount) {
+            QModelIndex statusIndex = indexOf(id, 1);
+            emit dataChanged(statusIndex, statusIndex);
+        }
+    };
+
+    for (const FolderRename &rename : detected) {
+        mark(findNode(rename.from), rename.to, rename.similarity);
+        mark(findNode(rename.to), rename.from, rename.similarity);
+    }
+}
+
+void FolderModel::finishLoading()
+{
+    complete = true;
+    pendingNodes.clear();
+}
+
+quint32 FolderModel::nodeId(const QModelIndex &index) const
+{
+    return index.isValid() ? quint32(index.internalId()) : kRootNode;
+}
+
+QModelIndex FolderModel::indexOf(quint32 id, int column) const
+{
+    if (id == kRootNode) {
+        return QModelIndex();
+    }
+    const Node &parentNode = nodes[nodes[id].parent];
+    return createIndex(int(id - parentNode.firstChild), column, quintptr(id));
+}
+
+QString FolderModel::relativePath(quint32 id) const
+{
+    QStringList parts;
+    while (id != kRootNode) {
+        parts.prepend(names[nodes[id].name]);
+        id = nodes[id].parent;
+    }
+    return parts.join('/');
+}
+
+void FolderModel::fetchChildren(quint32 id)
+{
+    Node &node = nodes[id];
+    if (node.fetchedCount >= node.childCount) {
+        return;
+    }
+
+    quint32 count = qMin(kFetchBatch, node.childCount - node.fetchedCount);
+    beginInsertRows(indexOf(id, 0), int(node.fetchedCount), int(node.fetchedCount + count - 1));
+    nodes[id].fetchedCount += count;
+    endInsertRows();
+}
+
+QModelIndex FolderModel::index(int row, int column, const QModelIndex &parent) const
+{
+    quint32 parentId = nodeId(parent);
+    if (row < 0 || column < 0 || column >= kColumnCount || quint32(row) >= nodes[parentId].fetchedCount) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, quintptr(nodes[parentId].firstChild + quint32(row)));
+}
+
+QModelIndex FolderModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    return indexOf(nodes[nodeId(child)].parent, 0);
+}
+
+int FolderModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return 0;
+    }
+    return int(nodes[nodeId(parent)].fetchedCount);
+}
+
+int FolderModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return kColumnCount;
+}
+
+bool FolderModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0) {
+        return false;
+    }
+    // Directories may still be waiting for their listing
+    const Node &node = nodes[nodeId(parent)];
+    return node.childCount > 0 || (!complete && node.directory);
+}
+
+bool FolderModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node &node = nodes[nodeId(parent)];
+    return node.fetchedCount < node.childCount
+        || (!complete && node.directory && !node.wanted);
+}
+
+void FolderModel::fetchMore(const QModelIndex &parent)
+{
+    quint32 id = nodeId(parent);
+    nodes[id].wanted = true;
+    fetchChildren(id);
+}
+
+QVariant FolderModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    quint32 id = nodeId(index);
+    const Node &node = nodes[id];
+    FolderEntry::Status status = FolderEntry::Status(node.status);
+    auto rename = renames.constFind(id);
+    bool renamed = rename != renames.constEnd();
+
+    auto stats = fileStats.constFind(id);
+    bool hasStats = stats != fileStats.constEnd();
+
+    switch (role) {
+    case Qt::DisplayRole:
+        if (index.column() == 0) {
+            return names[node.name];
+        }
+        if (index.column() == 2) {
+            if (!hasStats) {
+                return QVariant();
+            }
+            if (!stats.value().diffable) {
+                return QString("n/a");
+            }
+            const DiffStats &counts = stats.value().stats;
+            return QString("+%1 -%2 ~%3").arg(counts.added).arg(counts.deleted).arg(counts.modified);
+        }
+        if (renamed) {
+            QString text = status == FolderEntry::Deleted ? QString("Moved to %1") : QString("Moved from %1");
+            text = text.arg(rename.value().partner);
+            if (rename.value().similarity < 100) {
+                text += QString(" (%1% similar)").arg(rename.value().similarity);
+            }
+            return text;
+        }
+        return statusText(status);
+    case Qt::ForegroundRole:
+        if (index.column() != 1) {
+            break;
+        }
+        if (renamed) {
+            return QColor(0, 102, 204); // Blue
+        }
+        switch (status) {
+        case FolderEntry::Modified:
+            return QColor(255, 140, 0); // Orange
+        case FolderEntry::Added:
+            return QColor(0, 128, 0); // Green
+        case FolderEntry::Deleted:
+            return QColor(255, 0, 0); // Red
+        case FolderEntry::Identical:
+            return QColor(128, 128, 128); // Gray
+        default:
+            break;
+        }
+        break;
+    case Path1Role:
+        // A renamed file opens against its counterpart
+        if (renamed && status == FolderEntry::Added) {
+            return root1 + "/" + rename.value().partner;
+        }
+        return status == FolderEntry::Added ? QString() : root1 + "/" + relativePath(id);
+    case Path2Role:
+        if (renamed && status == FolderEntry::Deleted) {
+            return root2 + "/" + rename.value().partner;
+        }
+        return status == FolderEntry::Deleted ? QString() : root2 + "/" + relativePath(id);
+    case StatusRole:
+        return int(status);
+    case NodeRole:
+        return id;
+    case SortRole:
+        // Files without statistics sort below any change
+        if (index.column() == 2) {
+            return hasStats && stats.value().diffable ? stats.value().stats.churn() : -1;
+        }
+        return data(index, Qt::DisplayRole);
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+QVariant FolderModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    switch (section) {
+    case 0:
+        return tr("File");
+    case 1:
+        return tr("Status");
+    default:
+        return tr("Changes");
+    }
+}
+
+QString FolderModel::statusText(FolderEntry::Status status)
+{
+    switch (status) {
+    case FolderEntry::Directory:
+        return "Directory";
+    case FolderEntry::Identical:
+        return "Identical";
+    case FolderEntry::Modified:
+        return "Modified";
+    case FolderEntry::Added:
+        return "Added";
+    case FolderEntry::Deleted:
+        return "Deleted";
+    case FolderEntry::TypeMismatch:
+        return "Type mismatch";
+    case FolderEntry::Pending:
+    default:
+        return "Comparing...";
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef FOLDERMODEL_H
+#define FOLDERMODEL_H
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QMultiMap>
+#include <QString>
+#include <QVector>
+#include "foldercompareengine.h"
+#include "diffstatsscheduler.h"
+
+// A file that differs between the two folders, for reports
+struct ChangedFile {
+    QString relativePath;   // In the second folder for renames
+    QString renamedFrom;    // Relative path in the first folder; empty unless renamed
+    QString path1;          // Full paths, empty where the file is absent
+    QString path2;
+    FolderEntry::Status status;     // Renames are Modified, or Identical if unchanged
+    int similarity;                 // Percent, for renames
+};
+
+// Item model for folder comparison results.
+//
+// Every file and directory is one fixed-size Node in a flat array. Names are
+// interned, so a repeated name costs one table index, and the children of a
+// directory are stored contiguously (the engine reports each directory's
+// listing in one batch). Status text, colours and full paths are derived in
+// data() rather than stored; renames and diff statistics, which only few
+// entries have, live in side tables keyed by node. Children are handed to
+// the view in batches through canFetchMore()/fetchMore(), so collapsed
+// directories cost the view nothing.
+class FolderModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        Path1Role = Qt::UserRole,   // Full path in the first folder, empty if absent
+        Path2Role,                  // Full path in the second folder, empty if absent
+        StatusRole,                 // FolderEntry::Status as int
+        NodeRole,                   // Node id, stable until clear()
+        SortRole                    // Sort key for the column
+    };
+
+    explicit FolderModel(QObject *parent = nullptr);
+
+    void setRoots(const QString &root1, const QString &root2);
+    void clear();
+
+    // Entries must arrive as the engine reports them: a directory before its
+    // children and each directory's children together. A directory listed
+    // again replaces its children; subtrees of directories still present
+    // are kept.
+    void addEntries(const QVector<FolderEntry> &entries);
+    void updateEntries(const QVector<FolderEntry> &entries);
+    void clearDirectories(const QStringList &relativePaths);
+    void applyRenames(const QVector<FolderRename> &detected);
+    void setStats(const QVector<DiffStatsResult> &results);
+
+    // Files that became Modified since the last call, for statistics
+    QVector<quint32> takeNewlyModified();
+    // side: 1 or 2
+    QString filePath(quint32 id, int side) const;
+    // Nearest Modified file after (direction > 0) or before a node in
+    // listing order, the view's order until a column is sorted; 0 if none
+    quint32 adjacentModified(quint32 id, int direction) const;
+    // Every file that is not identical, in listing order; a rename is one
+    // entry. identicalFiles, if given, receives the number of the others.
+    QVector<ChangedFile> changedFiles(int *identicalFiles = nullptr) const;
+    // Drops the pending lookup table once the engine has reported everything
+    void finishLoading();
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    static QString statusText(FolderEntry::Status status);
+
+private:
+    struct Node {
+        quint32 parent;
+        quint32 name;           // Index into names
+        quint32 firstChild;     // Index of the first child in nodes
+        quint32 childCount;
+        quint32 fetchedCount;   // Children exposed to the view so far
+        quint8 status;          // FolderEntry::Status
+        bool directory;
+        bool wanted;            // The view asked for children before they arrived
+    };
+
+    struct Rename {
+        QString partner;        // Relative path on the other side
+        int similarity;
+    };
+
+    struct FileStats {
+        DiffStats stats;
+        bool diffable;
+    };
+
+    quint32 internName(const QString &name);
+    quint32 nodeId(const QModelIndex &index) const;
+    QModelIndex indexOf(quint32 id, int column) const;
+    QString relativePath(quint32 id) const;
+    void fetchChildren(quint32 id);
+    quint32 nextInTree(quint32 id) const;
+    quint32 previousInTree(quint32 id) const;
+    void appendChildren(quint32 parentId, const QVector<FolderEntry> &entries, int begin, int end,
+                        const QHash<QString, quint32> &adoptable = QHash<QString, quint32>());
+    void refreshChildren(quint32 parentId, const QVector<FolderEntry> &entries, int begin, int end);
+    void removeChildren(quint32 id);
+    quint32 allocateBlock(quint32 count);
+    // Frees the child blocks of a node and of all its descendants
+    void releaseSubtree(quint32 id);
+    void forgetSubtree(const QString &relativePath);
+
+    QVector<Node> nodes;        // nodes[0] is the invisible root
+    // Child blocks left behind by refreshes, by size, for reuse
+    QMultiMap<quint32, quint32> freeBlocks;
+    QVector<QString> names;
+    QHash<QString, quint32> nameIds;
+
+    // Directories stay mapped for incremental updates; pending files are
+    // only tracked while their comparison runs
+    QHash<QString, quint32> directoryNodes;
+    QHash<QString, quint32> pendingNodes;
+    // Few entries are renamed, so their details live outside the nodes
+    QHash<quint32, Rename> renames;
+    // Only modified files get statistics
+    QHash<quint32, FileStats> fileStats;
+    QVector<quint32> newlyModified;
+
+    QString root1;
+    QString root2;
+    bool complete;
+};
+
+#endif // FOLDERMODEL_H
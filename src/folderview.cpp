@@ -1,13 +1,52 @@
 #include "folderview.h"
+#include "tracer.h"
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QFileInfo>
-#include <QDirIterator>
-#include <QSet>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QSortFilterProxyModel>
+#include <QTemporaryDir>
+#include <QTimer>
 
 FolderView::FolderView(QWidget *parent)
     : QWidget(parent)
+    , comparisonStart(-1)
+    , entriesReported(0)
 {
+    model = new FolderModel(this);
+    
+    statsScheduler = new DiffStatsScheduler(this);
+    connect(statsScheduler, &DiffStatsScheduler::statsReady,
+            model, &FolderModel::setStats);
+    
+    compareEngine = new FolderCompareEngine(this);
+    connect(compareEngine, &FolderCompareEngine::entriesFound,
+            this, &FolderView::onEntriesFound);
+    connect(compareEngine, &FolderCompareEngine::entriesCompared,
+            this, &FolderView::onEntriesCompared);
+    connect(compareEngine, &FolderCompareEngine::directoriesEmptied,
+            model, &FolderModel::clearDirectories);
+    connect(compareEngine, &FolderCompareEngine::renamesDetected,
+            model, &FolderModel::applyRenames);
+    connect(compareEngine, &FolderCompareEngine::finished,
+            this, &FolderView::onComparisonFinished);
+    
+    gitEngine = new GitCompareEngine(this);
+    connect(gitEngine, &GitCompareEngine::entriesFound,
+            this, &FolderView::onEntriesFound);
+    connect(gitEngine, &GitCompareEngine::renamesDetected,
+            model, &FolderModel::applyRenames);
+    connect(gitEngine, &GitCompareEngine::finished,
+            this, &FolderView::onComparisonFinished);
+    
+    // Changes on disk re-evaluate only the affected directories
+    watcher = new FolderWatcher(this);
+    connect(watcher, &FolderWatcher::directoriesChanged,
+            compareEngine, &FolderCompareEngine::rescan);
+    connect(watcher, &FolderWatcher::overflowed,
+            this, &FolderView::reload);
+    
     setupUI();
 }
 
@@ -22,134 +61,235 @@ void FolderView::setupUI()
     QLabel *label = new QLabel(tr("File Tree"));
     label->setStyleSheet("font-weight: bold; padding: 5px; background-color: #f0f0f0;");
     
-    treeWidget = new QTreeWidget();
-    treeWidget->setHeaderLabels(QStringList() << tr("File") << tr("Status"));
-    treeWidget->setColumnWidth(0, 200);
+    // Sorting happens in a proxy so the model keeps its flat layout;
+    // until a header is clicked rows stay in listing order
+    sortModel = new QSortFilterProxyModel(this);
+    sortModel->setSourceModel(model);
+    sortModel->setSortRole(FolderModel::SortRole);
     
-    connect(treeWidget, &QTreeWidget::itemClicked, 
+    treeView = new QTreeView();
+    treeView->setModel(sortModel);
+    treeView->setColumnWidth(0, 200);
+    // Lets the view skip measuring rows it does not paint
+    treeView->setUniformRowHeights(true);
+    treeView->header()->setSortIndicator(-1, Qt::AscendingOrder);
+    treeView->setSortingEnabled(true);
+    
+    connect(treeView, &QTreeView::clicked, 
             this, &FolderView::onItemClicked);
     
+    // Statistics for what is on screen are computed first
+    visibleStatsTimer = new QTimer(this);
+    visibleStatsTimer->setSingleShot(true);
+    visibleStatsTimer->setInterval(100);
+    connect(visibleStatsTimer, &QTimer::timeout,
+            this, &FolderView::prioritizeVisibleStats);
+    connect(treeView->verticalScrollBar(), &QScrollBar::valueChanged,
+            visibleStatsTimer, [this]() { visibleStatsTimer->start(); });
+    connect(treeView, &QTreeView::expanded,
+            this, &FolderView::prioritizeChildStats);
+    
     layout->addWidget(label);
-    layout->addWidget(treeWidget);
+    layout->addWidget(treeView);
     layout->setContentsMargins(0, 0, 0, 0);
 }
 
 void FolderView::loadFolders(const QString &folder1, const QString &folder2)
 {
+    compareEngine->cancel();
+    gitEngine->cancel();
+    revisionFiles.reset();
+    
     baseFolder1 = folder1;
     baseFolder2 = folder2;
     
-    treeWidget->clear();
+    statsScheduler->clear();
+    model->clear();
+    model->setRoots(folder1, folder2);
+    watcher->setRoots(folder1, folder2);
     
-    // Create root item
-    QTreeWidgetItem *rootItem = new QTreeWidgetItem(treeWidget);
-    rootItem->setText(0, tr("Comparing Folders"));
-    rootItem->setExpanded(true);
-    
-    // Compare directories
-    compareDirectories(folder1, folder2, rootItem);
+    // Compare directories in the background; results stream into the model
+    startTiming();
+    compareEngine->start(folder1, folder2);
 }
 
-void FolderView::compareDirectories(const QString &path1, const QString &path2, QTreeWidgetItem *parentItem)
+bool FolderView::loadRevisions(const QString &repositoryPath, const QString &revision1, const QString &revision2)
 {
-    QDir dir1(path1);
-    QDir dir2(path2);
+    compareEngine->cancel();
     
-    // Get all files and subdirectories
-    QSet<QString> allNames;
+    statsScheduler->clear();
+    model->clear();
+    watcher->clear();
+    baseFolder1.clear();
+    baseFolder2.clear();
+    revisionFiles.reset();
     
-    QFileInfoList list1 = dir1.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-    QFileInfoList list2 = dir2.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    startTiming();
+    if (!gitEngine->start(repositoryPath, revision1, revision2)) {
+        return false;
+    }
     
-    for (const QFileInfo &info : list1) {
-        allNames.insert(info.fileName());
+    // Nothing is checked out; a file is written here when it is opened
+    revisionFiles.reset(new QTemporaryDir());
+    model->setRoots(revisionFiles->path() + "/1", revisionFiles->path() + "/2");
+    return true;
+}
+
+QString FolderView::errorString() const
+{
+    return gitEngine->errorString();
+}
+
+void FolderView::reload()
+{
+    if (!baseFolder1.isEmpty() && !baseFolder2.isEmpty()) {
+        loadFolders(baseFolder1, baseFolder2);
     }
-    for (const QFileInfo &info : list2) {
-        allNames.insert(info.fileName());
+}
+
+void FolderView::setRenameThreshold(int percent)
+{
+    compareEngine->setRenameThreshold(percent);
+}
+
+int FolderView::renameThreshold() const
+{
+    return compareEngine->renameThresholdPercent();
+}
+
+void FolderView::setIgnoreRules(const QStringList &rules)
+{
+    compareEngine->setIgnoreRules(rules);
+    reload();
+}
+
+QStringList FolderView::ignoreRules() const
+{
+    return compareEngine->ignoreRulesList();
+}
+
+void FolderView::setUseGitignore(bool use)
+{
+    compareEngine->setUseGitignore(use);
+    reload();
+}
+
+void FolderView::cancelComparison()
+{
+    compareEngine->cancel();
+    gitEngine->cancel();
+}
+
+void FolderView::onEntriesFound(const QVector<FolderEntry> &entries)
+{
+    model->addEntries(entries);
+    entriesReported += entries.size();
+    if (revisionFiles) {
+        // Revisions do not change and are not on disk to diff in bulk
+        model->takeNewlyModified();
+        return;
     }
+    requestStats();
     
-    // Compare each item
-    QList<QString> sortedNames = allNames.values();
-    std::sort(sortedNames.begin(), sortedNames.end());
-    
-    for (const QString &name : sortedNames) {
-        QString fullPath1 = path1 + "/" + name;
-        QString fullPath2 = path2 + "/" + name;
-        
-        QFileInfo info1(fullPath1);
-        QFileInfo info2(fullPath2);
-        
-        bool exists1 = info1.exists();
-        bool exists2 = info2.exists();
-        
-        QString status;
-        if (exists1 && exists2) {
-            if (info1.isDir() && info2.isDir()) {
-                status = "Directory";
-                QTreeWidgetItem *dirItem = new QTreeWidgetItem(parentItem);
-                dirItem->setText(0, name);
-                dirItem->setText(1, status);
-                dirItem->setData(0, Qt::UserRole, fullPath1);
-                dirItem->setData(1, Qt::UserRole, fullPath2);
-                
-                // Recursively compare subdirectories
-                compareDirectories(fullPath1, fullPath2, dirItem);
-            } else if (info1.isFile() && info2.isFile()) {
-                // Compare file contents
-                QFile f1(fullPath1), f2(fullPath2);
-                bool identical = false;
-                
-                if (f1.size() == f2.size()) {
-                    if (f1.open(QIODevice::ReadOnly) && f2.open(QIODevice::ReadOnly)) {
-                        identical = (f1.readAll() == f2.readAll());
-                        f1.close();
-                        f2.close();
-                    }
-                }
-                
-                status = identical ? "Identical" : "Modified";
-                addFileItem(name, fullPath1, fullPath2, status, parentItem);
-            } else {
-                status = "Type mismatch";
-                addFileItem(name, fullPath1, fullPath2, status, parentItem);
-            }
-        } else if (exists1) {
-            status = "Deleted";
-            addFileItem(name, fullPath1, "", status, parentItem);
-        } else if (exists2) {
-            status = "Added";
-            addFileItem(name, "", fullPath2, status, parentItem);
+    for (const FolderEntry &entry : entries) {
+        if (entry.directory) {
+            watcher->addDirectory(entry.relativePath);
         }
     }
 }
 
-void FolderView::addFileItem(const QString &name, const QString &path1, const QString &path2, 
-                             const QString &status, QTreeWidgetItem *parent)
-{
-    QTreeWidgetItem *item = new QTreeWidgetItem(parent);
-    item->setText(0, name);
-    item->setText(1, status);
-    item->setData(0, Qt::UserRole, path1);
-    item->setData(1, Qt::UserRole, path2);
-    
-    // Color code based on status
-    if (status == "Modified") {
-        item->setForeground(1, QColor(255, 140, 0)); // Orange
-    } else if (status == "Added") {
-        item->setForeground(1, QColor(0, 128, 0)); // Green
-    } else if (status == "Deleted") {
-        item->setForeground(1, QColor(255, 0, 0)); // Red
-    } else if (status == "Identical") {
-        item->setForeground(1, QColor(128, 128, 128)); // Gray
+void FolderView::onEntriesCompared(const QVector<FolderEntry> &entries)
+{
+    model->updateEntries(entries);
+    requestStats();
+}
+
+void FolderView::requestStats()
+{
+    const QVector<quint32> ids = model->takeNewlyModified();
+    for (quint32 id : ids) {
+        statsScheduler->request(id, model->filePath(id, 1), model->filePath(id, 2));
+    }
+    if (!ids.isEmpty()) {
+        visibleStatsTimer->start();
+    }
+}
+
+void FolderView::prioritizeVisibleStats()
+{
+    QVector<quint32> ids;
+    int height = treeView->viewport()->height();
+    for (QModelIndex index = treeView->indexAt(QPoint(0, 0));
+         index.isValid() && treeView->visualRect(index).top() < height;
+         index = treeView->indexBelow(index)) {
+        ids.append(index.data(FolderModel::NodeRole).toUInt());
+    }
+    statsScheduler->prioritize(ids);
+}
+
+void FolderView::prioritizeChildStats(const QModelIndex &index)
+{
+    QVector<quint32> ids;
+    int rows = sortModel->rowCount(index);
+    for (int row = 0; row < rows; ++row) {
+        ids.append(sortModel->index(row, 0, index).data(FolderModel::NodeRole).toUInt());
     }
+    statsScheduler->prioritize(ids);
+    visibleStatsTimer->start();
 }
 
-void FolderView::onItemClicked(QTreeWidgetItem *item, int column)
+void FolderView::startTiming()
 {
-    Q_UNUSED(column);
+    comparisonStart = Tracer::isEnabled() ? Tracer::now() : -1;
+    entriesReported = 0;
+}
+
+void FolderView::onComparisonFinished(bool cancelled)
+{
+    model->finishLoading();
+    emit comparisonFinished(cancelled);
     
-    QString path1 = item->data(0, Qt::UserRole).toString();
-    QString path2 = item->data(1, Qt::UserRole).toString();
+    if (comparisonStart >= 0) {
+        int traceMark = Tracer::mark();
+        Tracer::complete("folderComparison", comparisonStart, "entries", entriesReported);
+        emit timingsAvailable(Tracer::summary(traceMark));
+        comparisonStart = -1;
+    }
+}
+
+void FolderView::extractRevisionFile(int side, const QString &path)
+{
+    QString root = revisionFiles->path() + (side == 1 ? "/1" : "/2");
+    if (path.startsWith(root + "/") && !QFileInfo::exists(path)) {
+        gitEngine->extractFile(side, path.mid(root.size() + 1), path);
+    }
+}
+
+QVector<ChangedFile> FolderView::changedFiles(int *identicalFiles) const
+{
+    return model->changedFiles(identicalFiles);
+}
+
+QString FolderView::root(int side) const
+{
+    return side == 1 ? baseFolder1 : baseFolder2;
+}
+
+bool FolderView::comparesRevisions() const
+{
+    // Revision files only exist on disk once they have been opened
+    return bool(revisionFiles);
+}
+
+void FolderView::onItemClicked(const QModelIndex &index)
+{
+    QString path1 = index.data(FolderModel::Path1Role).toString();
+    QString path2 = index.data(FolderModel::Path2Role).toString();
+    
+    if (revisionFiles) {
+        extractRevisionFile(1, path1);
+        extractRevisionFile(2, path2);
+    }
     
     // Only emit signal for files, not directories
     QFileInfo info1(path1);
@@ -166,5 +306,25 @@ void FolderView::onItemClicked(QTreeWidgetItem *item, int column)
         } else {
             emit fileSelected(path1, path2);
         }
+        prefetchNeighbours(index);
+    }
+}
+
+void FolderView::prefetchNeighbours(const QModelIndex &index)
+{
+    // Next first: stepping forward through the changes is the common case
+    quint32 id = index.data(FolderModel::NodeRole).toUInt();
+    for (int direction : { 1, -1 }) {
+        quint32 neighbour = model->adjacentModified(id, direction);
+        if (neighbour == 0) {
+            continue;
+        }
+        QString path1 = model->filePath(neighbour, 1);
+        QString path2 = model->filePath(neighbour, 2);
+        if (revisionFiles) {
+            extractRevisionFile(1, path1);
+            extractRevisionFile(2, path2);
+        }
+        emit prefetchRequested(path1, path2);
     }
 }
@@ -2,9 +2,17 @@
 #define FOLDERVIEW_H
 
 #include <QWidget>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
-#include <QDir>
+#include <QTreeView>
+#include <memory>
+#include "foldercompareengine.h"
+#include "gitcompareengine.h"
+#include "foldermodel.h"
+#include "folderwatcher.h"
+#include "diffstatsscheduler.h"
+
+class QSortFilterProxyModel;
+class QTemporaryDir;
+class QTimer;
 
 class FolderView : public QWidget
 {
@@ -15,22 +23,65 @@ public:
     ~FolderView();
 
     void loadFolders(const QString &folder1, const QString &folder2);
+    // Compares two revisions of a local git repository; returns false, with
+    // errorString() set, if they cannot be read
+    bool loadRevisions(const QString &repositoryPath, const QString &revision1, const QString &revision2);
+    QString errorString() const;
+    // Takes effect with the next comparison
+    void setRenameThreshold(int percent);
+    int renameThreshold() const;
+    // Re-run the current comparison with the new filter
+    void setIgnoreRules(const QStringList &rules);
+    QStringList ignoreRules() const;
+    void setUseGitignore(bool use);
+    // Results of the last comparison, for reports
+    QVector<ChangedFile> changedFiles(int *identicalFiles = nullptr) const;
+    QString root(int side) const;
+    bool comparesRevisions() const;
+
+public slots:
+    void cancelComparison();
 
 signals:
     void fileSelected(const QString &file1, const QString &file2);
+    // The Modified files next to the selection, likely to be opened next
+    void prefetchRequested(const QString &file1, const QString &file2);
+    void comparisonFinished(bool cancelled);
+    // Duration of the last comparison, only while tracing is enabled
+    void timingsAvailable(const QString &summary);
 
 private slots:
-    void onItemClicked(QTreeWidgetItem *item, int column);
+    void onItemClicked(const QModelIndex &index);
+    void onEntriesFound(const QVector<FolderEntry> &entries);
+    void onEntriesCompared(const QVector<FolderEntry> &entries);
+    void prioritizeVisibleStats();
+    void prioritizeChildStats(const QModelIndex &index);
+    void reload();
+    void onComparisonFinished(bool cancelled);
 
 private:
     void setupUI();
-    void compareDirectories(const QString &path1, const QString &path2, QTreeWidgetItem *parentItem);
-    void addFileItem(const QString &name, const QString &path1, const QString &path2, 
-                     const QString &status, QTreeWidgetItem *parent);
+    void requestStats();
+    void startTiming();
+    void extractRevisionFile(int side, const QString &path);
+    void prefetchNeighbours(const QModelIndex &index);
+    
+    QTreeView *treeView;
+    FolderModel *model;
+    QSortFilterProxyModel *sortModel;
+    DiffStatsScheduler *statsScheduler;
+    QTimer *visibleStatsTimer;
+    FolderCompareEngine *compareEngine;
+    GitCompareEngine *gitEngine;
+    FolderWatcher *watcher;
     
-    QTreeWidget *treeWidget;
     QString baseFolder1;
     QString baseFolder2;
+    // Tracer timestamp of the running comparison, -1 when not tracing
+    qint64 comparisonStart;
+    qint64 entriesReported;
+    // Revision mode: files are written here from the object store when opened
+    std::unique_ptr<QTemporaryDir> revisionFiles;
 };
 
 #endif // FOLDERVIEW_H
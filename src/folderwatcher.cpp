@@ -0,0 +1,197 @@
+#include "folderwatcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <QFileSystemWatcher>
+#endif
+
+namespace {
+
+const int kQuietPeriodMs = 250;
+const int kMaxDelayMs = 2000;
+
+QString joinPath(const QString &root, const QString &relativePath)
+{
+    return relativePath.isEmpty() ? root : root + "/" + relativePath;
+}
+
+#ifdef Q_OS_LINUX
+const quint32 kWatchMask = IN_ONLYDIR | IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE
+                         | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+} // namespace
+
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent)
+{
+    debounceTimer = new QTimer(this);
+    debounceTimer->setSingleShot(true);
+    connect(debounceTimer, &QTimer::timeout, this, &FolderWatcher::flushChanges);
+
+#ifdef Q_OS_LINUX
+    limitReported = false;
+    notifier = nullptr;
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        qWarning() << "inotify unavailable, folder changes will not be picked up";
+    } else {
+        notifier = new QSocketNotifier(inotifyFd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, &FolderWatcher::readEvents);
+    }
+#else
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &FolderWatcher::onDirectoryChanged);
+#endif
+}
+
+FolderWatcher::~FolderWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (inotifyFd >= 0) {
+        ::close(inotifyFd);
+    }
+#endif
+}
+
+void FolderWatcher::setRoots(const QString &root1, const QString &root2)
+{
+    clear();
+    this->root1 = root1;
+    this->root2 = root2;
+    addDirectory(QString());
+}
+
+void FolderWatcher::clear()
+{
+    debounceTimer->stop();
+    changedDirectories.clear();
+
+#ifdef Q_OS_LINUX
+    for (auto it = watchPaths.constBegin(); it != watchPaths.constEnd(); ++it) {
+        ::inotify_rm_watch(inotifyFd, it.key());
+    }
+    watchPaths.clear();
+    limitReported = false;
+#else
+    const QStringList watched = watcher->directories();
+    if (!watched.isEmpty()) {
+        watcher->removePaths(watched);
+    }
+#endif
+}
+
+void FolderWatcher::addDirectory(const QString &relativePath)
+{
+    addWatch(joinPath(root1, relativePath), relativePath);
+    addWatch(joinPath(root2, relativePath), relativePath);
+}
+
+void FolderWatcher::addWatch(const QString &path, const QString &relativePath)
+{
+#ifdef Q_OS_LINUX
+    if (inotifyFd < 0) {
+        return;
+    }
+
+    int wd = ::inotify_add_watch(inotifyFd, QFile::encodeName(path).constData(), kWatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC && !limitReported) {
+            qWarning() << "inotify watch limit reached, some folder changes will not be picked up";
+            limitReported = true;
+        }
+        return;
+    }
+    // Watching the same directory again returns the existing descriptor
+    watchPaths.insert(wd, relativePath);
+#else
+    Q_UNUSED(relativePath);
+    watcher->addPath(path);
+#endif
+}
+
+void FolderWatcher::markChanged(const QString &relativePath)
+{
+    if (!debounceTimer->isActive()) {
+        burstTimer.start();
+    }
+    changedDirectories.insert(relativePath);
+
+    // Restart the quiet period, but never hold changes back indefinitely
+    qint64 remaining = kMaxDelayMs - burstTimer.elapsed();
+    debounceTimer->start(int(qBound<qint64>(0, remaining, kQuietPeriodMs)));
+}
+
+void FolderWatcher::flushChanges()
+{
+    if (changedDirectories.isEmpty()) {
+        return;
+    }
+
+    QStringList paths(changedDirectories.begin(), changedDirectories.end());
+    changedDirectories.clear();
+    paths.sort();
+    emit directoriesChanged(paths);
+}
+
+#ifdef Q_OS_LINUX
+void FolderWatcher::readEvents()
+{
+    alignas(struct inotify_event) char buffer[16384];
+
+    while (true) {
+        ssize_t length = ::read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char *p = buffer; p < buffer + length; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                debounceTimer->stop();
+                changedDirectories.clear();
+                emit overflowed();
+                continue;
+            }
+
+            auto it = watchPaths.constFind(event->wd);
+            if (it == watchPaths.constEnd()) {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                // The directory is gone; its parent reports the removal
+                watchPaths.remove(event->wd);
+                continue;
+            }
+
+            markChanged(it.value());
+        }
+    }
+}
+#else
+void FolderWatcher::onDirectoryChanged(const QString &path)
+{
+    QString cleanPath = QDir::cleanPath(path);
+    for (const QString &root : { QDir::cleanPath(root1), QDir::cleanPath(root2) }) {
+        if (cleanPath == root) {
+            markChanged(QString());
+            return;
+        }
+        if (cleanPath.startsWith(root + "/")) {
+            markChanged(cleanPath.mid(root.size() + 1));
+            return;
+        }
+    }
+}
+#endif
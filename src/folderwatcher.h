@@ -0,0 +1,70 @@
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QElapsedTimer>
+
+class QTimer;
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+// Watches the directory pairs of a folder comparison and reports which
+// relative directories changed. Events are coalesced: a report goes out
+// once the trees have been quiet for a moment, or at the latest after a
+// fixed delay, so a large checkout becomes a single burst.
+//
+// On Linux inotify is used directly: directory watches there also report
+// writes to the files inside, which QFileSystemWatcher's directory watches
+// do not. Elsewhere QFileSystemWatcher is used.
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderWatcher(QObject *parent = nullptr);
+    ~FolderWatcher();
+
+    // Drops all watches and starts watching the two root directories
+    void setRoots(const QString &root1, const QString &root2);
+    void addDirectory(const QString &relativePath);
+    void clear();
+
+signals:
+    void directoriesChanged(const QStringList &relativePaths);
+    // Events were lost; only a full comparison is reliable
+    void overflowed();
+
+private slots:
+    void flushChanges();
+#ifdef Q_OS_LINUX
+    void readEvents();
+#else
+    void onDirectoryChanged(const QString &path);
+#endif
+
+private:
+    void addWatch(const QString &path, const QString &relativePath);
+    void markChanged(const QString &relativePath);
+
+    QString root1;
+    QString root2;
+
+    QTimer *debounceTimer;
+    QElapsedTimer burstTimer;
+    QSet<QString> changedDirectories;
+
+#ifdef Q_OS_LINUX
+    int inotifyFd;
+    QSocketNotifier *notifier;
+    QHash<int, QString> watchPaths;     // Watch descriptor to relative path
+    bool limitReported;
+#else
+    QFileSystemWatcher *watcher;
+#endif
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,336 @@
+#include "gitcompareengine.h"
+#include "tracer.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+const int kFlushIntervalMs = 50;
+
+typedef QVector<GitRepository::TreeEntry> TreeEntries;
+
+QString fileName(const QString &relativePath)
+{
+    return relativePath.mid(relativePath.lastIndexOf('/') + 1);
+}
+
+} // namespace
+
+GitCompareEngine::GitCompareEngine(QObject *parent)
+    : QObject(parent)
+    , running(false)
+    , cancelled(false)
+    , pendingTasks(0)
+{
+    pool = new QThreadPool(this);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(kFlushIntervalMs);
+    connect(flushTimer, &QTimer::timeout, this, &GitCompareEngine::flushResults);
+}
+
+GitCompareEngine::~GitCompareEngine()
+{
+    // Tasks hold a pointer to this engine
+    cancelled = true;
+    pool->clear();
+    pool->waitForDone();
+}
+
+bool GitCompareEngine::start(const QString &repositoryPath, const QString &revision1, const QString &revision2)
+{
+    cancel();
+
+    auto opened = std::make_shared<GitRepository>(repositoryPath);
+    GitRepository::ObjectId tree1, tree2;
+    if (!opened->open()
+        || (tree1 = opened->resolveTree(revision1)).isEmpty()
+        || (tree2 = opened->resolveTree(revision2)).isEmpty()) {
+        error = opened->errorString();
+        return false;
+    }
+
+    repository = opened;
+    rootTree1 = tree1;
+    rootTree2 = tree2;
+    error.clear();
+    deletedBlobs.clear();
+    addedBlobs.clear();
+    cancelled = false;
+    pendingTasks = 0;
+    running = true;
+
+    submit([this]() { compareTrees(QString(), rootTree1, rootTree2); });
+    flushTimer->start();
+    return true;
+}
+
+void GitCompareEngine::cancel()
+{
+    if (!running) {
+        return;
+    }
+
+    cancelled = true;
+    pool->clear();
+    pool->waitForDone();
+
+    flushTimer->stop();
+    pendingTasks = 0;
+    running = false;
+
+    {
+        QMutexLocker locker(&resultMutex);
+        foundEntries.clear();
+        deletedBlobs.clear();
+        addedBlobs.clear();
+    }
+
+    emit finished(true);
+}
+
+void GitCompareEngine::submit(std::function<void()> task)
+{
+    if (cancelled) {
+        return;
+    }
+
+    ++pendingTasks;
+    pool->start([this, task]() {
+        if (!cancelled) {
+            task();
+        }
+        --pendingTasks;
+    });
+}
+
+void GitCompareEngine::fail(const QString &message)
+{
+    // The first failure is reported; queued tasks are skipped from now on
+    QMutexLocker locker(&resultMutex);
+    if (error.isEmpty()) {
+        error = message;
+    }
+    cancelled = true;
+}
+
+void GitCompareEngine::flushResults()
+{
+    bool done = pendingTasks == 0;
+
+    QVector<FolderEntry> found;
+    {
+        QMutexLocker locker(&resultMutex);
+        found.swap(foundEntries);
+    }
+    if (!found.isEmpty()) {
+        emit entriesFound(found);
+    }
+    if (!done) {
+        return;
+    }
+
+    flushTimer->stop();
+    running = false;
+
+    bool failed;
+    {
+        QMutexLocker locker(&resultMutex);
+        failed = !error.isEmpty();
+    }
+    if (failed) {
+        deletedBlobs.clear();
+        addedBlobs.clear();
+        emit finished(true);
+        return;
+    }
+
+    // Blob ids are content hashes: equal ids on both sides are exact renames
+    QHash<GitRepository::ObjectId, QVector<int>> deletedById;
+    for (int i = 0; i < deletedBlobs.size(); ++i) {
+        deletedById[deletedBlobs[i].id].append(i);
+    }
+
+    QVector<FolderRename> renames;
+    for (const OneSidedBlob &added : std::as_const(addedBlobs)) {
+        auto it = deletedById.find(added.id);
+        if (it == deletedById.end() || it->isEmpty()) {
+            continue;
+        }
+
+        // Prefer a file of the same name, as RenameDetector does
+        int pick = 0;
+        for (int k = 0; k < it->size(); ++k) {
+            if (fileName(deletedBlobs[it->at(k)].relativePath) == fileName(added.relativePath)) {
+                pick = k;
+                break;
+            }
+        }
+
+        FolderRename rename;
+        rename.from = deletedBlobs[it->at(pick)].relativePath;
+        rename.to = added.relativePath;
+        rename.similarity = 100;
+        renames.append(rename);
+        it->remove(pick);
+    }
+    deletedBlobs.clear();
+    addedBlobs.clear();
+
+    if (!renames.isEmpty()) {
+        emit renamesDetected(renames);
+    }
+    emit finished(false);
+}
+
+void GitCompareEngine::compareTrees(const QString &relativePath, const GitRepository::ObjectId &tree1,
+                                    const GitRepository::ObjectId &tree2)
+{
+    TraceScope trace("compareTrees");
+
+    // An empty id stands for a tree missing on that side. A tree that
+    // cannot be read must not pass for an empty one, which would report
+    // everything on the other side as added or deleted.
+    TreeEntries list1, list2;
+    const GitRepository::ObjectId *unreadable = nullptr;
+    if (!tree1.isEmpty() && !repository->readTree(tree1, &list1)) {
+        unreadable = &tree1;
+    } else if (!tree2.isEmpty() && !repository->readTree(tree2, &list2)) {
+        unreadable = &tree2;
+    }
+    if (unreadable) {
+        fail(QString("Cannot read tree %1 of %2")
+                 .arg(GitRepository::toHex(*unreadable))
+                 .arg(relativePath.isEmpty() ? QString("the root directory") : relativePath));
+        return;
+    }
+
+    // git orders directories as if their names ended in '/'; plain name
+    // order pairs a file with a directory of the same name
+    auto byName = [](const GitRepository::TreeEntry &a, const GitRepository::TreeEntry &b) {
+        return a.name < b.name;
+    };
+    std::sort(list1.begin(), list1.end(), byName);
+    std::sort(list2.begin(), list2.end(), byName);
+
+    QVector<FolderEntry> batch;
+    batch.reserve(qMax(list1.size(), list2.size()));
+    QVector<OneSidedBlob> deleted;
+    QVector<OneSidedBlob> added;
+    QVector<std::function<void()>> subtrees;
+
+    int i = 0, j = 0;
+    while (i < list1.size() || j < list2.size()) {
+        int order;
+        if (i == list1.size()) {
+            order = 1;
+        } else if (j == list2.size()) {
+            order = -1;
+        } else {
+            order = qstrcmp(list1[i].name, list2[j].name);
+        }
+
+        const GitRepository::TreeEntry &item = order > 0 ? list2[j] : list1[i];
+        FolderEntry entry;
+        entry.name = QString::fromUtf8(item.name);
+        entry.relativePath = relativePath.isEmpty() ? entry.name : relativePath + "/" + entry.name;
+
+        if (order != 0) {
+            entry.status = order < 0 ? FolderEntry::Deleted : FolderEntry::Added;
+            const GitRepository::ObjectId id = item.id;
+            const QString path = entry.relativePath;
+            if (item.isTree()) {
+                entry.directory = true;
+                if (order < 0) {
+                    subtrees.append([this, path, id]() { compareTrees(path, id, GitRepository::ObjectId()); });
+                } else {
+                    subtrees.append([this, path, id]() { compareTrees(path, GitRepository::ObjectId(), id); });
+                }
+            } else {
+                (order < 0 ? deleted : added).append({ path, id });
+            }
+            ++(order < 0 ? i : j);
+        } else {
+            const GitRepository::TreeEntry &item1 = list1[i++];
+            const GitRepository::TreeEntry &item2 = list2[j++];
+
+            if (item1.isTree() && item2.isTree()) {
+                entry.directory = true;
+                if (item1.id == item2.id) {
+                    // Same content address: nothing below can differ
+                    entry.status = FolderEntry::Identical;
+                } else {
+                    entry.status = FolderEntry::Directory;
+                    const QString path = entry.relativePath;
+                    const GitRepository::ObjectId id1 = item1.id;
+                    const GitRepository::ObjectId id2 = item2.id;
+                    subtrees.append([this, path, id1, id2]() { compareTrees(path, id1, id2); });
+                }
+            } else if (!item1.isTree() && !item2.isTree()) {
+                entry.status = item1.id == item2.id ? FolderEntry::Identical : FolderEntry::Modified;
+            } else {
+                entry.status = FolderEntry::TypeMismatch;
+            }
+        }
+
+        batch.append(entry);
+    }
+
+    trace.arg("entries", batch.size());
+
+    {
+        QMutexLocker locker(&resultMutex);
+        foundEntries += batch;
+        deletedBlobs += deleted;
+        addedBlobs += added;
+    }
+
+    for (const std::function<void()> &subtree : subtrees) {
+        submit(subtree);
+    }
+}
+
+bool GitCompareEngine::extractFile(int side, const QString &relativePath, const QString &filePath) const
+{
+    if (!repository) {
+        return false;
+    }
+
+    // Walk down from the root tree, reading one tree per path component
+    GitRepository::ObjectId id = side == 1 ? rootTree1 : rootTree2;
+    const QStringList parts = relativePath.split('/');
+    for (const QString &part : parts) {
+        TreeEntries entries;
+        if (!repository->readTree(id, &entries)) {
+            return false;
+        }
+
+        const QByteArray name = part.toUtf8();
+        auto it = std::find_if(entries.cbegin(), entries.cend(), [&name](const GitRepository::TreeEntry &entry) {
+            return entry.name == name;
+        });
+        if (it == entries.cend()) {
+            return false;
+        }
+        id = it->id;
+    }
+
+    GitRepository::ObjectType type;
+    QByteArray data;
+    if (!repository->readObject(id, &type, &data) || type != GitRepository::Blob) {
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(data) == data.size();
+}
@@ -0,0 +1,82 @@
+#ifndef GITCOMPAREENGINE_H
+#define GITCOMPAREENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "foldercompareengine.h"
+#include "gitrepository.h"
+
+class QThreadPool;
+class QTimer;
+
+// Compares the trees of two revisions in a local git repository without
+// checking anything out. Tree and blob ids are content hashes, so a pair of
+// subtrees with the same id is reported as one Identical directory without
+// being read, and files are classified by their ids alone; only trees that
+// differ are loaded. Reports through the same signals as
+// FolderCompareEngine, so results feed a FolderModel unchanged. Deleted and
+// added blobs with the same id are reported as renames.
+class GitCompareEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GitCompareEngine(QObject *parent = nullptr);
+    ~GitCompareEngine();
+
+    // Returns false, with errorString() set, if the repository or either
+    // revision cannot be read. A tree that cannot be read later stops the
+    // comparison, which then finishes as cancelled with errorString() set.
+    bool start(const QString &repositoryPath, const QString &revision1, const QString &revision2);
+    bool isRunning() const { return running; }
+    QString errorString() const { return error; }
+
+    // Writes the blob at relativePath in revision 1 or 2 to filePath
+    bool extractFile(int side, const QString &relativePath, const QString &filePath) const;
+
+public slots:
+    void cancel();
+
+signals:
+    void entriesFound(const QVector<FolderEntry> &entries);
+    void renamesDetected(const QVector<FolderRename> &renames);
+    void finished(bool cancelled);
+
+private slots:
+    void flushResults();
+
+private:
+    struct OneSidedBlob {
+        QString relativePath;
+        GitRepository::ObjectId id;
+    };
+
+    void compareTrees(const QString &relativePath, const GitRepository::ObjectId &tree1,
+                      const GitRepository::ObjectId &tree2);
+    void submit(std::function<void()> task);
+    void fail(const QString &message);
+
+    QThreadPool *pool;
+    QTimer *flushTimer;
+
+    std::shared_ptr<GitRepository> repository;
+    GitRepository::ObjectId rootTree1;
+    GitRepository::ObjectId rootTree2;
+    QString error;          // Written under resultMutex while running
+    bool running;
+    std::atomic<bool> cancelled;
+    std::atomic<int> pendingTasks;
+
+    // Filled by pool threads, drained by flushResults()
+    QMutex resultMutex;
+    QVector<FolderEntry> foundEntries;
+    QVector<OneSidedBlob> deletedBlobs;
+    QVector<OneSidedBlob> addedBlobs;
+};
+
+#endif // GITCOMPAREENGINE_H
@@ -0,0 +1,729 @@
+#include "gitrepository.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSet>
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const quint32 kIndexSignature = 0xff744f63;
+const quint32 kIndexVersion = 2;
+const int kIdSize = 20;
+const int kIndexHeaderSize = 8 + 256 * 4;
+const int kPackHeaderSize = 12;
+const int kMaxDeltaDepth = 4095;    // git's own hard limit
+const int kMaxRefDepth = 5;
+const int kMaxAlternateDepth = 5;   // Same limit as git
+const qint64 kMaxCachedBaseBytes = 32 * 1024 * 1024;
+
+enum PackEntryType { OfsDelta = 6, RefDelta = 7 };
+
+inline quint32 read32(const uchar *p) { return qFromBigEndian<quint32>(p); }
+inline quint64 read64(const uchar *p) { return qFromBigEndian<quint64>(p); }
+
+bool isHex(const QByteArray &text)
+{
+    for (char c : text) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+            return false;
+        }
+    }
+    return !text.isEmpty();
+}
+
+#ifdef HAVE_ZLIB
+// Inflates one zlib stream; with expectedSize < 0 the output grows as needed
+bool inflateStream(const uchar *input, qint64 inputSize, qint64 expectedSize, QByteArray *out)
+{
+    if (expectedSize > std::numeric_limits<int>::max() - 1) {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef *>(input);
+    stream.avail_in = uInt(qMin<qint64>(inputSize, std::numeric_limits<uInt>::max()));
+
+    // One spare byte tells a stream longer than announced from an exact fit
+    out->resize(int(expectedSize >= 0 ? expectedSize + 1 : qMax<qint64>(inputSize * 3, 4096)));
+    qint64 produced = 0;
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (produced == out->size()) {
+            if (expectedSize >= 0 || out->size() > std::numeric_limits<int>::max() / 2) {
+                break;
+            }
+            out->resize(out->size() * 2);
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(out->data() + produced);
+        stream.avail_out = uInt(out->size() - produced);
+        status = inflate(&stream, Z_NO_FLUSH);
+        produced = out->size() - qint64(stream.avail_out);
+    }
+    inflateEnd(&stream);
+
+    if (status != Z_STREAM_END || (expectedSize >= 0 && produced != expectedSize)) {
+        return false;
+    }
+    out->resize(int(produced));
+    return true;
+}
+#endif
+
+bool readDeltaSize(const uchar *&p, const uchar *end, quint64 *value)
+{
+    *value = 0;
+    int shift = 0;
+    do {
+        if (p == end || shift > 63) {
+            return false;
+        }
+        *value |= quint64(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return true;
+}
+
+// Rebuilds an object from its base and a git delta: a sequence of copy
+// (from the base) and insert (literal bytes) instructions
+bool applyDelta(const QByteArray &base, const QByteArray &delta, QByteArray *out)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(delta.constData());
+    const uchar *end = p + delta.size();
+
+    quint64 baseSize, resultSize;
+    if (!readDeltaSize(p, end, &baseSize) || baseSize != quint64(base.size())
+        || !readDeltaSize(p, end, &resultSize) || resultSize > quint64(std::numeric_limits<int>::max())) {
+        return false;
+    }
+
+    out->resize(int(resultSize));
+    char *dst = out->data();
+    char *dstEnd = dst + resultSize;
+
+    while (p < end) {
+        uchar op = *p++;
+        if (op & 0x80) {
+            quint32 offset = 0;
+            quint32 size = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (op & (1 << i)) {
+                    if (p == end) {
+                        return false;
+                    }
+                    offset |= quint32(*p++) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (op & (0x10 << i)) {
+                    if (p == end) {
+                        return false;
+                    }
+                    size |= quint32(*p++) << (8 * i);
+                }
+            }
+            if (size == 0) {
+                size = 0x10000;
+            }
+            if (quint64(offset) + size > quint64(base.size()) || size > quint64(dstEnd - dst)) {
+                return false;
+            }
+            std::memcpy(dst, base.constData() + offset, size);
+            dst += size;
+        } else if (op != 0) {
+            if (op > end - p || op > dstEnd - dst) {
+                return false;
+            }
+            std::memcpy(dst, p, op);
+            p += op;
+            dst += op;
+        } else {
+            return false;   // Reserved
+        }
+    }
+    return dst == dstEnd;
+}
+
+QByteArray readSmallFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+} // namespace
+
+GitRepository::GitRepository(const QString &path)
+    : path(path)
+    , baseCacheBytes(0)
+{
+}
+
+GitRepository::~GitRepository()
+{
+    for (Pack &pack : packs) {
+        pack.packFile->unmap(const_cast<uchar *>(pack.pack));
+        pack.indexFile->unmap(const_cast<uchar *>(pack.index));
+    }
+}
+
+bool GitRepository::open()
+{
+#ifndef HAVE_ZLIB
+    error = "Reading git repositories requires zlib support";
+    return false;
+#endif
+
+    // A work tree has .git as a directory, or as a file pointing elsewhere
+    // (linked work trees, submodules); otherwise path is the git directory
+    QFileInfo dotGit(path + "/.git");
+    if (dotGit.isDir()) {
+        gitDir = dotGit.absoluteFilePath();
+    } else if (dotGit.isFile()) {
+        QByteArray link = readSmallFile(dotGit.absoluteFilePath());
+        if (!link.startsWith("gitdir:")) {
+            error = QString("Unrecognised .git file in %1").arg(path);
+            return false;
+        }
+        gitDir = QDir(path).absoluteFilePath(QFile::decodeName(link.mid(7).trimmed()));
+    } else {
+        gitDir = QFileInfo(path).absoluteFilePath();
+    }
+
+    QByteArray common = readSmallFile(gitDir + "/commondir");
+    commonDir = common.isEmpty() ? gitDir : QDir(gitDir).absoluteFilePath(QFile::decodeName(common));
+
+    if (!QFileInfo(commonDir + "/objects").isDir() || !QFileInfo::exists(gitDir + "/HEAD")) {
+        error = QString("Not a git repository: %1").arg(path);
+        return false;
+    }
+
+    return addObjectDir(commonDir + "/objects", 0);
+}
+
+bool GitRepository::addObjectDir(const QString &dir, int depth)
+{
+    const QString objects = QDir::cleanPath(QDir(dir).absolutePath());
+    if (objectDirs.contains(objects)) {
+        return true;
+    }
+    if (!QFileInfo(objects).isDir()) {
+        error = QString("Alternate object directory not found: %1").arg(objects);
+        return false;
+    }
+    objectDirs.append(objects);
+
+    QDir packDir(objects + "/pack");
+    const QStringList indexes = packDir.entryList(QStringList() << "*.idx", QDir::Files);
+    for (const QString &index : indexes) {
+        if (!openPack(packDir.absoluteFilePath(index))) {
+            return false;
+        }
+    }
+
+    // One directory per line, absolute or relative to this one
+    const QList<QByteArray> alternates = readSmallFile(objects + "/info/alternates").split('\n');
+    for (const QByteArray &entry : alternates) {
+        const QByteArray line = entry.trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        if (line.startsWith('"')) {
+            error = QString("Quoted paths in %1/info/alternates are not supported").arg(objects);
+            return false;
+        }
+        if (depth >= kMaxAlternateDepth) {
+            error = QString("Alternate object directories nested too deeply in %1").arg(objects);
+            return false;
+        }
+        if (!addObjectDir(QDir(objects).absoluteFilePath(QFile::decodeName(line)), depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GitRepository::openPack(const QString &indexPath)
+{
+    Pack pack;
+    pack.objectCount = 0;
+    pack.indexFile.reset(new QFile(indexPath));
+    QString packPath = indexPath.left(indexPath.size() - 4) + ".pack";
+    pack.packFile.reset(new QFile(packPath));
+
+    if (!pack.indexFile->open(QIODevice::ReadOnly) || !pack.packFile->open(QIODevice::ReadOnly)) {
+        // An index without its pack is a leftover from an interrupted fetch
+        return true;
+    }
+
+    pack.indexSize = pack.indexFile->size();
+    pack.packSize = pack.packFile->size();
+    if (pack.indexSize < kIndexHeaderSize + 2 * kIdSize || pack.packSize < 12 + kIdSize) {
+        error = QString("Corrupt pack %1").arg(packPath);
+        return false;
+    }
+
+    pack.index = pack.indexFile->map(0, pack.indexSize);
+    pack.pack = pack.packFile->map(0, pack.packSize);
+    if (!pack.index || !pack.pack) {
+        error = QString("Cannot map pack %1").arg(packPath);
+        if (pack.index) {
+            pack.indexFile->unmap(const_cast<uchar *>(pack.index));
+        }
+        if (pack.pack) {
+            pack.packFile->unmap(const_cast<uchar *>(pack.pack));
+        }
+        return false;
+    }
+
+    // Registered before validation so the destructor unmaps it either way
+    packs.push_back(std::move(pack));
+    const Pack &added = packs.back();
+
+    if (read32(added.index) != kIndexSignature || read32(added.index + 4) != kIndexVersion) {
+        error = QString("Unsupported pack index %1").arg(indexPath);
+        return false;
+    }
+    if (std::memcmp(added.pack, "PACK", 4) != 0) {
+        error = QString("Corrupt pack %1").arg(packPath);
+        return false;
+    }
+
+    // Names, CRCs and 32-bit offsets; large offsets follow
+    quint32 count = read32(added.index + kIndexHeaderSize - 4);
+    if (kIndexHeaderSize + qint64(count) * (kIdSize + 8) + 2 * kIdSize > added.indexSize) {
+        error = QString("Corrupt pack index %1").arg(indexPath);
+        return false;
+    }
+    packs.back().objectCount = count;
+    return true;
+}
+
+bool GitRepository::findPacked(const ObjectId &id, int *packIndex, qint64 *offset) const
+{
+    const uchar *key = reinterpret_cast<const uchar *>(id.constData());
+    for (int i = 0; i < int(packs.size()); ++i) {
+        const Pack &pack = packs[i];
+        const uchar *fanout = pack.index + 8;
+        quint32 lo = key[0] == 0 ? 0 : read32(fanout + (key[0] - 1) * 4);
+        quint32 hi = read32(fanout + key[0] * 4);
+        if (hi > pack.objectCount) {
+            return false;
+        }
+
+        const uchar *names = pack.index + kIndexHeaderSize;
+        while (lo < hi) {
+            quint32 mid = lo + (hi - lo) / 2;
+            int order = std::memcmp(names + qint64(mid) * kIdSize, key, kIdSize);
+            if (order < 0) {
+                lo = mid + 1;
+            } else if (order > 0) {
+                hi = mid;
+            } else {
+                const uchar *offsets = names + qint64(pack.objectCount) * (kIdSize + 4);
+                quint32 small = read32(offsets + qint64(mid) * 4);
+                if (small & 0x80000000) {
+                    const uchar *large = offsets + qint64(pack.objectCount) * 4 + qint64(small & 0x7fffffff) * 8;
+                    if (large + 8 > pack.index + pack.indexSize) {
+                        return false;
+                    }
+                    *offset = qint64(read64(large));
+                } else {
+                    *offset = small;
+                }
+                *packIndex = i;
+                return *offset >= kPackHeaderSize && *offset < pack.packSize - kIdSize;
+            }
+        }
+    }
+    return false;
+}
+
+bool GitRepository::readObject(const ObjectId &id, ObjectType *type, QByteArray *data) const
+{
+    if (id.size() != kIdSize) {
+        return false;
+    }
+
+    int pack;
+    qint64 offset;
+    if (findPacked(id, &pack, &offset)) {
+        return readPacked(pack, offset, type, data);
+    }
+    return readLoose(id, type, data);
+}
+
+bool GitRepository::readLoose(const ObjectId &id, ObjectType *type, QByteArray *data) const
+{
+#ifdef HAVE_ZLIB
+    QString hex = toHex(id);
+    QFile file;
+    for (const QString &dir : objectDirs) {
+        file.setFileName(dir + "/" + hex.left(2) + "/" + hex.mid(2));
+        if (file.open(QIODevice::ReadOnly)) {
+            break;
+        }
+    }
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    QByteArray compressed = file.readAll();
+    QByteArray raw;
+    if (!inflateStream(reinterpret_cast<const uchar *>(compressed.constData()), compressed.size(), -1, &raw)) {
+        return false;
+    }
+
+    // "<type> <size>\0<content>"
+    int space = raw.indexOf(' ');
+    int nul = raw.indexOf('\0');
+    if (space < 0 || nul < space) {
+        return false;
+    }
+
+    QByteArray typeName = raw.left(space);
+    if (typeName == "blob") {
+        *type = Blob;
+    } else if (typeName == "tree") {
+        *type = Tree;
+    } else if (typeName == "commit") {
+        *type = Commit;
+    } else if (typeName == "tag") {
+        *type = Tag;
+    } else {
+        return false;
+    }
+
+    bool ok = false;
+    qint64 size = raw.mid(space + 1, nul - space - 1).toLongLong(&ok);
+    if (!ok || size != raw.size() - nul - 1) {
+        return false;
+    }
+    *data = raw.mid(nul + 1);
+    return true;
+#else
+    Q_UNUSED(id);
+    Q_UNUSED(type);
+    Q_UNUSED(data);
+    return false;
+#endif
+}
+
+bool GitRepository::readPacked(int packIndex, qint64 offset, ObjectType *type, QByteArray *data) const
+{
+#ifdef HAVE_ZLIB
+    // Deltas are collected down to a whole object, a cached base or a loose
+    // one, then applied on the way back up, so deep chains need no recursion
+    struct Delta {
+        int pack;
+        qint64 offset;
+        const uchar *payload;
+        qint64 available;
+        qint64 size;
+    };
+    QVector<Delta> chain;
+    ObjectType baseType;
+    QByteArray base;
+    while (true) {
+        if (!chain.isEmpty()) {
+            const QPair<int, qint64> key(packIndex, offset);
+            QMutexLocker locker(&cacheMutex);
+            auto it = baseCache.constFind(key);
+            if (it != baseCache.constEnd()) {
+                baseType = it->type;
+                base = it->data;
+                break;
+            }
+        }
+        if (chain.size() > kMaxDeltaDepth) {
+            return false;
+        }
+
+        const Pack &pack = packs[packIndex];
+        const uchar *p = pack.pack + offset;
+        const uchar *end = pack.pack + pack.packSize - kIdSize;
+        if (p >= end) {
+            return false;
+        }
+
+        // Type in bits 4-6 of the first byte, size as a little-endian varint
+        uchar c = *p++;
+        int entryType = (c >> 4) & 7;
+        quint64 size = c & 15;
+        int shift = 4;
+        while (c & 0x80) {
+            if (p == end || shift > 60) {
+                return false;
+            }
+            c = *p++;
+            size |= quint64(c & 0x7f) << shift;
+            shift += 7;
+        }
+
+        if (entryType >= Commit && entryType <= Tag) {
+            baseType = ObjectType(entryType);
+            if (!inflateStream(p, end - p, qint64(size), &base)) {
+                return false;
+            }
+            if (!chain.isEmpty()) {
+                cacheBase(packIndex, offset, baseType, base);
+            }
+            break;
+        }
+
+        Delta delta;
+        delta.pack = packIndex;
+        delta.offset = offset;
+        delta.size = qint64(size);
+        if (entryType == OfsDelta) {
+            // Distance back to the base, in git's offset encoding
+            if (p == end) {
+                return false;
+            }
+            c = *p++;
+            quint64 distance = c & 0x7f;
+            while (c & 0x80) {
+                if (p == end || distance > (quint64(1) << 56)) {
+                    return false;
+                }
+                c = *p++;
+                distance = ((distance + 1) << 7) | (c & 0x7f);
+            }
+            if (distance == 0 || distance > quint64(offset - kPackHeaderSize)) {
+                return false;
+            }
+            delta.payload = p;
+            delta.available = end - p;
+            chain.append(delta);
+            offset -= qint64(distance);
+        } else if (entryType == RefDelta) {
+            if (end - p < kIdSize) {
+                return false;
+            }
+            ObjectId baseId(reinterpret_cast<const char *>(p), kIdSize);
+            p += kIdSize;
+            delta.payload = p;
+            delta.available = end - p;
+            chain.append(delta);
+            if (!findPacked(baseId, &packIndex, &offset)) {
+                if (!readLoose(baseId, &baseType, &base)) {
+                    return false;
+                }
+                break;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    for (int i = int(chain.size()) - 1; i >= 0; --i) {
+        const Delta &link = chain[i];
+        QByteArray delta;
+        QByteArray object;
+        if (!inflateStream(link.payload, link.available, link.size, &delta)
+            || !applyDelta(base, delta, &object)) {
+            return false;
+        }
+        if (i > 0) {
+            cacheBase(link.pack, link.offset, baseType, object);
+        }
+        base = object;
+    }
+    *type = baseType;
+    *data = base;
+    return true;
+#else
+    Q_UNUSED(packIndex);
+    Q_UNUSED(offset);
+    Q_UNUSED(type);
+    Q_UNUSED(data);
+    return false;
+#endif
+}
+
+void GitRepository::cacheBase(int packIndex, qint64 offset, ObjectType type, const QByteArray &data) const
+{
+    const QPair<int, qint64> key(packIndex, offset);
+    QMutexLocker locker(&cacheMutex);
+    if (baseCacheBytes + data.size() > kMaxCachedBaseBytes) {
+        baseCache.clear();
+        baseCacheBytes = 0;
+    }
+    if (data.size() <= kMaxCachedBaseBytes / 4) {
+        baseCache.insert(key, { type, data });
+        baseCacheBytes += data.size();
+    }
+}
+
+bool GitRepository::readTree(const ObjectId &id, QVector<TreeEntry> *entries) const
+{
+    ObjectType type;
+    QByteArray data;
+    if (!readObject(id, &type, &data) || type != Tree) {
+        return false;
+    }
+
+    // "<octal mode> <name>\0<20-byte id>" per entry
+    const char *p = data.constData();
+    const char *end = p + data.size();
+    while (p < end) {
+        TreeEntry entry;
+        entry.mode = 0;
+        while (p < end && *p >= '0' && *p <= '7') {
+            entry.mode = entry.mode * 8 + quint32(*p++ - '0');
+        }
+        if (p == end || *p++ != ' ') {
+            return false;
+        }
+
+        const char *nul = static_cast<const char *>(std::memchr(p, '\0', size_t(end - p)));
+        if (!nul || end - nul - 1 < kIdSize) {
+            return false;
+        }
+        entry.name = QByteArray(p, int(nul - p));
+        entry.id = QByteArray(nul + 1, kIdSize);
+        p = nul + 1 + kIdSize;
+        entries->append(entry);
+    }
+    return true;
+}
+
+GitRepository::ObjectId GitRepository::resolveRef(const QString &name, int depth) const
+{
+    if (depth > kMaxRefDepth) {
+        return ObjectId();
+    }
+
+    // HEAD and per-work-tree refs live in the git directory, shared refs in
+    // the common directory; packed refs only in the latter
+    QByteArray content = readSmallFile(gitDir + "/" + name);
+    if (content.isEmpty() && commonDir != gitDir) {
+        content = readSmallFile(commonDir + "/" + name);
+    }
+    if (content.startsWith("ref:")) {
+        return resolveRef(QString::fromUtf8(content.mid(4).trimmed()), depth + 1);
+    }
+    if (content.size() >= 2 * kIdSize) {
+        return fromHex(content.left(2 * kIdSize));
+    }
+
+    QFile packedRefs(commonDir + "/packed-refs");
+    if (!packedRefs.open(QIODevice::ReadOnly)) {
+        return ObjectId();
+    }
+    const QByteArray wanted = name.toUtf8();
+    while (!packedRefs.atEnd()) {
+        QByteArray line = packedRefs.readLine().trimmed();
+        if (line.startsWith('#') || line.startsWith('^') || line.size() <= 2 * kIdSize) {
+            continue;
+        }
+        if (line.mid(2 * kIdSize + 1) == wanted) {
+            return fromHex(line.left(2 * kIdSize));
+        }
+    }
+    return ObjectId();
+}
+
+GitRepository::ObjectId GitRepository::resolveAbbreviated(const QByteArray &hex) const
+{
+    QSet<QByteArray> matches;
+    const QByteArray prefix = hex.toLower();
+
+    // Only the fan-out bucket of the first byte can contain matches
+    uchar first = uchar(QByteArray::fromHex(prefix.left(2))[0]);
+    for (const Pack &pack : packs) {
+        const uchar *fanout = pack.index + 8;
+        quint32 begin = first == 0 ? 0 : read32(fanout + (first - 1) * 4);
+        quint32 end = read32(fanout + first * 4);
+        const char *names = reinterpret_cast<const char *>(pack.index + kIndexHeaderSize);
+        for (quint32 i = begin; i < end; ++i) {
+            QByteArray id(names + qint64(i) * kIdSize, kIdSize);
+            if (id.toHex().startsWith(prefix)) {
+                matches.insert(id);
+            }
+        }
+    }
+
+    for (const QString &dir : objectDirs) {
+        QDir looseDir(dir + "/" + QString::fromLatin1(prefix.left(2)));
+        const QStringList loose = looseDir.entryList(QStringList() << QString::fromLatin1(prefix.mid(2)) + "*",
+                                                     QDir::Files);
+        for (const QString &rest : loose) {
+            matches.insert(fromHex(prefix.left(2) + rest.toLatin1()));
+        }
+    }
+
+    return matches.size() == 1 ? *matches.begin() : ObjectId();
+}
+
+GitRepository::ObjectId GitRepository::resolveTree(const QString &revision)
+{
+    const QByteArray hex = revision.toLatin1();
+    ObjectId id;
+    if (hex.size() == 2 * kIdSize && isHex(hex)) {
+        id = fromHex(hex);
+    }
+
+    // Same search order as git rev-parse
+    const QStringList candidates = QStringList()
+        << revision << "refs/" + revision << "refs/tags/" + revision << "refs/heads/" + revision
+        << "refs/remotes/" + revision << "refs/remotes/" + revision + "/HEAD";
+    for (int i = 0; id.isEmpty() && i < candidates.size(); ++i) {
+        id = resolveRef(candidates[i]);
+    }
+
+    if (id.isEmpty() && hex.size() >= 4 && hex.size() < 2 * kIdSize && isHex(hex)) {
+        id = resolveAbbreviated(hex);
+    }
+    if (id.isEmpty()) {
+        error = QString("Unknown or ambiguous revision: %1").arg(revision);
+        return ObjectId();
+    }
+
+    // Annotated tags point at commits, commits at their root tree
+    for (int depth = 0; depth < kMaxRefDepth; ++depth) {
+        ObjectType type;
+        QByteArray data;
+        if (!readObject(id, &type, &data)) {
+            error = QString("Cannot read object %1").arg(toHex(id));
+            return ObjectId();
+        }
+
+        if (type == Tree) {
+            return id;
+        }
+        QByteArray field = type == Commit ? "tree " : type == Tag ? "object " : QByteArray();
+        if (field.isEmpty() || !data.startsWith(field)) {
+            break;
+        }
+        id = fromHex(data.mid(field.size(), 2 * kIdSize));
+    }
+
+    error = QString("%1 does not name a commit or tree").arg(revision);
+    return ObjectId();
+}
+
+QString GitRepository::toHex(const ObjectId &id)
+{
+    return QString::fromLatin1(id.toHex());
+}
+
+GitRepository::ObjectId GitRepository::fromHex(const QByteArray &hex)
+{
+    if (hex.size() != 2 * kIdSize || !isHex(hex)) {
+        return ObjectId();
+    }
+    return QByteArray::fromHex(hex);
+}
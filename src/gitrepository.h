@@ -0,0 +1,94 @@
+#ifndef GITREPOSITORY_H
+#define GITREPOSITORY_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// Read-only access to the object store of a local git repository.
+//
+// Loose objects are inflated from objects/xx/..., packed objects are looked
+// up through the version 2 pack index and read from the memory-mapped pack,
+// with offset and reference deltas resolved against their bases. Object
+// directories listed in objects/info/alternates (shared clones) are searched
+// after the repository's own. Only the
+// objects asked for are read; nothing is checked out. Reading objects is
+// safe from several threads once open() has returned.
+class GitRepository
+{
+public:
+    enum ObjectType { None = 0, Commit = 1, Tree = 2, Blob = 3, Tag = 4 };
+
+    typedef QByteArray ObjectId;    // 20 raw SHA-1 bytes
+
+    struct TreeEntry {
+        QByteArray name;
+        quint32 mode;
+        ObjectId id;
+
+        bool isTree() const { return mode == 040000; }
+    };
+
+    // path: a work tree, or the .git directory itself
+    explicit GitRepository(const QString &path);
+    ~GitRepository();
+
+    bool open();
+    QString errorString() const { return error; }
+
+    // Accepts a full or abbreviated hex id, HEAD, a branch, a tag or a full
+    // ref name, and peels tags and commits down to the root tree
+    ObjectId resolveTree(const QString &revision);
+
+    bool readObject(const ObjectId &id, ObjectType *type, QByteArray *data) const;
+    // Entries in the order git stores them
+    bool readTree(const ObjectId &id, QVector<TreeEntry> *entries) const;
+
+    static QString toHex(const ObjectId &id);
+    static ObjectId fromHex(const QByteArray &hex);
+
+private:
+    struct Pack {
+        std::unique_ptr<QFile> packFile;
+        std::unique_ptr<QFile> indexFile;
+        const uchar *pack;
+        qint64 packSize;
+        const uchar *index;
+        qint64 indexSize;
+        quint32 objectCount;
+    };
+
+    bool addObjectDir(const QString &dir, int depth);
+    bool openPack(const QString &indexPath);
+    bool findPacked(const ObjectId &id, int *pack, qint64 *offset) const;
+    bool readPacked(int pack, qint64 offset, ObjectType *type, QByteArray *data) const;
+    void cacheBase(int pack, qint64 offset, ObjectType type, const QByteArray &data) const;
+    bool readLoose(const ObjectId &id, ObjectType *type, QByteArray *data) const;
+    ObjectId resolveRef(const QString &name, int depth = 0) const;
+    ObjectId resolveAbbreviated(const QByteArray &hex) const;
+
+    QString path;
+    QString gitDir;
+    QString commonDir;      // Differs from gitDir in linked work trees
+    QStringList objectDirs; // objects, then its alternates
+    std::vector<Pack> packs;
+    QString error;
+
+    // Delta bases are often shared by many objects of one tree
+    struct CachedBase {
+        ObjectType type;
+        QByteArray data;
+    };
+    mutable QMutex cacheMutex;
+    mutable QHash<QPair<int, qint64>, CachedBase> baseCache;
+    mutable qint64 baseCacheBytes;
+};
+
+#endif // GITREPOSITORY_H
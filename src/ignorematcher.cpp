@@ -0,0 +1,295 @@
+#include "ignorematcher.h"
+#include <QFile>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+bool hasWildcards(const QByteArray &pattern, int from = 0)
+{
+    for (int i = from; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '*' || c == '?' || c == '[' || c == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bracket expression at p (just after '['); advances p past the closing ']'
+bool matchClass(const char *&p, const char *pe, char c)
+{
+    bool negate = p < pe && (*p == '!' || *p == '^');
+    if (negate) {
+        ++p;
+    }
+
+    bool matched = false;
+    bool first = true;
+    while (p < pe && (first || *p != ']')) {
+        first = false;
+        char low = *p == '\\' && p + 1 < pe ? *++p : *p;
+        ++p;
+        char high = low;
+        if (p + 1 < pe && *p == '-' && p[1] != ']') {
+            high = p[1] == '\\' && p + 2 < pe ? p[2] : p[1];
+            p += p[1] == '\\' ? 3 : 2;
+        }
+        if (uchar(c) >= uchar(low) && uchar(c) <= uchar(high)) {
+            matched = true;
+        }
+    }
+    if (p < pe) {
+        ++p;    // ']'
+    }
+    return matched != negate;
+}
+
+// gitignore flavoured wildmatch: '*' and '?' stop at '/', "**" as a whole
+// path segment spans any number of directories
+bool wildmatch(const char *pb, const char *p, const char *pe, const char *t, const char *te)
+{
+    while (p < pe) {
+        char c = *p;
+
+        if (c == '*') {
+            const char *q = p;
+            while (q < pe && *q == '*') {
+                ++q;
+            }
+
+            bool segmentStart = p == pb || p[-1] == '/';
+            bool segmentEnd = q == pe || *q == '/';
+            if (q - p >= 2 && segmentStart && segmentEnd) {
+                if (q == pe) {
+                    return true;    // Trailing "**": everything below
+                }
+                // "**/": zero or more whole directories
+                const char *rest = q + 1;
+                if (wildmatch(pb, rest, pe, t, te)) {
+                    return true;
+                }
+                for (const char *s = t; s < te; ++s) {
+                    if (*s == '/' && wildmatch(pb, rest, pe, s + 1, te)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Any run of characters within the current segment
+            p = q;
+            if (p == pe) {
+                return std::memchr(t, '/', size_t(te - t)) == nullptr;
+            }
+            for (const char *s = t; ; ++s) {
+                if (wildmatch(pb, p, pe, s, te)) {
+                    return true;
+                }
+                if (s == te || *s == '/') {
+                    return false;
+                }
+            }
+        }
+
+        if (t == te) {
+            return false;
+        }
+        if (c == '?') {
+            if (*t == '/') {
+                return false;
+            }
+            ++p;
+        } else if (c == '[') {
+            if (*t == '/') {
+                return false;
+            }
+            ++p;
+            if (!matchClass(p, pe, *t)) {
+                return false;
+            }
+        } else {
+            if (c == '\\' && p + 1 < pe) {
+                c = *++p;
+            }
+            if (c != *t) {
+                return false;
+            }
+            ++p;
+        }
+        ++t;
+    }
+    return t == te;
+}
+
+bool wildmatch(const QByteArray &pattern, const QByteArray &text)
+{
+    const char *p = pattern.constData();
+    const char *t = text.constData();
+    return wildmatch(p, p, p + pattern.size(), t, t + text.size());
+}
+
+} // namespace
+
+void IgnoreRules::addLines(const QByteArray &text)
+{
+    for (const QByteArray &line : text.split('\n')) {
+        addLine(line);
+    }
+}
+
+void IgnoreRules::addLine(const QByteArray &line)
+{
+    QByteArray pattern = line;
+    if (pattern.endsWith('\r')) {
+        pattern.chop(1);
+    }
+    if (pattern.isEmpty() || pattern.startsWith('#')) {
+        return;
+    }
+
+    // Trailing spaces are dropped unless escaped
+    int end = pattern.size();
+    while (end > 0 && pattern[end - 1] == ' ' && !(end > 1 && pattern[end - 2] == '\\')) {
+        --end;
+    }
+    pattern.truncate(end);
+
+    Rule rule;
+    rule.negate = pattern.startsWith('!');
+    if (rule.negate) {
+        pattern = pattern.mid(1);
+    }
+    rule.directoryOnly = pattern.endsWith('/');
+    if (rule.directoryOnly) {
+        pattern.chop(1);
+    }
+    // A slash at the start or in the middle ties the pattern to the base
+    rule.anchored = pattern.contains('/');
+    if (pattern.startsWith('/')) {
+        pattern = pattern.mid(1);
+    }
+    if (pattern.isEmpty()) {
+        return;
+    }
+
+    rule.pattern = pattern;
+    if (!hasWildcards(pattern)) {
+        rule.kind = Rule::Literal;
+    } else if (!rule.anchored && pattern.startsWith('*') && !hasWildcards(pattern, 1)) {
+        rule.kind = Rule::Suffix;
+        rule.pattern = pattern.mid(1);
+    } else {
+        rule.kind = Rule::Glob;
+    }
+
+    compile(rule);
+}
+
+void IgnoreRules::compile(Rule rule)
+{
+    if (rule.negate && !hasNegation) {
+        // Order matters from now on: move the plain names back into the list
+        hasNegation = true;
+        for (const QByteArray &name : std::as_const(names)) {
+            rules.prepend({ name, Rule::Literal, false, false, false });
+        }
+        for (const QByteArray &name : std::as_const(directoryNames)) {
+            rules.prepend({ name, Rule::Literal, false, true, false });
+        }
+        names.clear();
+        directoryNames.clear();
+    }
+
+    if (!hasNegation && rule.kind == Rule::Literal && !rule.anchored) {
+        (rule.directoryOnly ? directoryNames : names).insert(rule.pattern);
+        return;
+    }
+    rules.append(rule);
+}
+
+bool IgnoreRules::ruleMatches(const Rule &rule, const QByteArray &directory, const QByteArray &name)
+{
+    if (!rule.anchored) {
+        switch (rule.kind) {
+        case Rule::Literal:
+            return name == rule.pattern;
+        case Rule::Suffix:
+            return name.endsWith(rule.pattern);
+        default:
+            return wildmatch(rule.pattern, name);
+        }
+    }
+
+    QByteArray path = directory.isEmpty() ? name : directory + '/' + name;
+    return rule.kind == Rule::Literal ? path == rule.pattern : wildmatch(rule.pattern, path);
+}
+
+IgnoreRules::Match IgnoreRules::match(const QByteArray &directory, const QByteArray &name, bool isDirectory) const
+{
+    if (names.contains(name) || (isDirectory && directoryNames.contains(name))) {
+        return Ignored;
+    }
+
+    // The last matching rule decides
+    for (int i = rules.size() - 1; i >= 0; --i) {
+        const Rule &rule = rules[i];
+        if (rule.directoryOnly && !isDirectory) {
+            continue;
+        }
+        if (ruleMatches(rule, directory, name)) {
+            return rule.negate ? Included : Ignored;
+        }
+    }
+    return NoMatch;
+}
+
+IgnoreMatcher::IgnoreMatcher(const Ptr &parent, const QByteArray &basePath, const IgnoreRules &rules)
+    : parent(parent)
+    , basePath(basePath)
+    , rules(rules)
+{
+}
+
+IgnoreMatcher::Ptr IgnoreMatcher::create(const QStringList &userRules)
+{
+    IgnoreRules rules;
+    for (const QString &line : userRules) {
+        rules.addLine(QFile::encodeName(line));
+    }
+    return Ptr(new IgnoreMatcher(Ptr(), QByteArray(), rules));
+}
+
+IgnoreMatcher::Ptr IgnoreMatcher::withGitignore(const Ptr &parent, const QString &directoryPath,
+                                                const QByteArray &basePath)
+{
+    QFile file(directoryPath + "/.gitignore");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return parent;
+    }
+
+    IgnoreRules rules;
+    rules.addLines(file.readAll());
+    if (rules.isEmpty()) {
+        return parent;
+    }
+    return Ptr(new IgnoreMatcher(parent, basePath, rules));
+}
+
+bool IgnoreMatcher::isIgnored(const QByteArray &directory, const QByteArray &name, bool isDirectory) const
+{
+    // Innermost rules first; the first level with an opinion decides
+    for (const IgnoreMatcher *matcher = this; matcher; matcher = matcher->parent.get()) {
+        QByteArray relative = directory;
+        if (!matcher->basePath.isEmpty()) {
+            relative = directory.size() == matcher->basePath.size()
+                     ? QByteArray() : directory.mid(matcher->basePath.size() + 1);
+        }
+
+        IgnoreRules::Match match = matcher->rules.match(relative, name, isDirectory);
+        if (match != IgnoreRules::NoMatch) {
+            return match == IgnoreRules::Ignored;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,82 @@
+#ifndef IGNOREMATCHER_H
+#define IGNOREMATCHER_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+
+// One compiled set of gitignore rules: the lines of a single .gitignore
+// file, or rules given by the user.
+//
+// Supports the gitignore syntax: comments, "!" negation, trailing "/" for
+// directories only, patterns anchored by a "/" at the start or in the
+// middle, "*", "?", "[...]" and "**". Matching works on the raw file name
+// bytes. Plain names, the most common rules, are looked up in a hash set
+// whenever no negation makes their order matter.
+class IgnoreRules
+{
+public:
+    enum Match { NoMatch, Ignored, Included };
+
+    IgnoreRules() : hasNegation(false) {}
+
+    void addLine(const QByteArray &line);
+    void addLines(const QByteArray &text);
+    bool isEmpty() const { return rules.isEmpty() && names.isEmpty() && directoryNames.isEmpty(); }
+
+    // directory: path of the containing directory relative to the rules'
+    // base, empty for the base itself
+    Match match(const QByteArray &directory, const QByteArray &name, bool isDirectory) const;
+
+private:
+    struct Rule {
+        enum Kind { Literal, Suffix, Glob };
+
+        QByteArray pattern;
+        Kind kind;
+        bool negate;
+        bool directoryOnly;
+        bool anchored;      // Matched against the whole path, not just the name
+    };
+
+    static bool ruleMatches(const Rule &rule, const QByteArray &directory, const QByteArray &name);
+    void compile(Rule rule);
+
+    // In file order; evaluated last to first
+    QVector<Rule> rules;
+    // Plain unanchored names, used while there are no negations
+    QSet<QByteArray> names;
+    QSet<QByteArray> directoryNames;
+    bool hasNegation;
+};
+
+// The rules in effect for one directory: its own .gitignore, if any, in
+// front of those of its ancestors. Deeper rules take precedence, as in git.
+// Matchers are immutable and shared by all directories below them that add
+// no rules of their own.
+class IgnoreMatcher
+{
+public:
+    typedef std::shared_ptr<const IgnoreMatcher> Ptr;
+
+    // Root of a chain; userRules apply relative to the compared folder
+    static Ptr create(const QStringList &userRules);
+    // Adds the .gitignore of basePath (relative to the root), or returns
+    // parent itself when there is none
+    static Ptr withGitignore(const Ptr &parent, const QString &directoryPath, const QByteArray &basePath);
+
+    // directory: path of the containing directory relative to the root
+    bool isIgnored(const QByteArray &directory, const QByteArray &name, bool isDirectory) const;
+
+private:
+    IgnoreMatcher(const Ptr &parent, const QByteArray &basePath, const IgnoreRules &rules);
+
+    Ptr parent;
+    QByteArray basePath;
+    IgnoreRules rules;
+};
+
+#endif // IGNOREMATCHER_H
@@ -0,0 +1,333 @@
+#include "largefilediff.h"
+#include "fasthash.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Peak per line while interning: a hash, its copy in the sorted table and
+// the ID. The Myers pass needs less (ID plus two search vector entries).
+const qint64 kBytesPerLine = 20;
+
+// Myers indexes its search vectors with int
+const qint64 kMaxLines = 1000 * 1000 * 1000;
+
+class EditBuffer : public DiffEngine::EditSink
+{
+public:
+    explicit EditBuffer(qint64 budget) : edits(budget) {}
+    void append(const DiffEngine::Edit &edit) override { edits.append(edit); }
+
+    SpillBuffer<DiffEngine::Edit> edits;
+};
+
+bool isUtf16(TextDecoder::Encoding encoding)
+{
+    return encoding == TextDecoder::Utf16LE || encoding == TextDecoder::Utf16BE;
+}
+
+// Bytes per code unit
+qint64 unitSize(TextDecoder::Encoding encoding)
+{
+    return isUtf16(encoding) ? 2 : 1;
+}
+
+// Offset of the first '\n' unit at or after from, which is on a unit
+// boundary, or -1. In UTF-16 a 0x0A byte may belong to another character;
+// only one that makes a whole '\n' unit counts.
+qint64 findNewline(const char *data, qint64 from, qint64 size, TextDecoder::Encoding encoding)
+{
+    // Position of the 0x0A byte inside a '\n' unit
+    const qint64 low = encoding == TextDecoder::Utf16BE ? 1 : 0;
+    qint64 pos = from;
+    while (pos < size) {
+        const char *hit = static_cast<const char *>(std::memchr(data + pos, '\n', size_t(size - pos)));
+        if (!hit) {
+            return -1;
+        }
+        const qint64 at = hit - data;
+        if (!isUtf16(encoding)) {
+            return at;
+        }
+        const qint64 unit = at - ((at - from) & 1);
+        if (at - unit == low && unit + 1 < size && data[unit + 1 - low] == 0) {
+            return unit;
+        }
+        pos = at + 1;
+    }
+    return -1;
+}
+
+// Whether the unit before end, inside [start, end), is a CR
+bool endsWithCr(const char *data, qint64 start, qint64 end, TextDecoder::Encoding encoding)
+{
+    if (!isUtf16(encoding)) {
+        return end > start && data[end - 1] == '\r';
+    }
+    if (end - start < 2) {
+        return false;
+    }
+    const char first = data[end - 2];
+    const char second = data[end - 1];
+    return encoding == TextDecoder::Utf16LE ? first == '\r' && second == 0 : first == 0 && second == '\r';
+}
+
+qint64 countLines(const char *data, qint64 start, qint64 size, TextDecoder::Encoding encoding)
+{
+    qint64 lines = 1;
+    for (qint64 pos = findNewline(data, start, size, encoding); pos >= 0;
+         pos = findNewline(data, pos + unitSize(encoding), size, encoding)) {
+        ++lines;
+    }
+    return lines;
+}
+
+// Same split as DiffEngine::computeDiff(): at every '\n', keeping the
+// segment after the last one. A CR before the break is not hashed.
+void hashLines(const char *data, qint64 start, qint64 size, TextDecoder::Encoding encoding,
+               SpillBuffer<qint64> &offsets, quint64 *hashes)
+{
+    const qint64 unit = unitSize(encoding);
+    qint64 line = 0;
+    while (true) {
+        const qint64 newline = findNewline(data, start, size, encoding);
+        const qint64 end = newline >= 0 ? newline : size;
+        qint64 length = end - start;
+        if (endsWithCr(data, start, end, encoding)) {
+            length -= unit;
+        }
+
+        offsets.append(start);
+        hashes[line++] = FastHash::hash(data + start, length);
+
+        if (newline < 0) {
+            break;
+        }
+        start = end + unit;
+    }
+    offsets.append(size + unit);
+}
+
+} // namespace
+
+LargeFileDiff::LargeFileDiff(qint64 memoryBudget)
+    : budget(memoryBudget)
+    , side1(memoryBudget / 8)
+    , side2(memoryBudget / 8)
+    , hunks(memoryBudget / 8)
+{
+}
+
+QString LargeFileDiff::errorString() const
+{
+    return error;
+}
+
+bool LargeFileDiff::mapFile(Side &side, const QString &filePath)
+{
+    side.file.setFileName(filePath);
+    if (!side.file.open(QIODevice::ReadOnly)) {
+        error = QString("Cannot open %1: %2").arg(filePath).arg(side.file.errorString());
+        return false;
+    }
+    side.size = side.file.size();
+    if (side.size == 0) {
+        return true;
+    }
+    side.data = reinterpret_cast<const char *>(side.file.map(0, side.size));
+    if (!side.data) {
+        error = QString("Cannot map %1: %2").arg(filePath).arg(side.file.errorString());
+        return false;
+    }
+    side.encoding = TextDecoder::detect(side.data, side.size, &side.textStart);
+    return true;
+}
+
+bool LargeFileDiff::compare(const QString &file1, const QString &file2, const std::function<bool()> &cancelled)
+{
+    TraceScope trace("largeFileDiff");
+    auto stop = [&]() {
+        if (cancelled && cancelled()) {
+            error = QString("Comparison cancelled");
+            return true;
+        }
+        return false;
+    };
+
+    if (!mapFile(side1, file1) || !mapFile(side2, file2) || stop()) {
+        return false;
+    }
+
+    // Counting first sizes every array exactly
+    const qint64 lines1 = countLines(side1.data, side1.textStart, side1.size, side1.encoding);
+    const qint64 lines2 = countLines(side2.data, side2.textStart, side2.size, side2.encoding);
+    const qint64 total = lines1 + lines2;
+    trace.arg("lines", total);
+    if (total > kMaxLines) {
+        error = QString("Too many lines to compare (%1)").arg(total);
+        return false;
+    }
+    // Half of the budget goes to the line IDs, half to the spill buffers
+    const qint64 needed = total * kBytesPerLine;
+    if (needed > budget / 2) {
+        error = QString("The line index needs about %1 MiB; raise the memory budget to at least %2 MiB")
+                    .arg(needed >> 20).arg((2 * needed >> 20) + 1);
+        return false;
+    }
+
+    // Equal 64-bit hashes are taken as equal lines; the sorted distinct
+    // hashes turn them into dense IDs for the diff
+    QVector<int> ids(total);
+    {
+        TraceScope internTrace("internLines");
+        QVector<quint64> hashes(total);
+        hashLines(side1.data, side1.textStart, side1.size, side1.encoding, side1.offsets, hashes.data());
+        if (stop()) {
+            return false;
+        }
+        hashLines(side2.data, side2.textStart, side2.size, side2.encoding, side2.offsets, hashes.data() + lines1);
+        if (stop()) {
+            return false;
+        }
+        if (!side1.offsets.finish() || !side2.offsets.finish()) {
+            error = QString("Cannot write temporary files");
+            return false;
+        }
+
+        QVector<quint64> distinct = hashes;
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+        for (qint64 i = 0; i < total; ++i) {
+            ids[i] = int(std::lower_bound(distinct.constBegin(), distinct.constEnd(), hashes[i]) - distinct.constBegin());
+        }
+        internTrace.arg("distinct", distinct.size());
+    }
+    if (stop()) {
+        return false;
+    }
+
+    EditBuffer buffer(budget / 8);
+    DiffEngine::diffSequences(ids.constData(), int(lines1), ids.constData() + lines1, int(lines2), buffer);
+    ids = QVector<int>();
+    if (stop()) {
+        return false;
+    }
+    if (!buffer.edits.finish()) {
+        error = QString("Cannot write temporary files");
+        return false;
+    }
+
+    // Same pairing as DiffEngine::editsToHunks(), in lines
+    const SpillBuffer<DiffEngine::Edit> &edits = buffer.edits;
+    qint64 k = 0;
+    while (k < edits.size()) {
+        DiffEngine::Edit edit = edits.at(k);
+        if (edit.type == DiffEngine::Edit::Equal) {
+            ++k;
+            continue;
+        }
+
+        qint64 i0 = edit.pos1, i1 = i0;
+        qint64 j0 = edit.pos2, j1 = j0;
+        for (; k < edits.size() && (edit = edits.at(k)).type != DiffEngine::Edit::Equal; ++k) {
+            if (edit.type == DiffEngine::Edit::Delete) {
+                i1 = qint64(edit.pos1) + edit.length;
+            } else {
+                j1 = qint64(edit.pos2) + edit.length;
+            }
+        }
+        appendHunks(i0, i1, j0, j1);
+    }
+    if (!hunks.finish()) {
+        error = QString("Cannot write temporary files");
+        return false;
+    }
+
+    trace.arg("hunks", hunks.size());
+    return true;
+}
+
+void LargeFileDiff::appendHunks(qint64 i0, qint64 i1, qint64 j0, qint64 j1)
+{
+    const qint64 common = qMin(i1 - i0, j1 - j0);
+    if (common > 0) {
+        hunks.append({ DiffHunk::Modified, i0, i0 + common, j0, j0 + common });
+    }
+    if (i1 - i0 > common) {
+        hunks.append({ DiffHunk::Deleted, i0 + common, i1, j1, j1 });
+    } else if (j1 - j0 > common) {
+        hunks.append({ DiffHunk::Added, i1, i1, j0 + common, j1 });
+    }
+}
+
+qint64 LargeFileDiff::lineCount(int side) const
+{
+    return (side == 1 ? side1 : side2).offsets.size() - 1;
+}
+
+qint64 LargeFileDiff::hunkCount() const
+{
+    return hunks.size();
+}
+
+LineHunk LargeFileDiff::hunk(qint64 index) const
+{
+    return hunks.at(index);
+}
+
+qint64 LargeFileDiff::lineLength(const Side &s, qint64 index, qint64 *start) const
+{
+    const qint64 unit = unitSize(s.encoding);
+    *start = s.offsets.at(index);
+    const qint64 end = s.offsets.at(index + 1) - unit;
+    return endsWithCr(s.data, *start, end, s.encoding) ? end - unit - *start : end - *start;
+}
+
+QString LargeFileDiff::text(int side, qint64 index, qint64 maxBytes) const
+{
+    const Side &s = side == 1 ? side1 : side2;
+    qint64 start;
+    qint64 length = lineLength(s, index, &start);
+    if (maxBytes >= 0 && length > maxBytes) {
+        // Back off to a character boundary: before a UTF-8 continuation
+        // byte, or before a UTF-16 high surrogate whose pair was cut off
+        length = maxBytes;
+        if (isUtf16(s.encoding)) {
+            length &= ~qint64(1);
+            const int high = s.encoding == TextDecoder::Utf16LE ? 1 : 0;
+            if (length >= 2) {
+                const uchar top = uchar(s.data[start + length - 2 + high]);
+                if (top >= 0xD8 && top <= 0xDB) {
+                    length -= 2;
+                }
+            }
+        } else {
+            for (int i = 0; i < 3 && length > 0 && (uchar(s.data[start + length]) & 0xC0) == 0x80; ++i) {
+                --length;
+            }
+        }
+    }
+    return TextDecoder::decodeAs(s.data + start, length, s.encoding);
+}
+
+qint64 LargeFileDiff::peakResidentBytes()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,81 @@
+#ifndef LARGEFILEDIFF_H
+#define LARGEFILEDIFF_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <functional>
+#include "diffengine.h"
+#include "spillbuffer.h"
+#include "textdecoder.h"
+
+// A change as half-open line ranges, for files too large to hold as text
+struct LineHunk {
+    DiffHunk::Type type;
+    qint64 leftStart;
+    qint64 leftEnd;
+    qint64 rightStart;
+    qint64 rightEnd;
+};
+
+// Line diff of two files under a memory budget. Files are memory-mapped and
+// only their line hashes, interned to 4-byte IDs, are held for the Myers
+// pass. Line offsets, the edit script and the hunks are spill buffers that
+// move to temporary files when their share of the budget is used up, and
+// line contents are paged in from the mappings when asked for.
+//
+// Each file's encoding is detected up front as TextDecoder does. Lines are
+// split at '\n' code units of that encoding, so UTF-16 is never cut inside
+// a character, and compared by their bytes.
+class LargeFileDiff
+{
+public:
+    explicit LargeFileDiff(qint64 memoryBudget);
+
+    // False, with errorString() set, if the files cannot be read or their
+    // line IDs alone exceed the budget. cancelled, if given, is polled
+    // between the stages and ends the comparison early once it is true.
+    bool compare(const QString &file1, const QString &file2,
+                 const std::function<bool()> &cancelled = nullptr);
+    QString errorString() const;
+
+    qint64 lineCount(int side) const;
+    qint64 hunkCount() const;
+    LineHunk hunk(qint64 index) const;
+    // A line decoded, without the line break; a trailing CR is dropped as
+    // well. Past maxBytes, if given, the line is cut at the last character
+    // boundary, so the start of a huge line is cheap to show.
+    QString text(int side, qint64 index, qint64 maxBytes = -1) const;
+
+    // Peak resident set size of the process, -1 where unknown
+    static qint64 peakResidentBytes();
+
+private:
+    LargeFileDiff(const LargeFileDiff &) = delete;
+    LargeFileDiff &operator=(const LargeFileDiff &) = delete;
+
+    struct Side {
+        explicit Side(qint64 budget)
+            : data(nullptr), size(0), textStart(0), encoding(TextDecoder::Utf8), offsets(budget) {}
+
+        QFile file;
+        const char *data;
+        qint64 size;
+        qint64 textStart;               // After the byte order mark
+        TextDecoder::Encoding encoding;
+        SpillBuffer<qint64> offsets;    // Line starts plus a sentinel
+    };
+
+    qint64 lineLength(const Side &s, qint64 index, qint64 *start) const;
+
+    bool mapFile(Side &side, const QString &filePath);
+    void appendHunks(qint64 i0, qint64 i1, qint64 j0, qint64 j1);
+
+    qint64 budget;
+    QString error;
+    Side side1;
+    Side side2;
+    SpillBuffer<LineHunk> hunks;
+};
+
+#endif // LARGEFILEDIFF_H
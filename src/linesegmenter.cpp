@@ -0,0 +1,83 @@
+#include "linesegmenter.h"
+
+namespace {
+
+// About one delimiter in sixteen ends a segment, which makes segments of
+// typical minified code a few dozen characters long
+const quint32 kCutMask = 0xf;
+
+// Characters in the hash window that decides a cut
+const int kWindow = 8;
+
+// A run of one repeated character leaves the window unchanged, so its hash
+// would cut at every character or never; such runs are cut by length
+const int kRunSegment = 64;
+
+bool isDelimiter(char16_t c)
+{
+    switch (c) {
+    case ' ': case '\t': case ',': case ';': case ':': case '|':
+    case '{': case '}': case '[': case ']': case '(': case ')': case '<': case '>':
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+int LineSegmenter::segmentEnd(const QChar *text, int begin, int end)
+{
+    const int limit = qMin(end, begin + kMaxSegment);
+    // Shifting by four bits per character keeps only the last eight
+    // characters in the hash, so a cut depends on that window alone.
+    // Seeding it with the characters before begin keeps the first cuts
+    // of a segment independent of where it started
+    quint32 window = 0;
+    for (int pos = qMax(0, begin - (kWindow - 1)); pos < begin; ++pos) {
+        window = (window << 4) ^ text[pos].unicode();
+    }
+    int run = 0;
+    for (int pos = begin; pos < limit; ++pos) {
+        const char16_t c = text[pos].unicode();
+        const quint32 previous = window;
+        window = (window << 4) ^ c;
+        if (window == previous) {
+            if (++run == kRunSegment) {
+                return pos + 1;
+            }
+            continue;
+        }
+        run = 0;
+        const quint32 mix = window * 0x9e3779b1u;
+        if (isDelimiter(c) ? (mix >> 28 & kCutMask) == 0 : (mix >> 26) == 0) {
+            return pos + 1;
+        }
+    }
+    return limit;
+}
+
+QVector<int> LineSegmenter::segmentStarts(const QString &text)
+{
+    QVector<int> starts;
+    if (text.size() <= kLongLine) {
+        return starts;
+    }
+
+    const QChar *data = text.constData();
+    const int length = int(text.size());
+    int start = 0;
+    while (start <= length) {
+        int end = int(text.indexOf(QLatin1Char('\n'), start));
+        if (end < 0) {
+            end = length;
+        }
+        if (isLong(end - start)) {
+            for (int pos = segmentEnd(data, start, end); pos < end; pos = segmentEnd(data, pos, end)) {
+                starts.append(pos);
+            }
+        }
+        start = end + 1;
+    }
+    return starts;
+}
@@ -0,0 +1,36 @@
+#ifndef LINESEGMENTER_H
+#define LINESEGMENTER_H
+
+#include <QString>
+#include <QVector>
+
+// Virtual segmentation of very long lines, such as minified JSON or
+// JavaScript and CSV rows. A line longer than kLongLine characters is
+// diffed and displayed as segments instead of as one unit.
+//
+// Segments end after a delimiter (punctuation that separates tokens, or
+// whitespace) chosen by a hash of the few characters before it, so cut
+// points depend on content rather than on where the previous segment
+// began. After an edit both texts cut at the same places again within a
+// segment or two, and a one-character change stays a one-segment hunk.
+// Runs without delimiters, such as base64, are cut at any character by a
+// stricter hash test, about one in 64, and runs of one repeated character
+// every 64 characters; kMaxSegment is only a backstop.
+class LineSegmenter
+{
+public:
+    static const int kLongLine = 4096;
+    static const int kMaxSegment = 256;
+
+    static bool isLong(int lineLength) { return lineLength > kLongLine; }
+
+    // End of the segment of a long line that starts at begin; the line
+    // ends at end
+    static int segmentEnd(const QChar *text, int begin, int end);
+
+    // Offsets where a segment starts inside a long line, in order; empty
+    // if the text has no long lines
+    static QVector<int> segmentStarts(const QString &text);
+};
+
+#endif // LINESEGMENTER_H
@@ -1,14 +1,187 @@
 #include "mainwindow.h"
+#include "diffpreloader.h"
+#include "reportexporter.h"
+#include "tracer.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTextStream>
+#include <memory>
+
+namespace {
+
+// Exports run without a window and must not need a display, so this is
+// decided before the application object exists
+bool wantsExport(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (qstrncmp(argv[i], "--export-", 9) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compares two folders the way FolderView does, minus the tree, and writes
+// the report
+int exportFolders(const QString &folder1, const QString &folder2, ReportExporter &exporter)
+{
+    FolderModel model;
+    model.setRoots(folder1, folder2);
+    
+    FolderCompareEngine engine;
+    QObject::connect(&engine, &FolderCompareEngine::entriesFound, &model, &FolderModel::addEntries);
+    QObject::connect(&engine, &FolderCompareEngine::entriesCompared, &model, &FolderModel::updateEntries);
+    QObject::connect(&engine, &FolderCompareEngine::directoriesEmptied, &model, &FolderModel::clearDirectories);
+    QObject::connect(&engine, &FolderCompareEngine::renamesDetected, &model, &FolderModel::applyRenames);
+    
+    QEventLoop loop;
+    QObject::connect(&engine, &FolderCompareEngine::finished, &loop, &QEventLoop::quit);
+    engine.start(folder1, folder2);
+    if (engine.isRunning()) {
+        loop.exec();
+    }
+    model.finishLoading();
+    
+    int identical = 0;
+    const QVector<ChangedFile> files = model.changedFiles(&identical);
+    exporter.setRoots(folder1, folder2);
+    if (!exporter.run(files, identical)) {
+        qCritical("%s", qPrintable(exporter.errorString()));
+        return 1;
+    }
+    QTextStream(stdout) << "exported " << files.size() << " changed files, "
+                        << identical << " identical\n";
+    return 0;
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
-    app.setApplicationName("DiffyInAJiffy");
-    app.setApplicationVersion("1.0.0");
+    QElapsedTimer launchTimer;
+    launchTimer.start();
+    
+    // DIFFY_TRACE=<file> records stage timings and writes them there as a
+    // Chrome trace on exit
+    const QString tracePath = qEnvironmentVariable("DIFFY_TRACE");
+    if (!tracePath.isEmpty()) {
+        Tracer::enable(tracePath);
+    }
+    
+    const bool headless = wantsExport(argc, argv);
+    std::unique_ptr<QCoreApplication> app(headless ? new QCoreApplication(argc, argv)
+                                                   : new QApplication(argc, argv));
+    app->setApplicationName("DiffyInAJiffy");
+    app->setApplicationVersion("1.0.0");
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Side-by-side diff viewer");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("first", "File or folder to compare.", "[first second]");
+    parser.addPositionalArgument("second", "File or folder to compare it with.");
+    QCommandLineOption benchmarkOption("startup-benchmark",
+                                       "Print the time from launch to the first highlighted diff of two files and exit.");
+    parser.addOption(benchmarkOption);
+    QCommandLineOption budgetOption("memory-budget",
+                                    "Memory a diff may use before large file mode takes over.", "MiB");
+    parser.addOption(budgetOption);
+    QCommandLineOption htmlOption("export-html",
+                                  "Compare two folders without a window and write an HTML report.", "file");
+    parser.addOption(htmlOption);
+    QCommandLineOption jsonOption("export-json",
+                                  "Compare two folders without a window and write an NDJSON report.", "file");
+    parser.addOption(jsonOption);
+    parser.process(*app);
+    
+    const QStringList paths = parser.positionalArguments();
+    if (!paths.isEmpty() && paths.size() != 2) {
+        parser.showHelp(1);
+    }
+    
+    qint64 memoryBudget = DiffView::defaultMemoryBudget();
+    if (parser.isSet(budgetOption)) {
+        bool ok = false;
+        memoryBudget = parser.value(budgetOption).toLongLong(&ok) << 20;
+        if (!ok || memoryBudget <= 0) {
+            qCritical("--memory-budget expects a size in MiB");
+            return 1;
+        }
+    }
+    
+    bool comparingFiles = false;
+    bool comparingFolders = false;
+    if (paths.size() == 2) {
+        QFileInfo info1(paths[0]);
+        QFileInfo info2(paths[1]);
+        comparingFiles = info1.isFile() && info2.isFile();
+        comparingFolders = info1.isDir() && info2.isDir();
+        if (!comparingFiles && !comparingFolders) {
+            qCritical("Expected two existing files or two existing folders");
+            return 1;
+        }
+    }
+    
+    // Only a file pair ends in a shown diff, which is what stops the benchmark
+    if (parser.isSet(benchmarkOption) && !comparingFiles) {
+        qCritical("--startup-benchmark needs two existing files");
+        return 1;
+    }
+    
+    if (headless) {
+        if (!comparingFolders) {
+            qCritical("--export-html and --export-json need two existing folders");
+            return 1;
+        }
+        ReportExporter exporter;
+        exporter.setHtmlPath(parser.value(htmlOption));
+        exporter.setJsonPath(parser.value(jsonOption));
+        exporter.setMemoryBudget(memoryBudget);
+        int result = exportFolders(paths[0], paths[1], exporter);
+        Tracer::writeChromeTrace();
+        return result;
+    }
+    
+    // Read and diff text files on a worker while the window is built
+    DiffPreloader preloader;
+    const bool preloading = comparingFiles && DiffPreloader::canPreload(paths[0], paths[1], memoryBudget);
+    if (preloading) {
+        preloader.start(paths[0], paths[1]);
+    }
     
     MainWindow window;
+    window.setMemoryBudget(memoryBudget);
+    
+    // Startup metric: launch to the first diff highlighted in the panes
+    bool firstDiff = true;
+    const bool benchmark = parser.isSet(benchmarkOption);
+    QObject::connect(&window, &MainWindow::diffShown, app.get(), [&]() {
+        if (!firstDiff) {
+            return;
+        }
+        firstDiff = false;
+        Tracer::complete("timeToFirstDiff", 0);
+        if (benchmark) {
+            QTextStream(stdout) << "time to first diff: "
+                                << QString::number(launchTimer.nsecsElapsed() / 1e6, 'f', 1) << " ms\n";
+            // Queued: the diff may be shown before exec() starts
+            QMetaObject::invokeMethod(app.get(), &QCoreApplication::quit, Qt::QueuedConnection);
+        }
+    });
+    
+    // Folder scans run in the background already; starting before show()
+    // overlaps the first listing with the first paint
+    if (comparingFiles) {
+        window.compareFiles(paths[0], paths[1], preloading ? &preloader : nullptr);
+    } else if (comparingFolders) {
+        window.compareFolders(paths[0], paths[1]);
+    }
     window.show();
     
-    return app.exec();
+    int result = app->exec();
+    Tracer::writeChromeTrace();
+    return result;
 }
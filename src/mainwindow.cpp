@@ -1,11 +1,17 @@
 #include "mainwindow.h"
+#include "diffpreloader.h"
+#include "reportexporter.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QInputDialog>
+#include <QLineEdit>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
+    , folderView(nullptr)
+    , reportExporter(nullptr)
 {
     setupUI();
     createActions();
@@ -25,27 +31,47 @@ void MainWindow::setupUI()
     // Create main splitter for folder view and diff view
     mainSplitter = new QSplitter(Qt::Horizontal, this);
     
-    // Create folder view (file tree)
-    folderView = new FolderView(this);
-    
-    // Create diff view (side-by-side comparison)
+    // Create diff view (side-by-side comparison); the folder view is
+    // added in front of it when first needed
     diffView = new DiffView(this);
-    
-    // Add widgets to splitter
-    mainSplitter->addWidget(folderView);
     mainSplitter->addWidget(diffView);
     
+    // Connect signals
+    connect(diffView, &DiffView::timingsAvailable,
+            this, &MainWindow::showTimings);
+    connect(diffView, &DiffView::diffShown,
+            this, &MainWindow::diffShown);
+    
+    setCentralWidget(mainSplitter);
+    
+    statusBar()->showMessage("Ready");
+}
+
+FolderView *MainWindow::folders()
+{
+    if (folderView) {
+        return folderView;
+    }
+    
+    // Create folder view (file tree)
+    folderView = new FolderView(this);
+    mainSplitter->insertWidget(0, folderView);
+    
     // Set initial sizes (folder view 20%, diff view 80%)
     mainSplitter->setStretchFactor(0, 1);
     mainSplitter->setStretchFactor(1, 4);
     
-    // Connect signals
     connect(folderView, &FolderView::fileSelected, 
             diffView, &DiffView::loadFiles);
-    
-    setCentralWidget(mainSplitter);
-    
-    statusBar()->showMessage("Ready");
+    connect(folderView, &FolderView::prefetchRequested,
+            diffView, &DiffView::prefetchFiles);
+    connect(folderView, &FolderView::comparisonFinished,
+            this, &MainWindow::folderComparisonFinished);
+    connect(folderView, &FolderView::timingsAvailable,
+            this, &MainWindow::showTimings);
+    connect(stopComparisonAction, &QAction::triggered,
+            folderView, &FolderView::cancelComparison);
+    return folderView;
 }
 
 void MainWindow::createActions()
@@ -60,6 +86,20 @@ void MainWindow::createActions()
     openFoldersAction->setStatusTip(tr("Open two folders to compare"));
     connect(openFoldersAction, &QAction::triggered, this, &MainWindow::openFolders);
     
+    openRevisionsAction = new QAction(tr("Compare &Revisions..."), this);
+    openRevisionsAction->setStatusTip(tr("Compare two revisions of a git repository without checking them out"));
+    connect(openRevisionsAction, &QAction::triggered, this, &MainWindow::openRevisions);
+    
+    stopComparisonAction = new QAction(tr("&Stop Folder Comparison"), this);
+    stopComparisonAction->setShortcut(QKeySequence(Qt::Key_Escape));
+    stopComparisonAction->setStatusTip(tr("Cancel the running folder comparison"));
+    stopComparisonAction->setEnabled(false);
+    
+    exportReportAction = new QAction(tr("&Export Report..."), this);
+    exportReportAction->setStatusTip(tr("Write the folder comparison with all file diffs as HTML or NDJSON"));
+    exportReportAction->setEnabled(false);
+    connect(exportReportAction, &QAction::triggered, this, &MainWindow::exportReport);
+    
     exitAction = new QAction(tr("E&xit"), this);
     exitAction->setShortcut(QKeySequence::Quit);
     exitAction->setStatusTip(tr("Exit the application"));
@@ -83,6 +123,34 @@ void MainWindow::createActions()
     connect(ignorePunctuationAction, &QAction::toggled, 
             this, &MainWindow::toggleIgnorePunctuation);
     
+    foldSectionsAction = new QAction(tr("&Fold Unchanged Sections"), this);
+    foldSectionsAction->setCheckable(true);
+    foldSectionsAction->setStatusTip(tr("Collapse Markdown sections without changes"));
+    connect(foldSectionsAction, &QAction::toggled, 
+            this, &MainWindow::toggleFoldSections);
+    
+    renameThresholdAction = new QAction(tr("Rename &Detection..."), this);
+    renameThresholdAction->setStatusTip(tr("Set how similar a moved file must be to be paired"));
+    connect(renameThresholdAction, &QAction::triggered, 
+            this, &MainWindow::setRenameThreshold);
+    
+    memoryBudgetAction = new QAction(tr("&Memory Budget..."), this);
+    memoryBudgetAction->setStatusTip(tr("Set how much memory a diff may use before large file mode takes over"));
+    connect(memoryBudgetAction, &QAction::triggered, 
+            this, &MainWindow::editMemoryBudget);
+    
+    ignorePatternsAction = new QAction(tr("Ignore &Patterns..."), this);
+    ignorePatternsAction->setStatusTip(tr("Leave files matching gitignore-style patterns out of folder comparisons"));
+    connect(ignorePatternsAction, &QAction::triggered, 
+            this, &MainWindow::editIgnorePatterns);
+    
+    useGitignoreAction = new QAction(tr("Use .&gitignore Files"), this);
+    useGitignoreAction->setCheckable(true);
+    useGitignoreAction->setChecked(true);
+    useGitignoreAction->setStatusTip(tr("Apply the .gitignore files found in compared folders"));
+    connect(useGitignoreAction, &QAction::toggled, 
+            this, &MainWindow::toggleUseGitignore);
+    
     aboutAction = new QAction(tr("&About"), this);
     aboutAction->setStatusTip(tr("About DiffyInAJiffy"));
     connect(aboutAction, &QAction::triggered, this, &MainWindow::aboutDialog);
@@ -93,6 +161,9 @@ void MainWindow::createMenus()
     QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openFilesAction);
     fileMenu->addAction(openFoldersAction);
+    fileMenu->addAction(openRevisionsAction);
+    fileMenu->addAction(stopComparisonAction);
+    fileMenu->addAction(exportReportAction);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
     
@@ -100,6 +171,12 @@ void MainWindow::createMenus()
     viewMenu->addAction(ignoreWhitespaceAction);
     viewMenu->addAction(ignoreReflowAction);
     viewMenu->addAction(ignorePunctuationAction);
+    viewMenu->addSeparator();
+    viewMenu->addAction(foldSectionsAction);
+    viewMenu->addAction(renameThresholdAction);
+    viewMenu->addAction(memoryBudgetAction);
+    viewMenu->addAction(ignorePatternsAction);
+    viewMenu->addAction(useGitignoreAction);
     
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
     helpMenu->addAction(aboutAction);
@@ -126,8 +203,7 @@ void MainWindow::openFiles()
     );
     
     if (files.size() == 2) {
-        diffView->loadFiles(files[0], files[1]);
-        statusBar()->showMessage(tr("Comparing: %1 and %2").arg(files[0]).arg(files[1]));
+        compareFiles(files[0], files[1]);
     } else if (files.size() > 0) {
         QMessageBox::warning(this, tr("File Selection"), 
             tr("Please select exactly two files to compare."));
@@ -148,10 +224,118 @@ void MainWindow::openFolders()
     if (folder2.isEmpty())
         return;
     
-    folderView->loadFolders(folder1, folder2);
+    compareFolders(folder1, folder2);
+}
+
+void MainWindow::compareFiles(const QString &file1, const QString &file2, DiffPreloader *preloader)
+{
+    if (preloader && preloader->isFinished()) {
+        diffView->showPreloaded(*preloader);
+    } else if (preloader) {
+        connect(preloader, &DiffPreloader::finished, diffView, [this, preloader]() {
+            diffView->showPreloaded(*preloader);
+        });
+    } else {
+        diffView->loadFiles(file1, file2);
+    }
+    statusBar()->showMessage(tr("Comparing: %1 and %2").arg(file1).arg(file2));
+}
+
+void MainWindow::compareFolders(const QString &folder1, const QString &folder2)
+{
+    folders()->loadFolders(folder1, folder2);
+    stopComparisonAction->setEnabled(true);
+    exportReportAction->setEnabled(false);
     statusBar()->showMessage(tr("Comparing folders: %1 and %2").arg(folder1).arg(folder2));
 }
 
+void MainWindow::openRevisions()
+{
+    QString repository = QFileDialog::getExistingDirectory(
+        this, tr("Select Git Repository"));
+    
+    if (repository.isEmpty())
+        return;
+    
+    bool ok = false;
+    QString revision1 = QInputDialog::getText(this, tr("Compare Revisions"),
+                                              tr("First revision (branch, tag or commit):"),
+                                              QLineEdit::Normal, "HEAD", &ok);
+    if (!ok || revision1.isEmpty())
+        return;
+    
+    QString revision2 = QInputDialog::getText(this, tr("Compare Revisions"),
+                                              tr("Second revision (branch, tag or commit):"),
+                                              QLineEdit::Normal, QString(), &ok);
+    if (!ok || revision2.isEmpty())
+        return;
+    
+    if (!folders()->loadRevisions(repository, revision1.trimmed(), revision2.trimmed())) {
+        QMessageBox::warning(this, tr("Compare Revisions"), folders()->errorString());
+        return;
+    }
+    stopComparisonAction->setEnabled(true);
+    exportReportAction->setEnabled(false);
+    statusBar()->showMessage(tr("Comparing revisions: %1 and %2").arg(revision1).arg(revision2));
+}
+
+void MainWindow::folderComparisonFinished(bool cancelled)
+{
+    stopComparisonAction->setEnabled(false);
+    exportReportAction->setEnabled(!cancelled && !folders()->comparesRevisions()
+                                   && !(reportExporter && reportExporter->isRunning()));
+    statusBar()->showMessage(cancelled ? tr("Folder comparison cancelled") : tr("Folder comparison finished"), 5000);
+    
+    // A revision comparison stops early when the object store cannot be read
+    if (cancelled && folders()->comparesRevisions() && !folders()->errorString().isEmpty()) {
+        QMessageBox::warning(this, tr("Compare Revisions"), folders()->errorString());
+    }
+}
+
+void MainWindow::exportReport()
+{
+    QString path = QFileDialog::getSaveFileName(
+        this, tr("Export Report"), QString(), tr("HTML report (*.html);;JSON lines (*.ndjson)"));
+    
+    if (path.isEmpty())
+        return;
+    
+    if (!reportExporter) {
+        reportExporter = new ReportExporter(this);
+        connect(reportExporter, &ReportExporter::progress, this, [this](int done, int total) {
+            statusBar()->showMessage(tr("Exporting report: %1 of %2 files").arg(done).arg(total));
+        });
+        connect(reportExporter, &ReportExporter::finished,
+                this, &MainWindow::reportExportFinished);
+    }
+    
+    // The format follows the file name
+    const bool json = path.endsWith(".ndjson", Qt::CaseInsensitive) || path.endsWith(".jsonl", Qt::CaseInsensitive);
+    reportExporter->setHtmlPath(json ? QString() : path);
+    reportExporter->setJsonPath(json ? path : QString());
+    reportExporter->setRoots(folders()->root(1), folders()->root(2));
+    reportExporter->setMemoryBudget(diffView->memoryBudget());
+    
+    int identical = 0;
+    const QVector<ChangedFile> files = folders()->changedFiles(&identical);
+    exportReportAction->setEnabled(false);
+    reportExporter->start(files, identical);
+    statusBar()->showMessage(tr("Exporting report: %1 changed files").arg(files.size()));
+}
+
+void MainWindow::reportExportFinished(bool ok)
+{
+    // Unless another comparison has started meanwhile
+    exportReportAction->setEnabled(!stopComparisonAction->isEnabled() && !folders()->comparesRevisions());
+    statusBar()->showMessage(ok ? tr("Report exported")
+                                : tr("Report export failed: %1").arg(reportExporter->errorString()), 5000);
+}
+
+void MainWindow::showTimings(const QString &summary)
+{
+    statusBar()->showMessage(tr("Timings: %1").arg(summary), 10000);
+}
+
 void MainWindow::toggleIgnoreWhitespace(bool enabled)
 {
     diffView->setIgnoreWhitespace(enabled);
@@ -170,6 +354,61 @@ void MainWindow::toggleIgnorePunctuation(bool enabled)
     statusBar()->showMessage(enabled ? tr("Ignoring punctuation") : tr("Not ignoring punctuation"), 2000);
 }
 
+void MainWindow::toggleFoldSections(bool enabled)
+{
+    diffView->setFoldUnchangedSections(enabled);
+    statusBar()->showMessage(enabled ? tr("Folding unchanged sections") : tr("Showing all sections"), 2000);
+}
+
+void MainWindow::setRenameThreshold()
+{
+    bool ok = false;
+    int percent = QInputDialog::getInt(this, tr("Rename Detection"),
+                                       tr("Minimum similarity of renamed files in percent\n"
+                                          "(100: identical files only, 0: off):"),
+                                       folders()->renameThreshold(), 0, 100, 5, &ok);
+    if (ok) {
+        folders()->setRenameThreshold(percent);
+        statusBar()->showMessage(tr("Rename detection applies to the next folder comparison"), 3000);
+    }
+}
+
+void MainWindow::setMemoryBudget(qint64 bytes)
+{
+    diffView->setMemoryBudget(bytes);
+}
+
+void MainWindow::editMemoryBudget()
+{
+    bool ok = false;
+    int mebibytes = QInputDialog::getInt(this, tr("Memory Budget"),
+                                         tr("Memory a diff may use, in MiB. Larger files are\n"
+                                            "compared in large file mode, which shows only\n"
+                                            "the changed regions:"),
+                                         int(diffView->memoryBudget() >> 20), 64, 1024 * 1024, 256, &ok);
+    if (ok) {
+        diffView->setMemoryBudget(qint64(mebibytes) << 20);
+    }
+}
+
+void MainWindow::editIgnorePatterns()
+{
+    bool ok = false;
+    QString text = QInputDialog::getMultiLineText(this, tr("Ignore Patterns"),
+                                                  tr("Patterns to leave out of folder comparisons,\n"
+                                                     "one per line in .gitignore syntax:"),
+                                                  folders()->ignoreRules().join('\n'), &ok);
+    if (ok) {
+        folders()->setIgnoreRules(text.split('\n'));
+    }
+}
+
+void MainWindow::toggleUseGitignore(bool enabled)
+{
+    folders()->setUseGitignore(enabled);
+    statusBar()->showMessage(enabled ? tr("Using .gitignore files") : tr("Not using .gitignore files"), 2000);
+}
+
 void MainWindow::aboutDialog()
 {
     QMessageBox::about(this, tr("About DiffyInAJiffy"),
@@ -189,6 +428,5 @@ void MainWindow::aboutDialog()
            "<p>Planned enhancements:</p>"
            "<ul>"
            "<li>PDF overlay mode</li>"
-           "<li>Full DOCX structure parsing</li>"
            "</ul>"));
 }
@@ -9,6 +9,9 @@
 #include "diffview.h"
 #include "folderview.h"
 
+class DiffPreloader;
+class ReportExporter;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -16,13 +19,32 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
+    
+    // Paths from the command line. A preloader that was started on the
+    // same files supplies the diff once it is done.
+    void compareFiles(const QString &file1, const QString &file2, DiffPreloader *preloader = nullptr);
+    void compareFolders(const QString &folder1, const QString &folder2);
+    void setMemoryBudget(qint64 bytes);
+
+signals:
+    void diffShown();
 
 private slots:
     void openFiles();
     void openFolders();
+    void openRevisions();
+    void folderComparisonFinished(bool cancelled);
+    void exportReport();
+    void reportExportFinished(bool ok);
+    void showTimings(const QString &summary);
     void toggleIgnoreWhitespace(bool enabled);
     void toggleIgnoreReflow(bool enabled);
     void toggleIgnorePunctuation(bool enabled);
+    void toggleFoldSections(bool enabled);
+    void setRenameThreshold();
+    void editMemoryBudget();
+    void editIgnorePatterns();
+    void toggleUseGitignore(bool enabled);
     void aboutDialog();
 
 private:
@@ -30,19 +52,31 @@ private:
     void createMenus();
     void createToolBar();
     void setupUI();
+    FolderView *folders();
     
     // UI Components
     QSplitter *mainSplitter;
+    // Created on first use; a file comparison never needs the tree
     FolderView *folderView;
     DiffView *diffView;
+    // Created by the first export
+    ReportExporter *reportExporter;
     
     // Actions
     QAction *openFilesAction;
     QAction *openFoldersAction;
+    QAction *openRevisionsAction;
+    QAction *stopComparisonAction;
+    QAction *exportReportAction;
     QAction *exitAction;
     QAction *ignoreWhitespaceAction;
     QAction *ignoreReflowAction;
     QAction *ignorePunctuationAction;
+    QAction *foldSectionsAction;
+    QAction *renameThresholdAction;
+    QAction *memoryBudgetAction;
+    QAction *ignorePatternsAction;
+    QAction *useGitignoreAction;
     QAction *aboutAction;
 };
 
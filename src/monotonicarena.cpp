@@ -0,0 +1,79 @@
+#include "monotonicarena.h"
+#include <cstdlib>
+
+namespace {
+
+const qsizetype kMinChunkSize = 64 * 1024;
+// A chunk above this size is not kept for the next round
+const qsizetype kMaxRetainedSize = 64 * 1024 * 1024;
+
+} // namespace
+
+MonotonicArena::MonotonicArena()
+    : offset(0)
+    , used(0)
+    , allocationsSinceReset(0)
+{
+}
+
+MonotonicArena::~MonotonicArena()
+{
+    for (const Chunk &chunk : chunks) {
+        std::free(chunk.data);
+    }
+}
+
+void *MonotonicArena::allocateBytes(qsizetype bytes, qsizetype alignment)
+{
+    if (!chunks.isEmpty()) {
+        Chunk &chunk = chunks.last();
+        qsizetype start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= chunk.size) {
+            offset = start + bytes;
+            used += bytes;
+            return chunk.data + start;
+        }
+    }
+
+    // Chunks double so a growing workload needs few of them
+    qsizetype size = qMax(kMinChunkSize, bytes + alignment);
+    if (!chunks.isEmpty()) {
+        size = qMax(size, chunks.last().size * 2);
+    }
+    // malloc memory is aligned for any fundamental type
+    Chunk chunk = { static_cast<char *>(std::malloc(size_t(size))), size };
+    Q_CHECK_PTR(chunk.data);
+    chunks.append(chunk);
+    ++allocationsSinceReset;
+
+    offset = bytes;
+    used += bytes;
+    return chunk.data;
+}
+
+void MonotonicArena::reset()
+{
+    // Replace several chunks by one that fits their combined load; a single
+    // chunk is simply rewound. One huge diff does not pin its memory.
+    qsizetype total = 0;
+    for (const Chunk &chunk : chunks) {
+        total += chunk.size;
+    }
+    if (chunks.size() > 1 || total > kMaxRetainedSize) {
+        for (const Chunk &chunk : chunks) {
+            std::free(chunk.data);
+        }
+        chunks.clear();
+
+        if (total <= kMaxRetainedSize) {
+            Chunk chunk = { static_cast<char *>(std::malloc(size_t(total))), total };
+            if (chunk.data) {
+                chunks.append(chunk);
+            }
+        }
+    }
+
+    offset = 0;
+    used = 0;
+    allocationsSinceReset = 0;
+}
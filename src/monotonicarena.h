@@ -0,0 +1,50 @@
+#ifndef MONOTONICARENA_H
+#define MONOTONICARENA_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <type_traits>
+
+// Bump allocator for scratch arrays that all die together. Memory is taken
+// from large chunks and only given back by reset(), which keeps one chunk
+// big enough for everything handed out since the previous reset, so a
+// workload that repeats settles on a single chunk and no heap traffic.
+class MonotonicArena
+{
+public:
+    MonotonicArena();
+    ~MonotonicArena();
+
+    // Uninitialised storage for count objects of a trivial type
+    template<typename T>
+    T *allocate(qsizetype count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                      "arena memory is never constructed or destroyed");
+        return static_cast<T *>(allocateBytes(qsizetype(sizeof(T)) * count, alignof(T)));
+    }
+
+    void reset();
+
+    // Chunks taken from the heap since the last reset()
+    int heapAllocations() const { return allocationsSinceReset; }
+    qsizetype bytesInUse() const { return used; }
+
+private:
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    struct Chunk {
+        char *data;
+        qsizetype size;
+    };
+
+    void *allocateBytes(qsizetype bytes, qsizetype alignment);
+
+    QVector<Chunk> chunks;      // The last one is being filled
+    qsizetype offset;           // Fill position in the last chunk
+    qsizetype used;             // Bytes handed out since reset()
+    int allocationsSinceReset;
+};
+
+#endif // MONOTONICARENA_H
@@ -0,0 +1,139 @@
+#include "overviewruler.h"
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+
+namespace {
+
+// Finer than any screen; a paint visits each bucket at most once
+const int kBuckets = 4096;
+
+// Higher wins when changes of several kinds share a bucket
+int priority(DiffHunk::Type type)
+{
+    switch (type) {
+    case DiffHunk::Modified:
+        return 3;
+    case DiffHunk::Deleted:
+        return 2;
+    case DiffHunk::Added:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+QColor colorFor(int priority)
+{
+    switch (priority) {
+    case 3:
+        return QColor(220, 180, 40);
+    case 2:
+        return QColor(220, 80, 80);
+    default:
+        return QColor(80, 190, 80);
+    }
+}
+
+} // namespace
+
+OverviewRuler::OverviewRuler(QWidget *parent)
+    : QWidget(parent)
+    , totalRows(0)
+    , viewportStart(0)
+    , viewportRows(0)
+{
+    setCursor(Qt::PointingHandCursor);
+    setToolTip(tr("Changes in the whole document; click to jump"));
+}
+
+QSize OverviewRuler::sizeHint() const
+{
+    return QSize(14, 100);
+}
+
+void OverviewRuler::setAlignment(const AlignmentMap &map)
+{
+    totalRows = map.rowCount();
+    const int count = qMin(kBuckets, totalRows);
+    bucketTypes.fill(0, count);
+    bucketCoverage.fill(0.0f, count);
+
+    if (count > 0) {
+        const double rowsPerBucket = double(totalRows) / count;
+        for (const AlignmentMap::Region &region : map.regions()) {
+            // An insertion point still gets a mark
+            const double row0 = region.row0;
+            const double row1 = qMax(region.row1, region.row0 + 1);
+            const int first = qMin(count - 1, int(row0 / rowsPerBucket));
+            const int last = qMin(count - 1, int((row1 - 1) / rowsPerBucket));
+            for (int b = first; b <= last; ++b) {
+                const double overlap = qMin(row1, (b + 1) * rowsPerBucket) - qMax(row0, b * rowsPerBucket);
+                bucketCoverage[b] += float(qMax(overlap, 1.0) / rowsPerBucket);
+                bucketTypes[b] = quint8(qMax(int(bucketTypes[b]), priority(region.type)));
+            }
+        }
+    }
+    update();
+}
+
+void OverviewRuler::setViewport(double firstRow, double rows)
+{
+    viewportStart = firstRow;
+    viewportRows = rows;
+    update();
+}
+
+double OverviewRuler::rowAt(int y) const
+{
+    return height() > 0 ? double(y) * totalRows / height() : 0;
+}
+
+void OverviewRuler::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(245, 245, 245));
+
+    const int count = bucketTypes.size();
+    const int h = height();
+    if (count == 0 || h <= 0) {
+        return;
+    }
+
+    // One pixel row covers one or more buckets, or one bucket is stretched
+    // over several pixel rows
+    for (int y = 0; y < h; ++y) {
+        const int first = int(qint64(y) * count / h);
+        const int last = qMax(first + 1, int(qint64(y + 1) * count / h));
+        int type = 0;
+        float coverage = 0;
+        for (int b = first; b < last && b < count; ++b) {
+            type = qMax(type, int(bucketTypes[b]));
+            coverage = qMax(coverage, bucketCoverage[b]);
+        }
+        if (type > 0) {
+            QColor color = colorFor(type);
+            color.setAlpha(96 + int(159 * qMin(coverage, 1.0f)));
+            painter.fillRect(0, y, width(), 1, color);
+        }
+    }
+
+    if (totalRows > 0 && viewportRows > 0) {
+        const double scale = double(h) / totalRows;
+        QRectF visible(0.5, viewportStart * scale, width() - 1.0, qMax(viewportRows * scale, 2.0));
+        painter.setPen(QColor(80, 80, 80));
+        painter.drawRect(visible);
+    }
+}
+
+void OverviewRuler::mousePressEvent(QMouseEvent *event)
+{
+    emit rowRequested(rowAt(int(event->position().y())));
+}
+
+void OverviewRuler::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton) {
+        emit rowRequested(rowAt(int(event->position().y())));
+    }
+}
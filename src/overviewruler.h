@@ -0,0 +1,45 @@
+#ifndef OVERVIEWRULER_H
+#define OVERVIEWRULER_H
+
+#include <QWidget>
+#include <QVector>
+#include "alignmentmap.h"
+
+// Narrow strip beside the diff panes showing where the changes are, with
+// the visible part of the document outlined. Changes are aggregated into a
+// fixed number of buckets when a diff is set, so painting does not depend
+// on the document size.
+class OverviewRuler : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit OverviewRuler(QWidget *parent = nullptr);
+
+    void setAlignment(const AlignmentMap &map);
+    void setViewport(double firstRow, double rows);
+
+    QSize sizeHint() const override;
+
+signals:
+    // A click or drag asks for this row to be centred
+    void rowRequested(double row);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+    double rowAt(int y) const;
+
+    // Per bucket: the most prominent change type and the share of rows
+    // that changed
+    QVector<quint8> bucketTypes;
+    QVector<float> bucketCoverage;
+    int totalRows;
+    double viewportStart;
+    double viewportRows;
+};
+
+#endif // OVERVIEWRULER_H
@@ -0,0 +1,255 @@
+#include "renamedetector.h"
+#include "fasthash.h"
+#include "filecomparator.h"
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const int kBands = 16;
+const int kRowsPerBand = RenameDetector::kSketchSize / kBands;
+
+// Buckets this full hold boilerplate shared by many files; comparing
+// against all of them would make the pairing quadratic
+const int kMaxBucketSize = 64;
+
+// One independent hash function per sketch slot, derived from the line hash
+inline quint32 slotHash(quint64 lineHash, int slot)
+{
+    quint64 x = lineHash + quint64(slot + 1) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return quint32((x ^ (x >> 31)) >> 32);
+}
+
+class SketchBuilder
+{
+public:
+    SketchBuilder() : sketch(RenameDetector::kSketchSize, 0xFFFFFFFFu), lines(0) {}
+
+    void addData(const char *data, qint64 length)
+    {
+        const char *end = data + length;
+        while (data < end) {
+            const char *newline = static_cast<const char *>(std::memchr(data, '\n', size_t(end - data)));
+            if (!newline) {
+                partial.append(data, int(end - data));
+                return;
+            }
+            if (partial.isEmpty()) {
+                addLine(data, newline);
+            } else {
+                partial.append(data, int(newline - data));
+                addLine(partial.constData(), partial.constData() + partial.size());
+                partial.clear();
+            }
+            data = newline + 1;
+        }
+    }
+
+    QVector<quint32> finish()
+    {
+        if (!partial.isEmpty()) {
+            addLine(partial.constData(), partial.constData() + partial.size());
+            partial.clear();
+        }
+        return lines > 0 ? sketch : QVector<quint32>();
+    }
+
+private:
+    void addLine(const char *begin, const char *end)
+    {
+        // Indentation and line endings do not make lines different
+        while (begin < end && (*begin == ' ' || *begin == '\t')) {
+            ++begin;
+        }
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+            --end;
+        }
+        if (begin == end) {
+            return;
+        }
+
+        quint64 lineHash = FastHash::hash(begin, end - begin);
+        for (int slot = 0; slot < RenameDetector::kSketchSize; ++slot) {
+            sketch[slot] = qMin(sketch[slot], slotHash(lineHash, slot));
+        }
+        ++lines;
+    }
+
+    QVector<quint32> sketch;
+    QByteArray partial;
+    int lines;
+};
+
+int similarity(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+    int equal = 0;
+    for (int i = 0; i < RenameDetector::kSketchSize; ++i) {
+        equal += a[i] == b[i];
+    }
+    return equal * 100 / RenameDetector::kSketchSize;
+}
+
+quint64 bandKey(const QVector<quint32> &sketch, int band)
+{
+    return FastHash::hash(reinterpret_cast<const char *>(sketch.constData() + band * kRowsPerBand),
+                          kRowsPerBand * sizeof(quint32), quint64(band));
+}
+
+QString fileName(const QString &relativePath)
+{
+    return relativePath.mid(relativePath.lastIndexOf('/') + 1);
+}
+
+struct Match {
+    int similarity;
+    bool sameName;
+    int deleted;
+    int added;
+};
+
+} // namespace
+
+bool RenameDetector::fingerprint(const QString &filePath, RenameCandidate *candidate, bool sketch)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        return false;
+    }
+
+    QByteArray buffer;
+    buffer.resize(FileComparator::kChunkSize);
+    FastHash hash;
+    SketchBuilder builder;
+    bool binary = false;
+
+    qint64 n;
+    while ((n = file.read(buffer.data(), buffer.size())) > 0) {
+        hash.addData(buffer.constData(), n);
+        if (sketch && !binary) {
+            // Line structure means nothing in binary files
+            binary = std::memchr(buffer.constData(), '\0', size_t(n)) != nullptr;
+            if (!binary) {
+                builder.addData(buffer.constData(), n);
+            }
+        }
+    }
+    if (n < 0) {
+        return false;
+    }
+
+    candidate->hashed = true;
+    candidate->hash = hash.digest();
+    if (sketch && !binary) {
+        candidate->sketch = builder.finish();
+    }
+    return true;
+}
+
+QVector<FolderRename> RenameDetector::pair(const QVector<RenameCandidate> &deleted,
+                                           const QVector<RenameCandidate> &added, int threshold)
+{
+    QVector<FolderRename> renames;
+    QVector<bool> deletedUsed(deleted.size(), false);
+    QVector<bool> addedUsed(added.size(), false);
+
+    // Identical content first; a file keeping its name wins over the others
+    QHash<quint64, QVector<int>> addedByHash;
+    for (int j = 0; j < added.size(); ++j) {
+        if (added[j].hashed) {
+            addedByHash[added[j].hash].append(j);
+        }
+    }
+    for (int i = 0; i < deleted.size(); ++i) {
+        if (!deleted[i].hashed) {
+            continue;
+        }
+        auto it = addedByHash.find(deleted[i].hash);
+        if (it == addedByHash.end()) {
+            continue;
+        }
+
+        int best = -1;
+        for (int j : it.value()) {
+            if (addedUsed[j] || added[j].size != deleted[i].size) {
+                continue;
+            }
+            if (best < 0 || fileName(added[j].relativePath) == fileName(deleted[i].relativePath)) {
+                best = j;
+            }
+        }
+        if (best >= 0) {
+            deletedUsed[i] = addedUsed[best] = true;
+            renames.append({ deleted[i].relativePath, added[best].relativePath, 100 });
+        }
+    }
+
+    if (threshold >= 100) {
+        return renames;
+    }
+
+    // Edited renames: candidates share at least one band of their sketches
+    QHash<quint64, QVector<int>> buckets;
+    for (int j = 0; j < added.size(); ++j) {
+        if (addedUsed[j] || added[j].sketch.isEmpty()) {
+            continue;
+        }
+        for (int band = 0; band < kBands; ++band) {
+            QVector<int> &bucket = buckets[bandKey(added[j].sketch, band)];
+            if (bucket.size() <= kMaxBucketSize) {
+                bucket.append(j);
+            }
+        }
+    }
+
+    QVector<Match> matches;
+    QSet<int> seen;
+    for (int i = 0; i < deleted.size(); ++i) {
+        if (deletedUsed[i] || deleted[i].sketch.isEmpty()) {
+            continue;
+        }
+
+        seen.clear();
+        for (int band = 0; band < kBands; ++band) {
+            auto it = buckets.constFind(bandKey(deleted[i].sketch, band));
+            if (it == buckets.constEnd() || it.value().size() > kMaxBucketSize) {
+                continue;
+            }
+            for (int j : it.value()) {
+                if (seen.contains(j)) {
+                    continue;
+                }
+                seen.insert(j);
+
+                int score = similarity(deleted[i].sketch, added[j].sketch);
+                if (score >= threshold) {
+                    bool sameName = fileName(deleted[i].relativePath) == fileName(added[j].relativePath);
+                    matches.append({ score, sameName, i, j });
+                }
+            }
+        }
+    }
+
+    // Greedy, best pairs first
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+        if (a.similarity != b.similarity) {
+            return a.similarity > b.similarity;
+        }
+        return a.sameName && !b.sameName;
+    });
+
+    for (const Match &match : matches) {
+        if (deletedUsed[match.deleted] || addedUsed[match.added]) {
+            continue;
+        }
+        deletedUsed[match.deleted] = addedUsed[match.added] = true;
+        renames.append({ deleted[match.deleted].relativePath, added[match.added].relativePath,
+                         match.similarity });
+    }
+
+    return renames;
+}
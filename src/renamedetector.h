@@ -0,0 +1,47 @@
+#ifndef RENAMEDETECTOR_H
+#define RENAMEDETECTOR_H
+
+#include <QString>
+#include <QVector>
+
+struct FolderRename {
+    QString from;       // Relative path in the first folder
+    QString to;         // Relative path in the second folder
+    int similarity;     // Percent; 100 for identical content
+};
+
+// A file present on one side only, as input for rename detection
+struct RenameCandidate {
+    QString relativePath;
+    qint64 size;
+    bool hashed;
+    quint64 hash;
+    QVector<quint32> sketch;    // MinHash of the file's lines, empty if not sketched
+
+    RenameCandidate() : size(-1), hashed(false), hash(0) {}
+};
+
+// Pairs deleted files with added files.
+//
+// Identical content is found through the whole-file hash. For edited files
+// each file's set of non-blank lines is summarised as a MinHash sketch; the
+// fraction of equal sketch slots estimates the Jaccard similarity of two
+// files. Sketches are bucketed by bands (locality-sensitive hashing), so
+// only files sharing a band are ever compared and the work stays close to
+// linear in the number of candidates.
+class RenameDetector
+{
+public:
+    static const int kSketchSize = 64;
+    static const qint64 kMaxSketchBytes = 8 * 1024 * 1024;
+
+    // Hashes the file and, if requested, builds its sketch, in one read
+    static bool fingerprint(const QString &filePath, RenameCandidate *candidate, bool sketch);
+
+    // threshold: minimum similarity in percent for edited renames; 100
+    // pairs identical files only
+    static QVector<FolderRename> pair(const QVector<RenameCandidate> &deleted,
+                                      const QVector<RenameCandidate> &added, int threshold);
+};
+
+#endif // RENAMEDETECTOR_H
@@ -0,0 +1,492 @@
+#include "reportexporter.h"
+#include "largefilediff.h"
+#include "textdecoder.h"
+#include "tracer.h"
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+namespace {
+
+const qint64 kDefaultMemoryBudget = qint64(1024) * 1024 * 1024;
+
+// Files diffed ahead of the writer, per worker thread
+const int kFilesAheadPerThread = 4;
+
+// Keeps a heavily changed file from dominating the report
+const int kContextLines = 3;
+const int kMaxRowsPerFile = 2000;
+const int kMaxJsonHunks = 10000;
+const int kMaxLineBytes = 1000;
+const int kProbeBytes = 8192;
+
+// Progress is reported every this many files
+const int kProgressInterval = 64;
+
+const char kHtmlHead[] =
+    "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">\n"
+    "<style>\n"
+    "body{font-family:sans-serif;margin:1em;display:flex;flex-direction:column}\n"
+    "#summary{order:-1}\n"
+    "summary{cursor:pointer;padding:2px 4px;font-family:monospace}\n"
+    ".status{display:inline-block;width:7em;font-weight:bold}\n"
+    ".modified .status{color:#a07000}.added .status{color:#007000}\n"
+    ".deleted .status{color:#b00000}.renamed .status{color:#0050b0}\n"
+    ".counts,.from,.note{color:#666}\n"
+    "table{border-collapse:collapse;font-family:monospace;font-size:90%;margin:4px 0 12px 2em}\n"
+    "td{padding:0 6px;white-space:pre;vertical-align:top}\n"
+    "td.n{color:#999;text-align:right}\n"
+    "tr.gap td{color:#666;background:#f0f0f0}\n"
+    "tr.mod td{background:#ffffc8}\n"
+    "tr.add td:nth-child(n+3){background:#c8ffc8}\n"
+    "tr.del td:nth-child(-n+2){background:#ffc8c8}\n"
+    "</style>\n"
+    // A diff stays in its inert template until its section is first opened
+    "<script>\n"
+    "document.addEventListener('toggle', function (event) {\n"
+    "  var section = event.target;\n"
+    "  var diff = section.querySelector(':scope > template');\n"
+    "  if (section.open && diff) {\n"
+    "    section.appendChild(diff.content);\n"
+    "    diff.remove();\n"
+    "  }\n"
+    "}, true);\n"
+    "</script>\n";
+
+struct FileReport {
+    QByteArray html;
+    QByteArray json;
+    qint64 added;
+    qint64 deleted;
+    qint64 modified;
+
+    FileReport() : added(0), deleted(0), modified(0) {}
+};
+
+QByteArray html(const QString &text)
+{
+    return text.toHtmlEscaped().toUtf8();
+}
+
+QByteArray jsonString(const QString &text)
+{
+    QString escaped;
+    escaped.reserve(text.size() + 2);
+    escaped += QLatin1Char('"');
+    for (QChar c : text) {
+        switch (c.unicode()) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (c.unicode() < 0x20) {
+                escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+            } else {
+                escaped += c;
+            }
+        }
+    }
+    escaped += QLatin1Char('"');
+    return escaped.toUtf8();
+}
+
+QString statusName(const ChangedFile &file)
+{
+    if (!file.renamedFrom.isEmpty()) {
+        return "renamed";
+    }
+    switch (file.status) {
+    case FolderEntry::Modified:
+        return "modified";
+    case FolderEntry::Added:
+        return "added";
+    case FolderEntry::Deleted:
+        return "deleted";
+    case FolderEntry::TypeMismatch:
+        return "type changed";
+    default:
+        return "not compared";
+    }
+}
+
+const char *hunkType(DiffHunk::Type type)
+{
+    switch (type) {
+    case DiffHunk::Added:
+        return "added";
+    case DiffHunk::Deleted:
+        return "deleted";
+    default:
+        return "modified";
+    }
+}
+
+// Zero bytes mark binary content unless the file is UTF-16, which
+// LargeFileDiff splits and decodes in its own encoding
+bool isLineText(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray probe = file.read(kProbeBytes);
+    return TextDecoder::isUtf16(probe) || !probe.contains('\0');
+}
+
+void appendCells(QByteArray &rows, const LargeFileDiff &diff, int side, qint64 line)
+{
+    if (line < 0) {
+        rows += "<td></td><td></td>";
+        return;
+    }
+    rows += "<td class=\"n\">" + QByteArray::number(line + 1) + "</td><td>";
+    rows += html(diff.text(side, line, kMaxLineBytes));
+    rows += "</td>";
+}
+
+void appendRow(QByteArray &rows, const char *type, const LargeFileDiff &diff, qint64 left, qint64 right)
+{
+    rows += "<tr class=\"";
+    rows += type;
+    rows += "\">";
+    appendCells(rows, diff, 1, left);
+    appendCells(rows, diff, 2, right);
+    rows += "</tr>\n";
+}
+
+// Side-by-side rows for hunk index with a few lines of context, as in the
+// large file view; next1 is the first left line not shown yet. Stops after
+// maxRows and returns the number of rows added.
+int appendHunkRows(QByteArray &rows, const LargeFileDiff &diff, qint64 index, qint64 *next1, int maxRows)
+{
+    const LineHunk hunk = diff.hunk(index);
+    int count = 0;
+
+    // Unchanged lines between hunks are the same number on both sides
+    const qint64 from1 = qMax(hunk.leftStart - kContextLines, *next1);
+    const qint64 from2 = hunk.rightStart - (hunk.leftStart - from1);
+    if (index == 0 || from1 > *next1) {
+        rows += "<tr class=\"gap\"><td colspan=\"4\">@@ line " + QByteArray::number(from1 + 1) + " @@</td></tr>\n";
+        ++count;
+    }
+    for (qint64 i = 0; i < hunk.leftStart - from1 && count < maxRows; ++i, ++count) {
+        appendRow(rows, "ctx", diff, from1 + i, from2 + i);
+    }
+
+    const char *type = hunk.type == DiffHunk::Added ? "add" : hunk.type == DiffHunk::Deleted ? "del" : "mod";
+    const qint64 lines1 = hunk.leftEnd - hunk.leftStart;
+    const qint64 lines2 = hunk.rightEnd - hunk.rightStart;
+    for (qint64 i = 0; i < qMax(lines1, lines2) && count < maxRows; ++i, ++count) {
+        appendRow(rows, type, diff, i < lines1 ? hunk.leftStart + i : -1, i < lines2 ? hunk.rightStart + i : -1);
+    }
+
+    qint64 until1 = qMin(hunk.leftEnd + kContextLines, diff.lineCount(1));
+    if (index + 1 < diff.hunkCount()) {
+        until1 = qMin(until1, diff.hunk(index + 1).leftStart);
+    }
+    for (qint64 i = 0; i < until1 - hunk.leftEnd && count < maxRows; ++i, ++count) {
+        appendRow(rows, "ctx", diff, hunk.leftEnd + i, hunk.rightEnd + i);
+    }
+    *next1 = until1;
+    return count;
+}
+
+// Runs on a worker; everything it needs is in its arguments
+FileReport renderFile(const ChangedFile &file, qint64 budget, bool withHtml, bool withJson)
+{
+    FileReport report;
+    QByteArray rows;
+    QByteArray hunks;
+    QString note;
+
+    if (file.status == FolderEntry::Modified) {
+        LargeFileDiff diff(budget);
+        if (!isLineText(file.path1) || !isLineText(file.path2)) {
+            note = "Binary content, not diffed";
+        } else if (!diff.compare(file.path1, file.path2)) {
+            note = diff.errorString();
+        } else {
+            qint64 next1 = 0;
+            int rowCount = 0;
+            for (qint64 i = 0; i < diff.hunkCount(); ++i) {
+                const LineHunk hunk = diff.hunk(i);
+                if (hunk.type == DiffHunk::Added) {
+                    report.added += hunk.rightEnd - hunk.rightStart;
+                } else if (hunk.type == DiffHunk::Deleted) {
+                    report.deleted += hunk.leftEnd - hunk.leftStart;
+                } else {
+                    report.modified += hunk.leftEnd - hunk.leftStart;
+                }
+
+                if (withJson && i < kMaxJsonHunks) {
+                    hunks += i > 0 ? ",{\"type\":\"" : "{\"type\":\"";
+                    hunks += hunkType(hunk.type);
+                    hunks += "\",\"left\":[" + QByteArray::number(hunk.leftStart) + "," + QByteArray::number(hunk.leftEnd);
+                    hunks += "],\"right\":[" + QByteArray::number(hunk.rightStart) + "," + QByteArray::number(hunk.rightEnd) + "]}";
+                }
+                if (withHtml && rowCount < kMaxRowsPerFile) {
+                    rowCount += appendHunkRows(rows, diff, i, &next1, kMaxRowsPerFile - rowCount);
+                }
+            }
+            if (rowCount >= kMaxRowsPerFile) {
+                note = QString("Only the first %1 rows of %2 changes are shown").arg(kMaxRowsPerFile).arg(diff.hunkCount());
+            }
+        }
+    }
+
+    const QString status = statusName(file);
+    if (withHtml) {
+        QByteArray &out = report.html;
+        out += "<details class=\"" + status.toUtf8().replace(' ', '-') + "\"><summary><span class=\"status\">";
+        out += html(status) + "</span>" + html(file.relativePath);
+        if (!file.renamedFrom.isEmpty()) {
+            out += " <span class=\"from\">from " + html(file.renamedFrom) + " ("
+                 + QByteArray::number(file.similarity) + "%)</span>";
+        }
+        if (report.added + report.deleted + report.modified > 0) {
+            out += " <span class=\"counts\">+" + QByteArray::number(report.added) + " -" + QByteArray::number(report.deleted)
+                 + " ~" + QByteArray::number(report.modified) + "</span>";
+        }
+        out += "</summary>";
+        if (!note.isEmpty()) {
+            out += "<p class=\"note\">" + html(note) + "</p>";
+        }
+        if (!rows.isEmpty()) {
+            out += "<template><table>\n" + rows + "</table></template>";
+        }
+        out += "</details>\n";
+    }
+
+    if (withJson) {
+        QByteArray &out = report.json;
+        out += "{\"kind\":\"file\",\"path\":" + jsonString(file.relativePath);
+        out += ",\"status\":" + jsonString(status);
+        if (!file.renamedFrom.isEmpty()) {
+            out += ",\"from\":" + jsonString(file.renamedFrom) + ",\"similarity\":" + QByteArray::number(file.similarity);
+        }
+        out += ",\"added\":" + QByteArray::number(report.added);
+        out += ",\"deleted\":" + QByteArray::number(report.deleted);
+        out += ",\"modified\":" + QByteArray::number(report.modified);
+        out += ",\"hunks\":[" + hunks + "]";
+        if (!note.isEmpty()) {
+            out += ",\"note\":" + jsonString(note);
+        }
+        out += "}\n";
+    }
+    return report;
+}
+
+} // namespace
+
+ReportExporter::ReportExporter(QObject *parent)
+    : QObject(parent)
+    , cancelled(false)
+    , running(false)
+    , budget(kDefaultMemoryBudget)
+{
+    workers = new QThreadPool(this);
+    workers->setMaxThreadCount(QThread::idealThreadCount());
+    driver = new QThreadPool(this);
+    driver->setMaxThreadCount(1);
+}
+
+ReportExporter::~ReportExporter()
+{
+    cancel();
+    driver->waitForDone();
+}
+
+void ReportExporter::setHtmlPath(const QString &path)
+{
+    htmlPath = path;
+}
+
+void ReportExporter::setJsonPath(const QString &path)
+{
+    jsonPath = path;
+}
+
+void ReportExporter::setRoots(const QString &root1, const QString &root2)
+{
+    this->root1 = root1;
+    this->root2 = root2;
+}
+
+void ReportExporter::setMemoryBudget(qint64 bytes)
+{
+    budget = bytes;
+}
+
+QString ReportExporter::errorString() const
+{
+    return error;
+}
+
+bool ReportExporter::isRunning() const
+{
+    return running;
+}
+
+void ReportExporter::cancel()
+{
+    cancelled = true;
+}
+
+void ReportExporter::start(const QVector<ChangedFile> &files, int identicalFiles)
+{
+    running = true;
+    cancelled = false;
+    driver->start([this, files, identicalFiles]() {
+        bool ok = run(files, identicalFiles);
+        QMetaObject::invokeMethod(this, [this, ok]() {
+            running = false;
+            emit finished(ok);
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool ReportExporter::run(const QVector<ChangedFile> &files, int identicalFiles)
+{
+    TraceScope trace("exportReport");
+    trace.arg("files", files.size());
+    error.clear();
+
+    // Saved files replace the targets only once complete
+    const bool withHtml = !htmlPath.isEmpty();
+    const bool withJson = !jsonPath.isEmpty();
+    QSaveFile htmlFile(htmlPath);
+    QSaveFile jsonFile(jsonPath);
+    if (withHtml && !htmlFile.open(QIODevice::WriteOnly)) {
+        error = tr("Cannot write %1: %2").arg(htmlPath).arg(htmlFile.errorString());
+        return false;
+    }
+    if (withJson && !jsonFile.open(QIODevice::WriteOnly)) {
+        error = tr("Cannot write %1: %2").arg(jsonPath).arg(jsonFile.errorString());
+        return false;
+    }
+
+    const QByteArray created = QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8();
+    if (withHtml) {
+        htmlFile.write(kHtmlHead);
+        htmlFile.write("<title>" + html(root1) + " vs " + html(root2) + "</title>\n</head><body>\n");
+        htmlFile.write("<h1>Folder comparison</h1>\n<p>" + html(root1) + " &rarr; " + html(root2)
+                       + "<br>Created " + created + "</p>\n");
+    }
+    if (withJson) {
+        jsonFile.write("{\"kind\":\"report\",\"root1\":" + jsonString(root1) + ",\"root2\":" + jsonString(root2)
+                       + ",\"created\":\"" + created + "\"}\n");
+    }
+
+    // Workers fill a ring of slots; the writer takes them in file order and
+    // refills each slot with the next file once it has been written
+    const int threads = workers->maxThreadCount();
+    const qint64 fileBudget = budget / threads;
+    const int window = threads * kFilesAheadPerThread;
+    QVector<FileReport> reports(window);
+    QVector<bool> ready(window, false);
+    QMutex mutex;
+    QWaitCondition readyCondition;
+
+    auto submit = [&](int index) {
+        workers->start([&, index]() {
+            FileReport report;
+            if (!cancelled) {
+                report = renderFile(files[index], fileBudget, withHtml, withJson);
+            }
+            QMutexLocker locker(&mutex);
+            reports[index % window] = report;
+            ready[index % window] = true;
+            readyCondition.wakeAll();
+        });
+    };
+    int submitted = 0;
+    for (; submitted < qMin(window, int(files.size())); ++submitted) {
+        submit(submitted);
+    }
+
+    int counts[4] = { 0, 0, 0, 0 };     // Modified, added, deleted, renamed
+    qint64 added = 0, deleted = 0, modified = 0;
+    for (int i = 0; i < files.size() && !cancelled; ++i) {
+        FileReport report;
+        {
+            QMutexLocker locker(&mutex);
+            while (!ready[i % window]) {
+                readyCondition.wait(&mutex);
+            }
+            report = reports[i % window];
+            reports[i % window] = FileReport();
+            ready[i % window] = false;
+        }
+        if (submitted < files.size()) {
+            submit(submitted++);
+        }
+
+        if (withHtml) {
+            htmlFile.write(report.html);
+        }
+        if (withJson) {
+            jsonFile.write(report.json);
+        }
+
+        const ChangedFile &file = files[i];
+        if (!file.renamedFrom.isEmpty()) {
+            ++counts[3];
+        } else if (file.status == FolderEntry::Added) {
+            ++counts[1];
+        } else if (file.status == FolderEntry::Deleted) {
+            ++counts[2];
+        } else if (file.status == FolderEntry::Modified) {
+            ++counts[0];
+        }
+        added += report.added;
+        deleted += report.deleted;
+        modified += report.modified;
+
+        if ((i + 1) % kProgressInterval == 0 || i + 1 == files.size()) {
+            emit progress(i + 1, int(files.size()));
+        }
+    }
+
+    // Tasks still refer to the locals above
+    workers->clear();
+    workers->waitForDone();
+    if (cancelled) {
+        error = tr("Export cancelled");
+        return false;
+    }
+
+    const QString summary = tr("%1 changed files: %2 modified, %3 added, %4 deleted, %5 renamed; %6 identical. "
+                               "Lines: +%7 -%8 ~%9")
+                                .arg(files.size()).arg(counts[0]).arg(counts[1]).arg(counts[2]).arg(counts[3])
+                                .arg(identicalFiles).arg(added).arg(deleted).arg(modified);
+    if (withHtml) {
+        htmlFile.write("<section id=\"summary\"><p>" + html(summary) + "</p></section>\n</body></html>\n");
+        if (!htmlFile.commit()) {
+            error = tr("Cannot write %1: %2").arg(htmlPath).arg(htmlFile.errorString());
+            return false;
+        }
+    }
+    if (withJson) {
+        jsonFile.write("{\"kind\":\"summary\",\"files\":" + QByteArray::number(files.size())
+                       + ",\"modified\":" + QByteArray::number(counts[0])
+                       + ",\"added\":" + QByteArray::number(counts[1])
+                       + ",\"deleted\":" + QByteArray::number(counts[2])
+                       + ",\"renamed\":" + QByteArray::number(counts[3])
+                       + ",\"identical\":" + QByteArray::number(identicalFiles)
+                       + ",\"linesAdded\":" + QByteArray::number(added)
+                       + ",\"linesDeleted\":" + QByteArray::number(deleted)
+                       + ",\"linesModified\":" + QByteArray::number(modified) + "}\n");
+        if (!jsonFile.commit()) {
+            error = tr("Cannot write %1: %2").arg(jsonPath).arg(jsonFile.errorString());
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef REPORTEXPORTER_H
+#define REPORTEXPORTER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include "foldermodel.h"
+
+class QThreadPool;
+
+// Writes the result of a folder comparison as a self-contained HTML report,
+// as NDJSON (one JSON object per line), or both in one pass.
+//
+// Modified files are diffed on a thread pool with one thread per core while
+// the calling thread writes finished files in listing order. At most a few
+// files per thread are diffed ahead of the writer, and each diff is a
+// LargeFileDiff under an equal share of the memory budget, so memory use
+// does not grow with the number or size of the files.
+//
+// In the HTML report every file is a collapsed section whose diff is kept
+// in an inert <template> until the section is opened.
+class ReportExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReportExporter(QObject *parent = nullptr);
+    ~ReportExporter();
+
+    // An empty path skips that format
+    void setHtmlPath(const QString &path);
+    void setJsonPath(const QString &path);
+    void setRoots(const QString &root1, const QString &root2);
+    void setMemoryBudget(qint64 bytes);
+
+    // Writes the reports on the calling thread; false, with errorString()
+    // set, if an output cannot be written or the export was cancelled
+    bool run(const QVector<ChangedFile> &files, int identicalFiles);
+    // Same in the background; finished() follows through the event loop
+    void start(const QVector<ChangedFile> &files, int identicalFiles);
+    bool isRunning() const;
+    QString errorString() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int done, int total);
+    void finished(bool ok);
+
+private:
+    QThreadPool *workers;
+    // Runs the writer for start()
+    QThreadPool *driver;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> running;
+
+    QString htmlPath;
+    QString jsonPath;
+    QString root1;
+    QString root2;
+    qint64 budget;
+    QString error;
+};
+
+#endif // REPORTEXPORTER_H
@@ -0,0 +1,91 @@
+#ifndef SPILLBUFFER_H
+#define SPILLBUFFER_H
+
+#include <QTemporaryFile>
+#include <QVector>
+#include <memory>
+#include <type_traits>
+
+// Append-only array that stays in memory up to a byte budget and moves to
+// a temporary file beyond it. After finish() elements are read back through
+// a memory mapping, so the page cache rather than the heap holds them.
+template<typename T>
+class SpillBuffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "elements are written to disk as bytes");
+
+public:
+    explicit SpillBuffer(qint64 memoryBudget)
+        : budget(memoryBudget)
+        , count(0)
+        , mapped(nullptr)
+        , failed(false)
+    {
+    }
+
+    bool isEmpty() const { return count == 0; }
+    qint64 size() const { return count; }
+    bool isSpilled() const { return file != nullptr; }
+
+    void append(const T &value)
+    {
+        if (!file && qint64(memory.size() + 1) * qint64(sizeof(T)) > budget) {
+            spill();
+        }
+        memory.append(value);
+        ++count;
+        // Once spilled, memory only batches writes
+        if (file && memory.size() >= kWriteBatch) {
+            flush();
+        }
+    }
+
+    // Call once after the last append(); false if the file could not be
+    // written or mapped
+    bool finish()
+    {
+        if (file) {
+            flush();
+            if (!failed && count > 0) {
+                mapped = reinterpret_cast<const T *>(file->map(0, file->size()));
+                failed = mapped == nullptr;
+            }
+        }
+        return !failed;
+    }
+
+    T at(qint64 index) const
+    {
+        return mapped ? mapped[index] : memory[index];
+    }
+
+private:
+    static const int kWriteBatch = int(64 * 1024 / sizeof(T)) + 1;
+
+    void spill()
+    {
+        file.reset(new QTemporaryFile());
+        if (!file->open()) {
+            failed = true;
+        }
+        flush();
+    }
+
+    void flush()
+    {
+        const qint64 bytes = qint64(memory.size()) * qint64(sizeof(T));
+        if (!failed && file->write(reinterpret_cast<const char *>(memory.constData()), bytes) != bytes) {
+            failed = true;
+        }
+        memory.clear();
+    }
+
+    qint64 budget;
+    qint64 count;
+    QVector<T> memory;
+    std::unique_ptr<QTemporaryFile> file;
+    const T *mapped;
+    bool failed;
+};
+
+#endif // SPILLBUFFER_H
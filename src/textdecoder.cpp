@@ -0,0 +1,283 @@
+#include "textdecoder.h"
+#include "tracer.h"
+#include <QFile>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Enough to tell UTF-16 from 8-bit text
+const qsizetype kSniffBytes = 4096;
+
+// 8-bit text is taken for damaged UTF-8, rather than Windows-1252, while at
+// least this many valid multi-byte sequences come per invalid one
+const qsizetype kValidPerInvalid = 8;
+
+// Windows-1252 in 0x80-0x9F; the five undefined bytes map to C1 controls
+// like in Latin-1
+const char16_t kWindows1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+// UTF-16 text that is mostly ASCII has a zero in nearly every other byte,
+// which 8-bit encodings and UTF-8 never have
+bool sniffUtf16(const uchar *data, qsizetype size, TextDecoder::Encoding *encoding)
+{
+    const qsizetype sample = qMin(size, kSniffBytes) & ~qsizetype(1);
+    if (sample < 4) {
+        return false;
+    }
+    qsizetype evenZeros = 0, oddZeros = 0;
+    for (qsizetype i = 0; i < sample; i += 2) {
+        evenZeros += data[i] == 0;
+        oddZeros += data[i + 1] == 0;
+    }
+    const qsizetype pairs = sample / 2;
+    if (oddZeros * 5 >= pairs * 2 && evenZeros * 20 < pairs) {
+        *encoding = TextDecoder::Utf16LE;
+        return true;
+    }
+    if (evenZeros * 5 >= pairs * 2 && oddZeros * 20 < pairs) {
+        *encoding = TextDecoder::Utf16BE;
+        return true;
+    }
+    return false;
+}
+
+// Validates and transcodes in one pass; out needs room for size units.
+// Runs of ASCII are widened 16 bytes at a time. Each invalid or truncated
+// sequence becomes one U+FFFD, covering its longest valid prefix as the
+// WHATWG decoder does. Returns the number of units written.
+qsizetype decodeUtf8(const uchar *data, qsizetype size, char16_t *out,
+                     qsizetype *invalid, qsizetype *multibyte)
+{
+    const uchar *p = data;
+    const uchar *end = data + size;
+    char16_t *o = out;
+
+    while (p < end) {
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i cr = _mm_set1_epi8('\r');
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            // High bit set, or a CR that may start a CRLF
+            if (_mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, cr))) != 0) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(o), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(o + 8), _mm_unpackhi_epi8(chunk, zero));
+            p += 16;
+            o += 16;
+        }
+        if (p == end) {
+            break;
+        }
+#endif
+        const uchar c = *p;
+        if (c < 0x80) {
+            if (c == '\r' && end - p > 1 && p[1] == '\n') {
+                ++p;
+                continue;
+            }
+            *o++ = c;
+            ++p;
+            continue;
+        }
+
+        // Lead bytes that would be overlong, surrogates or beyond U+10FFFF
+        // are rejected through the range of the first continuation byte
+        int length;
+        uchar low = 0x80, high = 0xBF;
+        char32_t codePoint;
+        if (c >= 0xC2 && c <= 0xDF) {
+            length = 2;
+            codePoint = c & 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            length = 3;
+            codePoint = c & 0x0F;
+            if (c == 0xE0) {
+                low = 0xA0;
+            } else if (c == 0xED) {
+                high = 0x9F;
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            length = 4;
+            codePoint = c & 0x07;
+            if (c == 0xF0) {
+                low = 0x90;
+            } else if (c == 0xF4) {
+                high = 0x8F;
+            }
+        } else {
+            ++*invalid;
+            *o++ = 0xFFFD;
+            ++p;
+            continue;
+        }
+        int matched = 1;
+        for (; matched < length && p + matched < end; ++matched) {
+            const uchar next = p[matched];
+            if (next < (matched == 1 ? low : 0x80) || next > (matched == 1 ? high : 0xBF)) {
+                break;
+            }
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        if (matched < length) {
+            ++*invalid;
+            *o++ = 0xFFFD;
+            p += matched;
+            continue;
+        }
+        ++*multibyte;
+        p += length;
+
+        if (codePoint >= 0x10000) {
+            *o++ = char16_t(0xD800 + ((codePoint - 0x10000) >> 10));
+            *o++ = char16_t(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+        } else {
+            *o++ = char16_t(codePoint);
+        }
+    }
+    return o - out;
+}
+
+qsizetype decodeUtf16(const uchar *data, qsizetype size, bool bigEndian, char16_t *out)
+{
+    char16_t *o = out;
+    const qsizetype units = size / 2;
+    char16_t previous = 0;
+    for (qsizetype i = 0; i < units; ++i) {
+        const uchar *unit = data + 2 * i;
+        char16_t c = bigEndian ? char16_t((unit[0] << 8) | unit[1]) : char16_t((unit[1] << 8) | unit[0]);
+        if (c == u'\n' && previous == u'\r') {
+            --o;
+        }
+        *o++ = c;
+        previous = c;
+    }
+    if (size & 1) {
+        *o++ = 0xFFFD;
+    }
+    return o - out;
+}
+
+qsizetype decodeWindows1252(const uchar *data, qsizetype size, char16_t *out)
+{
+    char16_t *o = out;
+    for (qsizetype i = 0; i < size; ++i) {
+        const uchar c = data[i];
+        if (c == '\r' && i + 1 < size && data[i + 1] == '\n') {
+            continue;
+        }
+        *o++ = (c >= 0x80 && c < 0xA0) ? kWindows1252High[c - 0x80] : char16_t(c);
+    }
+    return o - out;
+}
+
+} // namespace
+
+QString TextDecoder::decode(const char *data, qsizetype size, Encoding *encoding)
+{
+    TraceScope trace("decode");
+    trace.arg("bytes", size);
+
+    qsizetype bomLength;
+    const Encoding detected = detect(data, size, &bomLength);
+    return decodeAs(data + bomLength, size - bomLength, detected, encoding);
+}
+
+TextDecoder::Encoding TextDecoder::detect(const char *data, qsizetype size, qsizetype *bomLength)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    Encoding detected = Utf8;
+    qsizetype bom = 0;
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        bom = 3;
+    } else if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        detected = Utf16LE;
+        bom = 2;
+    } else if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        detected = Utf16BE;
+        bom = 2;
+    } else {
+        sniffUtf16(bytes, size, &detected);
+    }
+    if (bomLength) {
+        *bomLength = bom;
+    }
+    return detected;
+}
+
+QString TextDecoder::decodeAs(const char *data, qsizetype size, Encoding encoding, Encoding *used)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    Encoding detected = encoding;
+
+    // Every encoding here yields at most one UTF-16 unit per input byte
+    QString text(size, Qt::Uninitialized);
+    char16_t *out = reinterpret_cast<char16_t *>(text.data());
+    qsizetype length;
+    if (detected == Utf16LE || detected == Utf16BE) {
+        length = decodeUtf16(bytes, size, detected == Utf16BE, out);
+    } else if (detected == Windows1252) {
+        length = decodeWindows1252(bytes, size, out);
+    } else {
+        // A few bad sequences among many good ones are damage, like a
+        // truncated copy; many are the signature of an 8-bit encoding
+        qsizetype invalid = 0, multibyte = 0;
+        length = decodeUtf8(bytes, size, out, &invalid, &multibyte);
+        if (invalid > 0 && invalid * kValidPerInvalid > multibyte) {
+            detected = Windows1252;
+            length = decodeWindows1252(bytes, size, out);
+        }
+    }
+    text.resize(length);
+
+    if (used) {
+        *used = detected;
+    }
+    return text;
+}
+
+QString TextDecoder::decodeFile(const QString &filePath, Encoding *encoding)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    // Decode straight from the page cache; pipes and the like are read
+    const qint64 size = file.size();
+    if (size > 0) {
+        if (const uchar *mapped = file.map(0, size)) {
+            return decode(reinterpret_cast<const char *>(mapped), size, encoding);
+        }
+    }
+    return decode(file.readAll(), encoding);
+}
+
+bool TextDecoder::isUtf16(const QByteArray &data)
+{
+    const Encoding encoding = detect(data.constData(), data.size());
+    return encoding == Utf16LE || encoding == Utf16BE;
+}
+
+const char *TextDecoder::name(Encoding encoding)
+{
+    switch (encoding) {
+    case Utf16LE:
+        return "UTF-16LE";
+    case Utf16BE:
+        return "UTF-16BE";
+    case Windows1252:
+        return "Windows-1252";
+    default:
+        return "UTF-8";
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef TEXTDECODER_H
+#define TEXTDECODER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Turns file contents into text. The encoding comes from a byte order mark
+// if there is one, otherwise UTF-16 is recognised by its zero bytes. Other
+// text is UTF-8, with U+FFFD for the odd invalid sequence, unless invalid
+// sequences are common; then it is read as Windows-1252 (a superset of
+// Latin-1). CRLF line ends become LF in the same pass.
+class TextDecoder
+{
+public:
+    enum Encoding {
+        Utf8,
+        Utf16LE,
+        Utf16BE,
+        Windows1252
+    };
+
+    static QString decode(const char *data, qsizetype size, Encoding *encoding = nullptr);
+    static QString decode(const QByteArray &data, Encoding *encoding = nullptr)
+    {
+        return decode(data.constData(), data.size(), encoding);
+    }
+
+    // The encoding decode() would start from: UTF-8, or UTF-16 by byte
+    // order mark or zero bytes. bomLength receives the bytes to skip.
+    static Encoding detect(const char *data, qsizetype size, qsizetype *bomLength = nullptr);
+    // Decodes part of a text whose encoding is already known, such as one
+    // line of a large file. UTF-8 may still fall back to Windows-1252.
+    static QString decodeAs(const char *data, qsizetype size, Encoding encoding, Encoding *used = nullptr);
+
+    // Reads a file through a memory mapping where possible; an unreadable
+    // file gives an empty string
+    static QString decodeFile(const QString &filePath, Encoding *encoding = nullptr);
+
+    // By byte order mark or zero-byte pattern; such text is full of NULs
+    // and must not be taken for binary data
+    static bool isUtf16(const QByteArray &data);
+
+    static const char *name(Encoding encoding);
+};
+
+#endif // TEXTDECODER_H
@@ -0,0 +1,198 @@
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QVector>
+
+namespace {
+
+// Enough for long sessions; later events are dropped rather than growing
+// without bound
+const int kMaxEvents = 1000000;
+
+struct TraceLog {
+    TraceLog() : dropped(0) {}
+
+    QMutex mutex;
+    QVector<Tracer::Event> events;
+    QString outputPath;
+    QElapsedTimer clock;
+    int dropped;
+};
+
+TraceLog &traceLog()
+{
+    static TraceLog log;
+    return log;
+}
+
+int currentThread()
+{
+    static std::atomic<int> nextThread(0);
+    thread_local int thread = ++nextThread;
+    return thread;
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled(false);
+
+void Tracer::enable(const QString &outputPath)
+{
+    TraceLog &log = traceLog();
+    {
+        QMutexLocker locker(&log.mutex);
+        log.outputPath = outputPath;
+        log.clock.start();
+    }
+    enabled = true;
+}
+
+qint64 Tracer::now()
+{
+    return traceLog().clock.nsecsElapsed();
+}
+
+void Tracer::complete(const char *name, qint64 start, const char *argName, qint64 argValue)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    Event event;
+    event.name = name;
+    event.start = start;
+    event.duration = now() - start;
+    event.argCount = argName ? 1 : 0;
+    event.argNames[0] = argName;
+    event.argValues[0] = argValue;
+    record(event);
+}
+
+void Tracer::record(const Event &event)
+{
+    TraceLog &log = traceLog();
+    Event stored = event;
+    stored.thread = currentThread();
+
+    QMutexLocker locker(&log.mutex);
+    if (log.events.size() < kMaxEvents) {
+        log.events.append(stored);
+    } else {
+        ++log.dropped;
+    }
+}
+
+int Tracer::mark()
+{
+    if (!isEnabled()) {
+        return 0;
+    }
+    TraceLog &log = traceLog();
+    QMutexLocker locker(&log.mutex);
+    return log.events.size();
+}
+
+QString Tracer::summary(int since)
+{
+    if (!isEnabled()) {
+        return QString();
+    }
+
+    struct Stage {
+        const char *name;
+        qint64 total;
+        int count;
+    };
+    QVector<Stage> stages;
+
+    TraceLog &log = traceLog();
+    const int thread = currentThread();
+    {
+        QMutexLocker locker(&log.mutex);
+        for (int i = since; i < log.events.size(); ++i) {
+            const Event &event = log.events[i];
+            if (event.thread != thread) {
+                continue;
+            }
+
+            // Few distinct stages per diff; a linear search beats a hash
+            int k = 0;
+            while (k < stages.size() && qstrcmp(stages[k].name, event.name) != 0) {
+                ++k;
+            }
+            if (k == stages.size()) {
+                stages.append({ event.name, 0, 0 });
+            }
+            stages[k].total += event.duration;
+            ++stages[k].count;
+        }
+    }
+
+    QStringList parts;
+    for (const Stage &stage : stages) {
+        QString part = QString("%1 %2 ms").arg(QString::fromLatin1(stage.name))
+                                           .arg(stage.total / 1e6, 0, 'f', 1);
+        if (stage.count > 1) {
+            part += QString(" (%1x)").arg(stage.count);
+        }
+        parts.append(part);
+    }
+    return parts.join(", ");
+}
+
+bool Tracer::writeChromeTrace()
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    TraceLog &log = traceLog();
+    QMutexLocker locker(&log.mutex);
+
+    QFile file(log.outputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    // Complete ("X") events; timestamps are in microseconds. Names are
+    // literals from the code base and need no escaping.
+    QByteArray json = "{\"traceEvents\":[\n";
+    for (int i = 0; i < log.events.size(); ++i) {
+        const Event &event = log.events[i];
+        json += "{\"name\":\"";
+        json += event.name;
+        json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(event.thread);
+        json += ",\"ts\":" + QByteArray::number(event.start / 1e3, 'f', 3);
+        json += ",\"dur\":" + QByteArray::number(event.duration / 1e3, 'f', 3);
+        if (event.argCount > 0) {
+            json += ",\"args\":{";
+            for (int k = 0; k < event.argCount; ++k) {
+                json += k > 0 ? ",\"" : "\"";
+                json += event.argNames[k];
+                json += "\":" + QByteArray::number(event.argValues[k]);
+            }
+            json += "}";
+        }
+        json += i + 1 < log.events.size() ? "},\n" : "}\n";
+    }
+    json += "],\"otherData\":{\"droppedEvents\":" + QByteArray::number(log.dropped) + "}}\n";
+
+    return file.write(json) == json.size();
+}
+
+void TraceScope::finish()
+{
+    Tracer::Event event;
+    event.name = name;
+    event.start = start;
+    event.duration = Tracer::now() - start;
+    event.argCount = argCount;
+    for (int i = 0; i < argCount; ++i) {
+        event.argNames[i] = argNames[i];
+        event.argValues[i] = argValues[i];
+    }
+    Tracer::record(event);
+}
@@ -0,0 +1,95 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Stage timings for finding out where a slow diff or comparison spends its
+// time. Off by default: a TraceScope then costs one relaxed load and a
+// branch. When enabled (DIFFY_TRACE=<file> in the environment), events are
+// collected in memory, summarised per stage for the status bar and written
+// as Chrome trace-event JSON (chrome://tracing, Perfetto) on exit.
+class Tracer
+{
+public:
+    struct Event {
+        const char *name;       // String literal
+        qint64 start;
+        qint64 duration;
+        int thread;
+        int argCount;
+        const char *argNames[2];
+        qint64 argValues[2];
+    };
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void enable(const QString &outputPath);
+
+    // Nanoseconds since tracing was enabled
+    static qint64 now();
+    // Records a stage that began at start and ends now; for spans that do
+    // not fit one scope, like an asynchronous folder comparison
+    static void complete(const char *name, qint64 start,
+                         const char *argName = nullptr, qint64 argValue = 0);
+
+    // Position in the event log, for summary()
+    static int mark();
+    // Time per stage recorded by the calling thread since mark, e.g.
+    // "readFile 1.2 ms, myersDiff 3.4 ms (12x)"
+    static QString summary(int since);
+
+    // Writes everything recorded to the file given to enable()
+    static bool writeChromeTrace();
+
+private:
+    friend class TraceScope;
+
+    static void record(const Event &event);
+
+    static std::atomic<bool> enabled;
+};
+
+// Times the enclosing scope as one stage. name and argument names must be
+// string literals; they are stored, not copied.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : name(name)
+        , start(Tracer::isEnabled() ? Tracer::now() : -1)
+        , argCount(0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (start >= 0) {
+            finish();
+        }
+    }
+
+    // Input sizes and counts shown with the stage; at most two are kept
+    void arg(const char *argName, qint64 value)
+    {
+        if (start >= 0 && argCount < 2) {
+            argNames[argCount] = argName;
+            argValues[argCount] = value;
+            ++argCount;
+        }
+    }
+
+private:
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    void finish();
+
+    const char *name;
+    qint64 start;
+    int argCount;
+    const char *argNames[2];
+    qint64 argValues[2];
+};
+
+#endif // TRACER_H
@@ -0,0 +1,273 @@
+#include "zipreader.h"
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+const quint32 kEndOfCentralDirSignature = 0x06054b50;
+const quint32 kCentralDirEntrySignature = 0x02014b50;
+const quint32 kLocalHeaderSignature = 0x04034b50;
+
+const int kEndOfCentralDirSize = 22;
+const int kCentralDirEntrySize = 46;
+const int kLocalHeaderSize = 30;
+
+const quint16 kMethodStored = 0;
+const quint16 kMethodDeflated = 8;
+
+inline quint16 read16(const uchar *p) { return qFromLittleEndian<quint16>(p); }
+inline quint32 read32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+
+// Sequential device over one archive entry. The compressed bytes live in the
+// reader's mapping, so the whole span is handed to zlib at once and output is
+// produced directly into the buffer passed to readData().
+class ZipEntryDevice : public QIODevice
+{
+public:
+    ZipEntryDevice(const uchar *compressed, quint32 compressedSize,
+                   quint32 uncompressedSize, quint16 method)
+        : input(compressed)
+        , inputSize(compressedSize)
+        , remaining(uncompressedSize)
+        , method(method)
+        , finished(false)
+    {
+#ifdef HAVE_ZLIB
+        std::memset(&stream, 0, sizeof(stream));
+        if (method == kMethodDeflated) {
+            stream.next_in = const_cast<Bytef *>(input);
+            stream.avail_in = inputSize;
+            // Negative window bits: raw deflate data, no zlib header
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+                finished = true;
+            }
+        }
+#endif
+    }
+
+    ~ZipEntryDevice() override
+    {
+#ifdef HAVE_ZLIB
+        if (method == kMethodDeflated) {
+            inflateEnd(&stream);
+        }
+#endif
+    }
+
+    bool isSequential() const override { return true; }
+
+    qint64 bytesAvailable() const override
+    {
+        return qint64(remaining) + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *out, qint64 maxlen) override
+    {
+        if (finished || remaining == 0) {
+            return -1;
+        }
+
+        if (method == kMethodStored) {
+            qint64 n = qMin<qint64>(maxlen, remaining);
+            std::memcpy(out, input + (inputSize - remaining), size_t(n));
+            remaining -= quint32(n);
+            return n;
+        }
+
+#ifdef HAVE_ZLIB
+        uInt capacity = uInt(qMin<qint64>(maxlen, std::numeric_limits<uInt>::max()));
+        stream.next_out = reinterpret_cast<Bytef *>(out);
+        stream.avail_out = capacity;
+
+        int status = inflate(&stream, Z_NO_FLUSH);
+        qint64 produced = capacity - stream.avail_out;
+        remaining -= quint32(qMin<qint64>(produced, remaining));
+
+        if (status == Z_STREAM_END) {
+            finished = true;
+        } else if (status != Z_OK) {
+            setErrorString(QString("Inflate failed: %1").arg(stream.msg ? stream.msg : "unknown error"));
+            finished = true;
+            return produced > 0 ? produced : -1;
+        }
+        return produced;
+#else
+        Q_UNUSED(out);
+        Q_UNUSED(maxlen);
+        return -1;
+#endif
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    const uchar *input;
+    quint32 inputSize;
+    quint32 remaining;
+    quint16 method;
+    bool finished;
+#ifdef HAVE_ZLIB
+    z_stream stream;
+#endif
+};
+
+} // namespace
+
+ZipReader::ZipReader(const QString &filePath)
+    : file(filePath)
+    , data(nullptr)
+    , size(0)
+{
+}
+
+ZipReader::~ZipReader()
+{
+    if (data) {
+        file.unmap(const_cast<uchar *>(data));
+    }
+}
+
+bool ZipReader::open()
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    size = file.size();
+    if (size < kEndOfCentralDirSize) {
+        error = "Not a ZIP archive";
+        return false;
+    }
+
+    data = file.map(0, size);
+    if (!data) {
+        error = file.errorString();
+        return false;
+    }
+
+    return readCentralDirectory();
+}
+
+bool ZipReader::readCentralDirectory()
+{
+    // The end-of-central-directory record sits at the end of the file,
+    // followed only by an optional comment of up to 64 KiB
+    qint64 limit = qMax<qint64>(0, size - kEndOfCentralDirSize - 0xFFFF);
+    qint64 eocd = -1;
+    for (qint64 pos = size - kEndOfCentralDirSize; pos >= limit; --pos) {
+        if (read32(data + pos) == kEndOfCentralDirSignature) {
+            eocd = pos;
+            break;
+        }
+    }
+
+    if (eocd < 0) {
+        error = "ZIP end of central directory not found";
+        return false;
+    }
+
+    quint16 entryCount = read16(data + eocd + 10);
+    quint32 dirSize = read32(data + eocd + 12);
+    quint32 dirOffset = read32(data + eocd + 16);
+
+    if (dirOffset == 0xFFFFFFFF || entryCount == 0xFFFF) {
+        error = "ZIP64 archives are not supported";
+        return false;
+    }
+    if (qint64(dirOffset) + dirSize > eocd) {
+        error = "Corrupt ZIP central directory";
+        return false;
+    }
+
+    entries.reserve(entryCount);
+
+    const uchar *p = data + dirOffset;
+    const uchar *end = p + dirSize;
+    for (int i = 0; i < entryCount; ++i) {
+        if (end - p < kCentralDirEntrySize || read32(p) != kCentralDirEntrySignature) {
+            error = "Corrupt ZIP central directory entry";
+            return false;
+        }
+
+        quint16 nameLength = read16(p + 28);
+        quint16 extraLength = read16(p + 30);
+        quint16 commentLength = read16(p + 32);
+        qint64 recordSize = qint64(kCentralDirEntrySize) + nameLength + extraLength + commentLength;
+        if (end - p < recordSize) {
+            error = "Corrupt ZIP central directory entry";
+            return false;
+        }
+
+        Entry entry;
+        entry.method = read16(p + 10);
+        entry.compressedSize = read32(p + 20);
+        entry.uncompressedSize = read32(p + 24);
+        entry.localHeaderOffset = read32(p + 42);
+
+        QString name = QString::fromUtf8(reinterpret_cast<const char *>(p + kCentralDirEntrySize), nameLength);
+        entries.insert(name, entry);
+
+        p += recordSize;
+    }
+
+    return true;
+}
+
+bool ZipReader::contains(const QString &entryName) const
+{
+    return entries.contains(entryName);
+}
+
+QIODevice *ZipReader::openEntry(const QString &entryName)
+{
+    auto it = entries.constFind(entryName);
+    if (it == entries.constEnd()) {
+        error = QString("Entry not found: %1").arg(entryName);
+        return nullptr;
+    }
+
+    const Entry &entry = it.value();
+
+    // The local header repeats name and extra field with possibly different
+    // lengths, so the payload offset has to be taken from it
+    qint64 headerPos = entry.localHeaderOffset;
+    if (headerPos + kLocalHeaderSize > size || read32(data + headerPos) != kLocalHeaderSignature) {
+        error = QString("Corrupt local header for %1").arg(entryName);
+        return nullptr;
+    }
+
+    qint64 payloadPos = headerPos + kLocalHeaderSize
+                      + read16(data + headerPos + 26) + read16(data + headerPos + 28);
+    if (payloadPos + entry.compressedSize > size) {
+        error = QString("Truncated ZIP entry %1").arg(entryName);
+        return nullptr;
+    }
+
+    bool supported = entry.method == kMethodStored;
+#ifdef HAVE_ZLIB
+    supported = supported || entry.method == kMethodDeflated;
+#endif
+    if (!supported) {
+        error = QString("Unsupported compression method %1 for %2").arg(entry.method).arg(entryName);
+        return nullptr;
+    }
+    // A stored entry is copied as is, so its sizes must agree or reads
+    // would run past the payload
+    if (entry.method == kMethodStored && entry.compressedSize != entry.uncompressedSize) {
+        error = QString("Corrupt ZIP entry %1").arg(entryName);
+        return nullptr;
+    }
+
+    auto *device = new ZipEntryDevice(data + payloadPos, entry.compressedSize,
+                                      entry.uncompressedSize, entry.method);
+    // Unbuffered: the reader's buffer is the inflate target, no extra copy
+    device->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    return device;
+}
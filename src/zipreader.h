@@ -0,0 +1,47 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+
+// Minimal read-only ZIP archive reader.
+//
+// The archive is memory-mapped and only the central directory is parsed, so
+// opening an entry never touches the payload of unrelated entries (e.g. the
+// images embedded in a DOCX). Entries are exposed as sequential QIODevices
+// that inflate straight from the mapping into the caller's buffer.
+class ZipReader
+{
+public:
+    explicit ZipReader(const QString &filePath);
+    ~ZipReader();
+
+    bool open();
+    bool contains(const QString &entryName) const;
+
+    // Returns a device streaming the uncompressed entry, or nullptr.
+    // The caller owns the device; it must not outlive this reader.
+    QIODevice *openEntry(const QString &entryName);
+
+    QString errorString() const { return error; }
+
+private:
+    struct Entry {
+        quint16 method;
+        quint32 compressedSize;
+        quint32 uncompressedSize;
+        quint32 localHeaderOffset;
+    };
+
+    bool readCentralDirectory();
+
+    QFile file;
+    const uchar *data;
+    qint64 size;
+    QHash<QString, Entry> entries;
+    QString error;
+};
+
+#endif // ZIPREADER_H
@@ -24,6 +24,53 @@ required_files=(
     "src/documentparser.cpp"
     "src/folderview.h"
     "src/folderview.cpp"
+    "src/zipreader.h"
+    "src/zipreader.cpp"
+    "src/foldercompareengine.h"
+    "src/foldercompareengine.cpp"
+    "src/filecomparator.h"
+    "src/filecomparator.cpp"
+    "src/fasthash.h"
+    "src/fasthash.cpp"
+    "src/foldermodel.h"
+    "src/foldermodel.cpp"
+    "src/foldermanifest.h"
+    "src/foldermanifest.cpp"
+    "src/folderwatcher.h"
+    "src/folderwatcher.cpp"
+    "src/renamedetector.h"
+    "src/renamedetector.cpp"
+    "src/diffstatsscheduler.h"
+    "src/diffstatsscheduler.cpp"
+    "src/ignorematcher.h"
+    "src/ignorematcher.cpp"
+    "src/gitrepository.h"
+    "src/gitrepository.cpp"
+    "src/gitcompareengine.h"
+    "src/gitcompareengine.cpp"
+    "src/tracer.h"
+    "src/tracer.cpp"
+    "src/monotonicarena.h"
+    "src/monotonicarena.cpp"
+    "src/diffsession.h"
+    "src/diffsession.cpp"
+    "src/diffpreloader.h"
+    "src/diffpreloader.cpp"
+    "src/textdecoder.h"
+    "src/textdecoder.cpp"
+    "src/spillbuffer.h"
+    "src/largefilediff.h"
+    "src/largefilediff.cpp"
+    "src/alignmentmap.h"
+    "src/alignmentmap.cpp"
+    "src/overviewruler.h"
+    "src/overviewruler.cpp"
+    "src/diffcache.h"
+    "src/diffcache.cpp"
+    "src/linesegmenter.h"
+    "src/linesegmenter.cpp"
+    "src/reportexporter.h"
+    "src/reportexporter.cpp"
     "README.md"
 )
 